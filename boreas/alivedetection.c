@@ -72,8 +72,7 @@ scan (alive_test_t alive_test)
   int number_of_targets;
   int number_of_dead_hosts;
   pthread_t sniffer_thread_id;
-  GHashTableIter target_hosts_iter;
-  gpointer key, value;
+  hosts_data_t *hosts_data = scanner.hosts_data;
   struct timeval start_time, end_time;
   int scandb_id;
   gchar *scan_id;
@@ -83,7 +82,7 @@ scan (alive_test_t alive_test)
   gboolean limit_reached_handled = FALSE; /* Scan restrictions related. */
 
   gettimeofday (&start_time, NULL);
-  number_of_targets = g_hash_table_size (scanner.hosts_data->targethosts);
+  number_of_targets = hosts_data->count;
 
   scandb_id = atoi (prefs_get ("ov_maindbid"));
   scan_id = get_openvas_scan_id (prefs_get ("db_address"), scandb_id);
@@ -91,8 +90,8 @@ scan (alive_test_t alive_test)
              number_of_targets);
 
   /* Sniffer thread needed if any alive test besides ALIVE_TEST_CONSIDER_ALIVE
-   * was chosen. */
-  if (alive_test != ALIVE_TEST_CONSIDER_ALIVE)
+   * was chosen or ports are to be discovered. */
+  if (alive_test != ALIVE_TEST_CONSIDER_ALIVE || scanner.port_discovery)
     {
       sniffer_thread_id = 0;
       start_sniffer_thread (&scanner, &sniffer_thread_id);
@@ -103,8 +102,6 @@ scan (alive_test_t alive_test)
    * that increases gradually. */
   if (alive_test == ALIVE_TEST_ICMP)
     {
-      g_hash_table_iter_init (&target_hosts_iter,
-                              scanner.hosts_data->targethosts);
       int batch = 1000;
       int curr_alive = 0;
       prev_alive = 0;
@@ -113,21 +110,21 @@ scan (alive_test_t alive_test)
        * last batch is send after all hosts were checked and we waited for last
        * packets to arrive.*/
       remaining_batch = number_of_targets;
-      for (int packets_send = 0;
-           g_hash_table_iter_next (&target_hosts_iter, &key, &value);)
+      for (int packets_send = 0; packets_send < number_of_targets;)
         {
-          send_icmp (key, value, &scanner);
+          send_icmp (&scanner, packets_send);
           packets_send++;
           /* Send dead hosts update after batch number of packets were send and
            * we still have more than batch size packets remaining. */
           if (packets_send % batch == 0
               && (number_of_targets - packets_send) > batch)
             {
+              flush_probe_batches (&scanner);
               /* The number of dead hosts we have to send to ospd is the batch
                * size minus the newly found alive hosts. The newly found alive
                * hosts is the diff between the current total of alive hosts and
                * the total of the last batch. */
-              curr_alive = g_hash_table_size (scanner.hosts_data->alivehosts);
+              curr_alive = hosts_data_alive_count (hosts_data);
               number_of_dead_hosts = batch - (curr_alive - prev_alive);
 
               /* If the max_scan_hosts limit was reached we can not tell ospd
@@ -172,74 +169,61 @@ scan (alive_test_t alive_test)
               prev_alive = curr_alive;
             }
         }
+      flush_probe_batches (&scanner);
     }
-  else if (alive_test & ALIVE_TEST_ICMP)
-    {
-      g_debug ("%s: ICMP Ping", __func__);
-      g_hash_table_foreach (scanner.hosts_data->targethosts, send_icmp,
-                            &scanner);
-      wait_until_so_sndbuf_empty (scanner.icmpv4soc, 10);
-      wait_until_so_sndbuf_empty (scanner.icmpv6soc, 10);
-      usleep (500000);
-    }
-  if (alive_test & ALIVE_TEST_TCP_SYN_SERVICE)
-    {
-      g_debug ("%s: TCP-SYN Service Ping", __func__);
-      scanner.tcp_flag = TH_SYN; /* SYN */
-      g_hash_table_foreach (scanner.hosts_data->targethosts, send_tcp,
-                            &scanner);
-      wait_until_so_sndbuf_empty (scanner.tcpv4soc, 10);
-      wait_until_so_sndbuf_empty (scanner.tcpv6soc, 10);
-      usleep (500000);
-    }
-  if (alive_test & ALIVE_TEST_TCP_ACK_SERVICE)
-    {
-      g_debug ("%s: TCP-ACK Service Ping", __func__);
-      scanner.tcp_flag = TH_ACK; /* ACK */
-      g_hash_table_foreach (scanner.hosts_data->targethosts, send_tcp,
-                            &scanner);
-      wait_until_so_sndbuf_empty (scanner.tcpv4soc, 10);
-      wait_until_so_sndbuf_empty (scanner.tcpv6soc, 10);
-      usleep (500000);
-    }
-  if (alive_test & ALIVE_TEST_ARP)
+  else
     {
-      g_debug ("%s: ARP Ping", __func__);
-      g_hash_table_foreach (scanner.hosts_data->targethosts, send_arp,
-                            &scanner);
-      wait_until_so_sndbuf_empty (scanner.arpv4soc, 10);
-      wait_until_so_sndbuf_empty (scanner.arpv6soc, 10);
+      g_debug ("%s: Send probes of all alive test methods interleaved",
+               __func__);
+      send_probes (&scanner, alive_test, get_alive_test_send_threads ());
     }
+  if (alive_test & ALIVE_TEST_ICMP)
+    send_icmp_retries (&scanner, get_icmp_retries (),
+                       get_icmp_grace_period ());
   if (alive_test & ALIVE_TEST_CONSIDER_ALIVE)
     {
       g_debug ("%s: Consider Alive", __func__);
-      for (g_hash_table_iter_init (&target_hosts_iter,
-                                   scanner.hosts_data->targethosts);
-           g_hash_table_iter_next (&target_hosts_iter, &key, &value);)
+      for (guint32 i = 0; i < hosts_data->count; i++)
         {
-          g_hash_table_add (scanner.hosts_data->alivehosts, g_strdup (key));
-          handle_scan_restrictions (&scanner, key);
+          gchar addr_str[INET6_ADDRSTRLEN];
+
+          if (hosts_data_set_alive (hosts_data, i)
+              && hosts_data_addr_str (hosts_data, i, addr_str))
+            handle_scan_restrictions (&scanner, addr_str);
         }
     }
 
-  /* Stop sniffer thread if any alive test besides ALIVE_TEST_CONSIDER_ALIVE was
-   * chosen. */
   if (alive_test != ALIVE_TEST_CONSIDER_ALIVE)
     {
       g_debug (
         "%s: all ping packets have been sent, wait a bit for rest of replies.",
         __func__);
 
-      for (unsigned int i = 0; i < get_alive_test_wait_timeout (); i++)
-        {
-          if (number_of_targets
-              == (int) g_hash_table_size (scanner.hosts_data->alivehosts))
-            break;
-          sleep (1); // 1 second is the minimum wait time
-        }
-      stop_sniffer_thread (&scanner, sniffer_thread_id);
+      hosts_data_wait_for_replies (hosts_data, g_get_monotonic_time (),
+                                   get_alive_test_wait_timeout ()
+                                     * G_USEC_PER_SEC);
+    }
+
+  /* Stateless TCP-SYN scan of the alive hosts. The sniffer puts the open and
+   * closed ports on the kb. */
+  if (scanner.port_discovery)
+    {
+      g_debug ("%s: TCP-SYN port discovery", __func__);
+      for (guint32 i = 0; i < hosts_data->count; i++)
+        if (hosts_data_is_alive (hosts_data, i))
+          send_port_probes (&scanner, i);
+      flush_probe_batches (&scanner);
+      wait_until_so_sndbuf_empty (scanner.tcpv4soc, 10);
+      wait_until_so_sndbuf_empty (scanner.tcpv6soc, 10);
+      hosts_data_wait_reply_timeout (hosts_data, g_get_monotonic_time (),
+                                     get_alive_test_wait_timeout ()
+                                       * G_USEC_PER_SEC);
     }
 
+  /* Stop sniffer thread if it was started. */
+  if (alive_test != ALIVE_TEST_CONSIDER_ALIVE || scanner.port_discovery)
+    stop_sniffer_thread (&scanner, sniffer_thread_id);
+
   /* If only ICMP was specified we continuously send updates about dead hosts to
    * ospd while checking the hosts. We now only have to send the dead hosts of
    * the last batch. This is done here to catch the last alive hosts which may
@@ -268,7 +252,7 @@ scan (alive_test_t alive_test)
         }
       else
         {
-          int curr_alive = g_hash_table_size (scanner.hosts_data->alivehosts);
+          int curr_alive = hosts_data_alive_count (hosts_data);
           number_of_dead_hosts = remaining_batch - (curr_alive - prev_alive);
           send_dead_hosts_to_ospd_openvas (number_of_dead_hosts);
         }
@@ -276,7 +260,7 @@ scan (alive_test_t alive_test)
   else
     {
       number_of_dead_hosts =
-        number_of_targets - g_hash_table_size (scanner.hosts_data->alivehosts);
+        number_of_targets - hosts_data_alive_count (hosts_data);
 
       /* Send number of dead hosts to ospd-openvas. We need to consider the scan
        * restrictions.*/
@@ -291,7 +275,7 @@ scan (alive_test_t alive_test)
 
   g_message ("Alive scan %s finished in %ld seconds: %d alive hosts of %d.",
              scan_id, end_time.tv_sec - start_time.tv_sec,
-             g_hash_table_size (scanner.hosts_data->alivehosts),
+             hosts_data_alive_count (hosts_data),
              number_of_targets);
   g_free (scan_id);
 
@@ -320,6 +304,31 @@ alive_detection_init (gvm_hosts_t *hosts, alive_test_t alive_test)
 
   /* Scanner */
 
+  /* Port discovery. Needs the TCP sockets. Only TCP ports are scanned. */
+  scanner.port_discovery = get_alive_test_port_discovery ();
+  scanner.cookie_key = g_random_int ();
+  scanner.discovery_ports = NULL;
+  if (scanner.port_discovery)
+    {
+      port_list = get_port_discovery_ports ();
+      if (port_list == NULL || validate_port_range (port_list))
+        {
+          g_warning ("%s: Invalid port range supplied for port discovery. "
+                     "Port discovery disabled.",
+                     __func__);
+          scanner.port_discovery = FALSE;
+        }
+      else
+        {
+          scanner.discovery_ports = g_array_new (FALSE, TRUE, sizeof (uint16_t));
+          portranges_array = port_range_ranges (port_list);
+          g_ptr_array_foreach (portranges_array, fill_tcp_ports_array,
+                               scanner.discovery_ports);
+          array_free (portranges_array);
+          portranges_array = NULL;
+        }
+    }
+
   /* Sockets */
   if ((error = set_all_needed_sockets (&scanner, alive_test)) != 0)
     return error;
@@ -327,30 +336,26 @@ alive_detection_init (gvm_hosts_t *hosts, alive_test_t alive_test)
   /* Do not print results in stdout. Only set for command line clients*/
   scanner.print_results = 0;
 
+  /* Pacing of probes. */
+  rate_limiter_init (&scanner.rate_limiter, get_alive_test_max_pps ());
+  scanner.route_cache = route_cache_new ();
+  scanner.arp_sweeper = arp_sweeper_new ();
+
   /* kb_t redis connection */
   int scandb_id = atoi (prefs_get ("ov_maindbid"));
   if ((scanner.main_kb = kb_direct_conn (prefs_get ("db_address"), scandb_id))
       == NULL)
     return -7;
+  /* Alive hosts are put on the queue by a publisher thread. Without it they
+   * are put on the queue directly. */
+  scanner.alive_queue = alive_queue_new ();
   /* TODO: pcap handle */
   // scanner.pcap_handle = open_live (NULL, FILTER_STR); //
   scanner.pcap_handle = NULL; /* is set in ping function */
 
   /* Results data */
-  /* hashtables */
-  scanner.hosts_data = g_malloc0 (sizeof (hosts_data_t));
-  scanner.hosts_data->alivehosts =
-    g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
-  scanner.hosts_data->targethosts =
-    g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
-
-  /* put all hosts we want to check in hashtable */
-  gvm_host_t *host;
-  for (host = gvm_hosts_next (hosts); host; host = gvm_hosts_next (hosts))
-    {
-      g_hash_table_insert (scanner.hosts_data->targethosts,
-                           gvm_host_value_str (host), host);
-    }
+  /* put all hosts we want to check in hosts data */
+  scanner.hosts_data = hosts_data_new (hosts);
   /* reset hosts iter */
   hosts->current = 0;
 
@@ -444,17 +449,33 @@ alive_detection_free (void *error)
 
   /* Ports array. */
   g_array_free (scanner.ports, TRUE);
+  if (scanner.discovery_ports)
+    g_array_free (scanner.discovery_ports, TRUE);
+
+  /* gvm_host_t are freed by caller of start_alive_detection()! */
+  hosts_data_free (scanner.hosts_data);
 
-  g_hash_table_destroy (scanner.hosts_data->alivehosts);
-  /* targethosts: (ipstr, gvm_host_t *)
-   * gvm_host_t are freed by caller of start_alive_detection()! */
-  g_hash_table_destroy (scanner.hosts_data->targethosts);
-  g_free (scanner.hosts_data);
+  alive_queue_free (scanner.alive_queue);
+  free_probe_batches (&scanner);
+  route_cache_free (scanner.route_cache);
+  arp_sweeper_free (scanner.arp_sweeper);
 
   /* Set error. */
   *(boreas_error_t *) error = error_out;
 }
 
+/**
+ * @brief Put all buffered alive hosts on the queue and stop the publisher.
+ *
+ * @param unused Unused.
+ */
+static void
+stop_alive_queue (__attribute__ ((unused)) void *unused)
+{
+  alive_queue_free (scanner.alive_queue);
+  scanner.alive_queue = NULL;
+}
+
 /**
  * @brief Start the scan of all specified hosts in gvm_hosts_t
  * list. Finish signal is put on Queue if scan is finished or an error occurred.
@@ -504,11 +525,15 @@ start_alive_detection (void *hosts_to_test)
   /* If alive detection thread returns, is canceled or killed unexpectedly a
    * finish signal is put on the queue for openvas to process.*/
   pthread_cleanup_push (put_finish_signal_on_queue, &fin_err);
+  /* All alive hosts have to be on the queue before the finish signal. */
+  pthread_cleanup_push (stop_alive_queue, NULL);
 
   /* Start the scan. */
   if (scan (alive_test) < 0)
     g_warning ("%s: error in scan()", __func__);
 
+  /* Put buffered alive hosts on queue. */
+  pthread_cleanup_pop (1);
   /* Put finish signal on queue. */
   pthread_cleanup_pop (1);
   /* Free memory, close sockets and connections. */
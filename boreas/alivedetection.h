@@ -25,13 +25,28 @@
 
 #include <pcap.h>
 
-/* to how many hosts are packets send to at a time. value <= 0 for no rate limit
- */
+/* How many packets may be sent back to back before pacing kicks in. */
 #define BURST 100
-/* how long (in microseconds) to wait until new BURST of packets is send */
-#define BURST_TIMEOUT 100000
+/* Default rate limit (packets per second) for sending probes. */
+#define DEFAULT_MAX_PPS 10000
+/* Lowest rate (packets per second) the rate limiter backs off to. */
+#define MIN_PPS 100
+/* Maximum number of threads sending probes. */
+#define MAX_SEND_THREADS 16
+/* Lowest time (ms) to wait for replies once the round trip time is known. */
+#define MIN_REPLY_TIMEOUT 250
+/* Number of round trip time samples needed before the wait is adapted. */
+#define MIN_RTT_SAMPLES 3
+/* Default maximum time (ms) to wait for replies before ICMP pings are sent
+ * again. */
+#define ICMP_RETRY_TIMEOUT 1000
 /* Src port of outgoing TCP pings. Used for filtering incoming packets. */
 #define FILTER_PORT 9910
+/* Interval (s) in which the alive detection metrics are published. */
+#define METRICS_INTERVAL 5
+/* Buckets of the round trip time histogram. Bucket i counts round trip times
+ * below 2^i ms, the last bucket all longer ones. */
+#define RTT_BUCKETS 12
 
 /* Default port list */
 #define DEFAULT_PORT_LIST                       \
@@ -44,12 +59,61 @@
 #define ALIVE_DETECTION_QUEUE "alive_detection"
 /* Signal to put on ALIVE_DETECTION_QUEUE if alive detection finished. */
 #define ALIVE_DETECTION_FINISHED "alive_detection_finished"
+/* KB item holding the latest alive detection metrics. */
+#define ALIVE_DETECTION_METRICS "alive_detection_metrics"
+/* Prefix of the KB items (port_discovery/<host>/tcp/{open,closed}) holding
+ * the ports found by port discovery. */
+#define PORT_DISCOVERY_KEY "port_discovery"
 
 void *
 start_alive_detection (void *);
 
 typedef struct hosts_data hosts_data_t;
 typedef struct scan_restrictions scan_restrictions_t;
+typedef struct probe_batch probe_batch_t;
+typedef struct route_cache route_cache_t;
+typedef struct arp_sweeper arp_sweeper_t;
+typedef struct alive_queue alive_queue_t;
+
+/**
+ * @brief Type of socket.
+ */
+typedef enum
+{
+  TCPV4,
+  TCPV6,
+  ICMPV4,
+  ICMPV6,
+  ARPV4,
+  ARPV6,
+  UDPV4,
+  UDPV6,
+  SOCKET_TYPE_MAX /* Boundary checking. */
+} socket_type_t;
+
+/**
+ * @brief Token bucket which paces the probes sent by the scanner.
+ *
+ * The rate is lowered when the kernel reports dropped packets or the socket
+ * send queue grows and raised again step by step up to max_pps afterwards.
+ */
+struct rate_limiter
+{
+  /* Configured upper limit in packets per second. 0 for no limit. */
+  unsigned int max_pps;
+  /* Currently allowed rate in packets per second. */
+  unsigned int pps;
+  /* Packets which may be sent right now. At most BURST. */
+  double tokens;
+  /* Monotonic time (microseconds) of the last refill of the bucket. */
+  gint64 last_refill;
+  /* Monotonic time (microseconds) of the last change of pps. */
+  gint64 last_adjust;
+  /* Number of packets sent. */
+  unsigned long sent;
+};
+
+typedef struct rate_limiter rate_limiter_t;
 
 /**
  * @brief The scanner struct holds data which is used frequently by the alive
@@ -69,10 +133,29 @@ struct scanner
   int udpv6soc;
   /* TH_SYN or TH_ACK */
   uint8_t tcp_flag;
+  /* Index + 1 of the target host the probes being built are sent to. The
+   * send time of the host is recorded once they are sent. 0 for none. */
+  guint32 probe_target;
   /* ports used for TCP ACK/SYN */
   GArray *ports;
+  /* Key of the cookies sent as sequence number of TCP probes. */
+  uint32_t cookie_key;
+  /* TRUE if open and closed TCP ports of alive hosts are to be discovered. */
+  gboolean port_discovery;
+  /* ports used for port discovery */
+  GArray *discovery_ports;
+  /* Pacing of outgoing probes. */
+  rate_limiter_t rate_limiter;
+  /* Probes waiting to be sent, one batch per socket type. */
+  probe_batch_t *probe_batches[SOCKET_TYPE_MAX];
+  /* Source addresses per route, for TCP probes. */
+  route_cache_t *route_cache;
+  /* Prebuilt ARP requests per interface. */
+  arp_sweeper_t *arp_sweeper;
   /* redis connection */
   kb_t main_kb;
+  /* Alive hosts waiting to be put on the queue. NULL to put them directly. */
+  alive_queue_t *alive_queue;
   /* pcap handle */
   pcap_t *pcap_handle;
   hosts_data_t *hosts_data;
@@ -84,17 +167,79 @@ struct scanner
 typedef struct scanner scanner_t;
 
 /**
- * @brief The hosts_data struct holds the alive hosts and target hosts in
- * separate hashtables.
+ * @brief Type of probe, for the alive detection metrics.
+ */
+typedef enum
+{
+  PROBE_ICMP,
+  PROBE_TCP_SYN,
+  PROBE_TCP_ACK,
+  PROBE_ARP,
+  PROBE_TYPE_MAX /* Boundary checking. */
+} probe_type_t;
+
+/**
+ * @brief Counters of the alive detection, published periodically.
+ */
+struct alive_metrics
+{
+  /* Monotonic time (us) the alive detection started. */
+  gint64 start;
+  /* Probes sent per probe type. Updated atomically. */
+  gint probes[PROBE_TYPE_MAX];
+  /* Packets captured by the sniffer. Updated atomically. */
+  gint replies;
+  /* Captured packets which were sent by a target host. Updated atomically. */
+  gint replies_matched;
+  /* Packets received and dropped as last reported by pcap_stats(). */
+  guint pcap_recv;
+  guint pcap_drop;
+  guint pcap_ifdrop;
+  /* Round trip time histogram, see RTT_BUCKETS. Protected by the lock of the
+   * hosts data. */
+  guint rtt_histogram[RTT_BUCKETS];
+};
+
+/**
+ * @brief The hosts_data struct holds the target hosts and which of them were
+ * detected as alive.
+ *
+ * Targets are looked up by their binary address in an open addressing table.
+ * IPv4 addresses are stored as IPv4 mapped IPv6 addresses.
  */
 struct hosts_data
 {
-  /* Set of the form (ip_str, ip_str).
-   * Target hosts which were detected as alive. */
-  GHashTable *alivehosts;
-  /* Hashtable of the form (ip_str, gvm_host_t *). The gvm_host_t pointers point
-   * to hosts which are to be freed by the caller of start_alive_detection(). */
-  GHashTable *targethosts;
+  /* Target hosts. The gvm_host_t pointers point to hosts which are to be freed
+   * by the caller of start_alive_detection(). */
+  gvm_host_t **hosts;
+  /* Addresses of the target hosts, in the same order as hosts. Unspecified if
+   * the address of a host could not be determined. */
+  struct in6_addr *addrs;
+  /* Number of target hosts. */
+  guint32 count;
+  /* Lookup table of the form (index + 1), 0 marks an empty slot. */
+  guint32 *slots;
+  /* Number of slots minus one. The number of slots is a power of two. */
+  guint32 mask;
+  /* Bitmap of the target hosts which were detected as alive. */
+  guint *alive;
+  /* Number of target hosts which were detected as alive. */
+  gint alive_count;
+  /* Monotonic time (us) the first probe was sent to each target host, 0 if no
+   * probe was sent. Negative while the probe is queued or if more than one
+   * probe was sent, see hosts_data_probe_queued(). */
+  gint64 *sent;
+  /* Protects the round trip time estimate. */
+  GMutex lock;
+  /* Signalled whenever a target host is detected as alive. */
+  GCond alive_cond;
+  /* Smoothed round trip time and its variation in us (RFC 6298). */
+  gint64 srtt;
+  gint64 rttvar;
+  /* Number of round trip time samples. */
+  guint rtt_samples;
+  /* Metrics of the alive detection. */
+  struct alive_metrics metrics;
 };
 
 /* Max_scan_hosts related struct. */
@@ -125,19 +270,4 @@ typedef enum
   ALIVE_TEST_TCP_SYN_SERVICE = 16
 } alive_test_t;
 
-/**
- * @brief Type of socket.
- */
-typedef enum
-{
-  TCPV4,
-  TCPV6,
-  ICMPV4,
-  ICMPV6,
-  ARPV4,
-  ARPV6,
-  UDPV4,
-  UDPV6,
-} socket_type_t;
-
 #endif /* not ALIVE_DETECTION_H */
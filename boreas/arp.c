@@ -36,7 +36,9 @@
 #include <libnet.h>
 #include <limits.h>
 #include <net/if.h>
+#include <netinet/if_ether.h> /* for struct ether_arp */
 #include <netinet/in.h>
+#include <netpacket/packet.h> /* for struct sockaddr_ll */
 #include <pcap.h>
 #include <stdio.h>
 #include <string.h>
@@ -58,6 +60,10 @@
  */
 #define G_LOG_DOMAIN "libgvm boreas"
 
+/* Protects libnet and the other module state used by send_arp_v4(), which may
+ * be called by several sender threads at once. */
+static GMutex libnet_lock;
+
 static libnet_t *libnet = 0;
 
 static uint32_t dstip;           /* target IP */
@@ -71,6 +77,32 @@ static const uint8_t ethnull[ETH_ALEN] = {0, 0, 0, 0, 0, 0};
 static const uint8_t ethxmas[ETH_ALEN] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
 static const char *ip_broadcast = "255.255.255.255";
 
+/* Padding of ARP requests. See pingip_send(). */
+#define ARP_PADDING 16
+/* Length of an ARP request frame including padding. */
+#define ARP_FRAME_LEN \
+  (sizeof (struct ether_header) + sizeof (struct ether_arp) + ARP_PADDING)
+
+/**
+ * @brief Interface used by the ARP sweeper.
+ */
+struct arp_iface
+{
+  char name[IF_NAMESIZE];       /* Interface name. */
+  int index;                    /* Interface index. */
+  struct in_addr addr;          /* IPv4 address of the interface. */
+  struct in_addr netmask;       /* Netmask of the interface address. */
+  uint8_t frame[ARP_FRAME_LEN]; /* ARP request with target address unset. */
+};
+
+/**
+ * @brief Prebuilt ARP requests for all interfaces with an IPv4 address.
+ */
+struct arp_sweeper
+{
+  GArray *ifaces; /* Array of struct arp_iface. */
+};
+
 /**
  * @brief Strip newline at end of string.
  *
@@ -224,13 +256,13 @@ pingip_send ()
 }
 
 /**
- * @brief Send arp ping using libnet.
+ * @brief Send arp ping using libnet. Caller must hold libnet_lock.
  *
  * @param dst Destination address as string.
  *
  */
-void
-send_arp_v4 (const char *dst_str)
+static void
+send_arp_v4_locked (const char *dst_str)
 {
   char ebuf[LIBNET_ERRBUF_SIZE + PCAP_ERRBUF_SIZE];
   char *cp;
@@ -364,3 +396,175 @@ send_arp_v4 (const char *dst_str)
   g_free (target);
   g_free (ifname);
 }
+
+/**
+ * @brief Send arp ping using libnet.
+ *
+ * Thread safe. Pings are serialized, as they share one libnet context.
+ *
+ * @param dst Destination address as string.
+ *
+ */
+void
+send_arp_v4 (const char *dst_str)
+{
+  g_mutex_lock (&libnet_lock);
+  send_arp_v4_locked (dst_str);
+  g_mutex_unlock (&libnet_lock);
+}
+
+/**
+ * @brief Build the ARP request template of an interface.
+ *
+ * @param iface Interface with name and address set.
+ * @param mac   MAC address of the interface.
+ */
+static void
+arp_iface_build_frame (struct arp_iface *iface, const uint8_t *mac)
+{
+  struct ether_header *eth = (struct ether_header *) iface->frame;
+  struct ether_arp *arp =
+    (struct ether_arp *) (iface->frame + sizeof (struct ether_header));
+  uint32_t src = 0;
+
+  /* set src IP if we have global openvas src ip */
+  gvm_source_addr (&src);
+  if (src == INADDR_ANY)
+    src = iface->addr.s_addr;
+
+  memset (iface->frame, 0, sizeof (iface->frame));
+  memcpy (eth->ether_dhost, ethxmas, ETH_ALEN);
+  memcpy (eth->ether_shost, mac, ETH_ALEN);
+  eth->ether_type = htons (ETHERTYPE_ARP);
+
+  arp->arp_hrd = htons (ARPHRD_ETHER);
+  arp->arp_pro = htons (ETHERTYPE_IP);
+  arp->arp_hln = ETH_ALEN;
+  arp->arp_pln = IP_ALEN;
+  arp->arp_op = htons (ARPOP_REQUEST);
+  memcpy (arp->arp_sha, mac, ETH_ALEN);
+  memcpy (arp->arp_spa, &src, IP_ALEN);
+  memcpy (arp->arp_tha, ethnull, ETH_ALEN);
+}
+
+/**
+ * @brief Create an ARP sweeper.
+ *
+ * Looks up all interfaces which are up, have a MAC address and an IPv4
+ * address once, and prebuilds an ARP request for each of them.
+ *
+ * @return ARP sweeper, to be freed with arp_sweeper_free().
+ */
+arp_sweeper_t *
+arp_sweeper_new (void)
+{
+  arp_sweeper_t *sweeper;
+  struct ifaddrs *ifaddr, *ifa;
+
+  sweeper = g_malloc0 (sizeof (arp_sweeper_t));
+  sweeper->ifaces = g_array_new (FALSE, TRUE, sizeof (struct arp_iface));
+
+  if (getifaddrs (&ifaddr) == -1)
+    {
+      g_warning ("%s: getifaddrs(): %s", __func__, strerror (errno));
+      return sweeper;
+    }
+
+  for (ifa = ifaddr; ifa; ifa = ifa->ifa_next)
+    {
+      struct arp_iface iface;
+      struct ifaddrs *link;
+
+      if (ifa->ifa_addr == NULL || ifa->ifa_netmask == NULL
+          || ifa->ifa_addr->sa_family != AF_INET || !(ifa->ifa_flags & IFF_UP)
+          || (ifa->ifa_flags & IFF_LOOPBACK)
+          || strlen (ifa->ifa_name) >= IF_NAMESIZE)
+        continue;
+
+      /* The link layer address is listed as AF_PACKET entry. */
+      for (link = ifaddr; link; link = link->ifa_next)
+        if (link->ifa_addr && link->ifa_addr->sa_family == AF_PACKET
+            && !strcmp (link->ifa_name, ifa->ifa_name))
+          break;
+      if (link == NULL
+          || ((struct sockaddr_ll *) link->ifa_addr)->sll_halen != ETH_ALEN)
+        continue;
+
+      memset (&iface, 0, sizeof (iface));
+      g_strlcpy (iface.name, ifa->ifa_name, sizeof (iface.name));
+      iface.index = ((struct sockaddr_ll *) link->ifa_addr)->sll_ifindex;
+      iface.addr = ((struct sockaddr_in *) ifa->ifa_addr)->sin_addr;
+      iface.netmask = ((struct sockaddr_in *) ifa->ifa_netmask)->sin_addr;
+      arp_iface_build_frame (
+        &iface, ((struct sockaddr_ll *) link->ifa_addr)->sll_addr);
+      g_array_append_val (sweeper->ifaces, iface);
+    }
+  freeifaddrs (ifaddr);
+
+  return sweeper;
+}
+
+/**
+ * @brief Free an ARP sweeper.
+ *
+ * @param sweeper ARP sweeper to free.
+ */
+void
+arp_sweeper_free (arp_sweeper_t *sweeper)
+{
+  if (sweeper == NULL)
+    return;
+  g_array_free (sweeper->ifaces, TRUE);
+  g_free (sweeper);
+}
+
+/**
+ * @brief Build an ARP request for a destination on a directly connected
+ * network.
+ *
+ * The request is copied from the prebuilt request of the interface with the
+ * most specific network containing the destination and only the target
+ * address is set.
+ *
+ * @param[in]  sweeper  ARP sweeper.
+ * @param[in]  dst      Destination address.
+ * @param[out] frame    Buffer of at least ARP_FRAME_LEN bytes.
+ * @param[out] addr     Link layer address to send the frame to.
+ *
+ * @return Length of the frame, -1 if no interface is directly connected to the
+ * network of the destination.
+ */
+int
+arp_sweeper_frame (arp_sweeper_t *sweeper, const struct in_addr *dst,
+                   u_char *frame, struct sockaddr_ll *addr)
+{
+  struct arp_iface *best = NULL;
+  struct ether_arp *arp;
+
+  for (guint i = 0; i < sweeper->ifaces->len; i++)
+    {
+      struct arp_iface *iface =
+        &g_array_index (sweeper->ifaces, struct arp_iface, i);
+
+      if ((dst->s_addr & iface->netmask.s_addr)
+            == (iface->addr.s_addr & iface->netmask.s_addr)
+          && (best == NULL
+              || ntohl (iface->netmask.s_addr) > ntohl (best->netmask.s_addr)))
+        best = iface;
+    }
+  if (best == NULL)
+    return -1;
+
+  memcpy (frame, best->frame, ARP_FRAME_LEN);
+  arp = (struct ether_arp *) (frame + sizeof (struct ether_header));
+  memcpy (arp->arp_tpa, &dst->s_addr, IP_ALEN);
+
+  memset (addr, 0, sizeof (*addr));
+  addr->sll_family = AF_PACKET;
+  addr->sll_protocol = htons (ETH_P_ARP);
+  addr->sll_ifindex = best->index;
+  addr->sll_halen = ETH_ALEN;
+  memcpy (addr->sll_addr, ethxmas, ETH_ALEN);
+
+  return ARP_FRAME_LEN;
+}
@@ -20,7 +20,22 @@
 #ifndef ARP_H
 #define ARP_H
 
+#include "alivedetection.h"
+
+#include <netinet/in.h>       /* for struct in_addr */
+#include <netpacket/packet.h> /* for struct sockaddr_ll */
+
 void
 send_arp_v4 (const char *);
 
+arp_sweeper_t *
+arp_sweeper_new (void);
+
+void
+arp_sweeper_free (arp_sweeper_t *);
+
+int
+arp_sweeper_frame (arp_sweeper_t *, const struct in_addr *, u_char *,
+                   struct sockaddr_ll *);
+
 #endif /* not ARP_H */
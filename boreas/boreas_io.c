@@ -24,7 +24,10 @@
 #include "util.h"
 
 #include <glib/gprintf.h>
+#include <netinet/in.h> /* for INET6_ADDRSTRLEN */
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 
 #undef G_LOG_DOMAIN
 /**
@@ -237,6 +240,392 @@ put_host_on_queue (kb_t kb, char *addr_str)
              __func__, addr_str);
 }
 
+/**
+ * @brief Put the state of a port found by port discovery on the kb.
+ *
+ * The port is added to the port_discovery/<host>/tcp/open or closed kb item.
+ * Without kb, open ports are printed on the command line.
+ *
+ * @param scanner Scanner struct.
+ * @param addr_str IP addr in str representation of the host.
+ * @param port TCP port.
+ * @param open 1 if the port is open, 0 if it is closed.
+ */
+void
+put_port_on_kb (scanner_t *scanner, const char *addr_str, uint16_t port,
+                int open)
+{
+  gchar *name;
+
+  if (scanner->main_kb == NULL)
+    {
+      if (scanner->print_results == 1 && open)
+        g_printf ("%s %d/tcp open\n", addr_str, port);
+      return;
+    }
+
+  name = g_strdup_printf ("%s/%s/tcp/%s", PORT_DISCOVERY_KEY, addr_str,
+                          open ? "open" : "closed");
+  if (kb_item_add_int_unique (scanner->main_kb, name, port) != 0)
+    g_debug ("%s: kb_item_add_int_unique() failed. Could not add port %d to "
+             "\"%s\".",
+             __func__, port, name);
+  g_free (name);
+}
+
+/**
+ * @brief Put the alive detection metrics on the kb.
+ *
+ * Replaces the metrics put on the kb before.
+ *
+ * @param kb KB to use.
+ * @param metrics Metrics in str representation.
+ */
+void
+put_metrics_on_kb (kb_t kb, const char *metrics)
+{
+  if (kb_item_set_str (kb, ALIVE_DETECTION_METRICS, metrics, 0) != 0)
+    g_debug ("%s: kb_item_set_str() failed. Could not put metrics on kb.",
+             __func__);
+}
+
+/* Maximum number of alive hosts or ports put on the kb with one push. */
+#define ALIVE_QUEUE_BATCH 256
+/* Interval (us) in which buffered alive hosts are put on the queue. */
+#define ALIVE_QUEUE_INTERVAL (20 * 1000)
+
+/**
+ * @brief Alive host or port state buffered for the kb.
+ */
+struct alive_queue_node
+{
+  struct alive_queue_node *next;   /* Node buffered before. */
+  char addr_str[INET6_ADDRSTRLEN]; /* IP addr in str representation. */
+  uint16_t port;                   /* TCP port, for port states only. */
+  int open;                        /* 1 if the port is open, 0 if closed. */
+};
+
+/**
+ * @brief Buffer of alive hosts and port states which a publisher thread puts
+ * on the kb.
+ *
+ * Hosts and ports are added without locking by pushing them on a stack with
+ * an atomic compare and exchange. The publisher takes the whole stack at once
+ * and puts the entries on the kb in batches, so adding an entry never waits
+ * for redis.
+ */
+struct alive_queue
+{
+  struct alive_queue_node *head;  /* Buffered hosts, most recent first. */
+  struct alive_queue_node *ports; /* Buffered port states, likewise. */
+  GHashTable *published_ports;    /* Port states put on the kb already. */
+  gchar *metrics;                 /* Latest metrics not on the kb yet. */
+  gint stop;                      /* Set to stop the publisher. */
+  kb_t kb;                        /* Connection used by the publisher. */
+  pthread_t thread;               /* Publisher thread. */
+};
+
+/**
+ * @brief Push a node on a stack of an alive queue. Does not block.
+ *
+ * @param head Head of the stack.
+ * @param node Node to push.
+ */
+static void
+alive_queue_add (struct alive_queue_node **head, struct alive_queue_node *node)
+{
+  do
+    node->next = g_atomic_pointer_get (head);
+  while (!g_atomic_pointer_compare_and_exchange (head, node->next, node));
+}
+
+/**
+ * @brief Take all nodes of a stack of an alive queue.
+ *
+ * @param head Head of the stack.
+ *
+ * @return Nodes in the order they were added.
+ */
+static struct alive_queue_node *
+alive_queue_take (struct alive_queue_node **head)
+{
+  struct alive_queue_node *list, *node, *fifo = NULL;
+
+  do
+    list = g_atomic_pointer_get (head);
+  while (!g_atomic_pointer_compare_and_exchange (head, list, NULL));
+  while (list)
+    {
+      node = list;
+      list = node->next;
+      node->next = fifo;
+      fifo = node;
+    }
+  return fifo;
+}
+
+/**
+ * @brief Put all buffered port states on the kb.
+ *
+ * The ports of every port_discovery/<host>/tcp/{open,closed} kb item are
+ * pushed at once. Every port is added to a kb item only once.
+ *
+ * @param queue Alive queue.
+ */
+static void
+alive_queue_publish_ports (alive_queue_t *queue)
+{
+  struct alive_queue_node *node;
+  GHashTable *items;
+  GHashTableIter iter;
+  gpointer name, ports;
+
+  node = alive_queue_take (&queue->ports);
+  if (node == NULL)
+    return;
+  if (queue->published_ports == NULL)
+    queue->published_ports =
+      g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  /* Ports per kb item, in the order they were found. */
+  items = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                 (GDestroyNotify) g_ptr_array_unref);
+  while (node)
+    {
+      struct alive_queue_node *next = node->next;
+      gchar *item;
+
+      item = g_strdup_printf ("%s/%s/tcp/%s", PORT_DISCOVERY_KEY,
+                              node->addr_str, node->open ? "open" : "closed");
+      if (g_hash_table_add (queue->published_ports,
+                            g_strdup_printf ("%s/%u", item, node->port)))
+        {
+          ports = g_hash_table_lookup (items, item);
+          if (ports == NULL)
+            {
+              ports = g_ptr_array_new_with_free_func (g_free);
+              g_hash_table_insert (items, item, ports);
+              item = NULL;
+            }
+          g_ptr_array_add (ports, g_strdup_printf ("%u", node->port));
+        }
+      g_free (item);
+      g_free (node);
+      node = next;
+    }
+
+  g_hash_table_iter_init (&iter, items);
+  while (g_hash_table_iter_next (&iter, &name, &ports))
+    {
+      GPtrArray *array = ports;
+
+      for (guint i = 0; i < array->len; i += ALIVE_QUEUE_BATCH)
+        {
+          size_t count = MIN (array->len - i, ALIVE_QUEUE_BATCH);
+
+          if (kb_item_push_strs (queue->kb, name,
+                                 (const char **) array->pdata + i, count)
+              != 0)
+            g_debug ("%s: kb_item_push_strs() failed. Could not add %zu "
+                     "ports to \"%s\".",
+                     __func__, count, (char *) name);
+        }
+    }
+  g_hash_table_destroy (items);
+}
+
+/**
+ * @brief Put all buffered alive hosts on the alive detection queue and all
+ * buffered port states and the latest metrics on the kb.
+ *
+ * @param queue Alive queue.
+ */
+static void
+alive_queue_publish (alive_queue_t *queue)
+{
+  struct alive_queue_node *node;
+  const char *values[ALIVE_QUEUE_BATCH];
+  gchar *metrics;
+
+  node = alive_queue_take (&queue->head);
+  while (node)
+    {
+      struct alive_queue_node *first = node;
+      size_t count = 0;
+
+      for (; node && count < ALIVE_QUEUE_BATCH; node = node->next)
+        values[count++] = node->addr_str;
+      if (kb_item_push_strs (queue->kb, ALIVE_DETECTION_QUEUE, values, count)
+          != 0)
+        g_debug ("%s: kb_item_push_strs() failed. Could not push %zu hosts "
+                 "on queue of hosts to be considered as alive.",
+                 __func__, count);
+      while (first != node)
+        {
+          struct alive_queue_node *next = first->next;
+
+          g_free (first);
+          first = next;
+        }
+    }
+
+  alive_queue_publish_ports (queue);
+
+  do
+    metrics = g_atomic_pointer_get (&queue->metrics);
+  while (!g_atomic_pointer_compare_and_exchange (&queue->metrics, metrics,
+                                                 NULL));
+  if (metrics)
+    {
+      put_metrics_on_kb (queue->kb, metrics);
+      g_free (metrics);
+    }
+}
+
+/**
+ * @brief Put buffered alive hosts, port states and metrics on the kb until
+ * stopped. Is a thread function.
+ *
+ * @param queue_p Pointer to alive queue.
+ */
+static void *
+alive_queue_thread (void *queue_p)
+{
+  alive_queue_t *queue = queue_p;
+
+  while (!g_atomic_int_get (&queue->stop))
+    {
+      g_usleep (ALIVE_QUEUE_INTERVAL);
+      alive_queue_publish (queue);
+    }
+  /* Hosts added before the stop. */
+  alive_queue_publish (queue);
+
+  return NULL;
+}
+
+/**
+ * @brief Create an alive queue and start its publisher thread.
+ *
+ * The publisher uses its own connection to the main kb.
+ *
+ * @return Alive queue, NULL on error.
+ */
+alive_queue_t *
+alive_queue_new (void)
+{
+  alive_queue_t *queue;
+  int err;
+
+  queue = g_malloc0 (sizeof (alive_queue_t));
+  queue->kb =
+    kb_direct_conn (prefs_get ("db_address"), atoi (prefs_get ("ov_maindbid")));
+  if (queue->kb == NULL)
+    {
+      g_warning ("%s: Could not connect to the main kb.", __func__);
+      g_free (queue);
+      return NULL;
+    }
+
+  err = pthread_create (&queue->thread, NULL, alive_queue_thread, queue);
+  if (err)
+    {
+      g_warning ("%s: pthread_create() failed: %s", __func__, strerror (err));
+      kb_lnk_reset (queue->kb);
+      g_free (queue);
+      return NULL;
+    }
+
+  return queue;
+}
+
+/**
+ * @brief Add an alive host to the alive queue.
+ *
+ * Does not block. The host is put on the alive detection queue by the
+ * publisher thread within ALIVE_QUEUE_INTERVAL.
+ *
+ * @param queue Alive queue.
+ * @param addr_str IP addr in str representation to put on queue.
+ */
+void
+alive_queue_push (alive_queue_t *queue, const char *addr_str)
+{
+  struct alive_queue_node *node;
+
+  node = g_malloc (sizeof (struct alive_queue_node));
+  g_strlcpy (node->addr_str, addr_str, sizeof (node->addr_str));
+  alive_queue_add (&queue->head, node);
+}
+
+/**
+ * @brief Add the state of a port found by port discovery to the alive queue.
+ *
+ * Does not block. The port is added to the port_discovery/<host>/tcp/open or
+ * closed kb item by the publisher thread within ALIVE_QUEUE_INTERVAL.
+ *
+ * @param queue Alive queue.
+ * @param addr_str IP addr in str representation of the host.
+ * @param port TCP port.
+ * @param open 1 if the port is open, 0 if it is closed.
+ */
+void
+alive_queue_push_port (alive_queue_t *queue, const char *addr_str,
+                       uint16_t port, int open)
+{
+  struct alive_queue_node *node;
+
+  node = g_malloc (sizeof (struct alive_queue_node));
+  g_strlcpy (node->addr_str, addr_str, sizeof (node->addr_str));
+  node->port = port;
+  node->open = open;
+  alive_queue_add (&queue->ports, node);
+}
+
+/**
+ * @brief Set the alive detection metrics to put on the kb.
+ *
+ * Does not block. The metrics are put on the kb by the publisher thread
+ * within ALIVE_QUEUE_INTERVAL. Metrics set before and not put on the kb yet
+ * are replaced.
+ *
+ * @param queue Alive queue.
+ * @param metrics Metrics in str representation.
+ */
+void
+alive_queue_set_metrics (alive_queue_t *queue, const char *metrics)
+{
+  gchar *str = g_strdup (metrics);
+  gchar *old;
+
+  do
+    old = g_atomic_pointer_get (&queue->metrics);
+  while (!g_atomic_pointer_compare_and_exchange (&queue->metrics, old, str));
+  g_free (old);
+}
+
+/**
+ * @brief Stop the publisher thread of an alive queue and free the queue.
+ *
+ * All hosts, ports and metrics added before are put on the kb.
+ *
+ * @param queue Alive queue. May be NULL.
+ */
+void
+alive_queue_free (alive_queue_t *queue)
+{
+  if (queue == NULL)
+    return;
+
+  g_atomic_int_set (&queue->stop, 1);
+  pthread_join (queue->thread, NULL);
+  kb_lnk_reset (queue->kb);
+  if (queue->published_ports)
+    g_hash_table_destroy (queue->published_ports);
+  g_free (queue->metrics);
+  g_free (queue);
+}
+
 /**
  * @brief Checks if the finish signal is already set.
  *
@@ -387,7 +776,9 @@ handle_scan_restrictions (scanner_t *scanner, gchar *addr_str)
     {
       /* Print host on command line if no kb is available. No kb available could
        * mean that boreas is used as commandline tool.*/
-      if (kb != NULL)
+      if (scanner->alive_queue != NULL)
+        alive_queue_push (scanner->alive_queue, addr_str);
+      else if (kb != NULL)
         put_host_on_queue (kb, addr_str);
       else
         {
@@ -505,6 +896,68 @@ get_alive_test_ports (void)
   return prefs_get ("ALIVE_TEST_PORTS");
 }
 
+/**
+ * @brief Check if the open and closed TCP ports of the alive hosts are to be
+ * discovered.
+ *
+ * @return TRUE if the alive_test_port_discovery preference is set to "yes",
+ * FALSE otherwise.
+ */
+gboolean
+get_alive_test_port_discovery (void)
+{
+  return prefs_get_bool ("alive_test_port_discovery");
+}
+
+/**
+ * @brief Get ports which should be used for port discovery.
+ *
+ * @return string containing the ports of the alive_test_discovery_ports
+ * preference or the port_range preference if not set. NULL otherwise.
+ */
+const gchar *
+get_port_discovery_ports (void)
+{
+  if (prefs_get ("alive_test_discovery_ports"))
+    return prefs_get ("alive_test_discovery_ports");
+  return prefs_get ("port_range");
+}
+
+/**
+ * @brief Get the number of echo requests sent to hosts which do not reply.
+ *
+ * Taken from the icmp_retries preference. At least 1.
+ *
+ * @return Number of echo requests per host, including the first one.
+ */
+unsigned int
+get_icmp_retries (void)
+{
+  const gchar *str_retries = prefs_get ("icmp_retries");
+  int retries = str_retries != NULL ? atoi (str_retries) : 1;
+
+  return retries > 0 ? retries : 1;
+}
+
+/**
+ * @brief Get the maximum time to wait for replies before echo requests are
+ * sent again.
+ *
+ * Taken from the icmp_grace_period preference (us). Once the round trip time
+ * is known, the actual wait is shorter. If not set, ICMP_RETRY_TIMEOUT is
+ * used.
+ *
+ * @return Maximum time in us.
+ */
+gint64
+get_icmp_grace_period (void)
+{
+  const gchar *str_grace_period = prefs_get ("icmp_grace_period");
+  int grace_period = str_grace_period != NULL ? atoi (str_grace_period) : 0;
+
+  return grace_period > 0 ? grace_period : ICMP_RETRY_TIMEOUT * 1000;
+}
+
 /**
  * @brief Get the max time in seconds that boreas waits for replies.
  * Minimum is 1 second. Max is 20. If a given value is invalid or greather
@@ -527,3 +980,65 @@ get_alive_test_wait_timeout (void)
 
   return WAIT_FOR_REPLIES_TIMEOUT;
 }
+
+/**
+ * @brief Get the maximum number of packets per second boreas sends.
+ *
+ * Taken from the alive_test_max_pps preference. 0 disables the rate limit. If
+ * the preference is not set or invalid, DEFAULT_MAX_PPS is used.
+ *
+ * @return Maximum number of packets per second, 0 for no limit.
+ */
+unsigned int
+get_alive_test_max_pps (void)
+{
+  const gchar *str_max_pps;
+  gchar *end = NULL;
+  long max_pps;
+
+  str_max_pps = prefs_get ("alive_test_max_pps");
+  if (str_max_pps == NULL)
+    return DEFAULT_MAX_PPS;
+
+  max_pps = strtol (str_max_pps, &end, 10);
+  if (end == str_max_pps || *end != '\0' || max_pps < 0 || max_pps > G_MAXINT)
+    {
+      g_warning ("%s: Invalid alive_test_max_pps value '%s'. Using %d "
+                 "packets per second instead.",
+                 __func__, str_max_pps, DEFAULT_MAX_PPS);
+      return DEFAULT_MAX_PPS;
+    }
+
+  return max_pps;
+}
+
+/**
+ * @brief Get the number of threads boreas sends probes from.
+ *
+ * Taken from the alive_test_send_threads preference. If the preference is not
+ * set or invalid, 1 is used. At most MAX_SEND_THREADS are used.
+ *
+ * @return Number of sender threads.
+ */
+unsigned int
+get_alive_test_send_threads (void)
+{
+  const gchar *str_threads;
+  gchar *end = NULL;
+  long threads;
+
+  str_threads = prefs_get ("alive_test_send_threads");
+  if (str_threads == NULL)
+    return 1;
+
+  threads = strtol (str_threads, &end, 10);
+  if (end == str_threads || *end != '\0' || threads < 1)
+    {
+      g_warning ("%s: Invalid alive_test_send_threads value '%s'. Using one "
+                 "thread instead.",
+                 __func__, str_threads);
+      return 1;
+    }
+
+  return MIN (threads, MAX_SEND_THREADS);
+}
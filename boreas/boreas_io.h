@@ -31,9 +31,30 @@ get_host_from_queue (kb_t, gboolean *);
 void
 put_host_on_queue (kb_t, char *);
 
+alive_queue_t *
+alive_queue_new (void);
+
+void
+alive_queue_push (alive_queue_t *, const char *);
+
+void
+alive_queue_push_port (alive_queue_t *, const char *, uint16_t, int);
+
+void
+alive_queue_set_metrics (alive_queue_t *, const char *);
+
+void
+alive_queue_free (alive_queue_t *);
+
 void
 put_finish_signal_on_queue (void *);
 
+void
+put_port_on_kb (scanner_t *, const char *, uint16_t, int);
+
+void
+put_metrics_on_kb (kb_t, const char *);
+
 void realloc_finish_signal_on_queue (kb_t);
 
 int finish_signal_on_queue (kb_t);
@@ -56,9 +77,27 @@ get_alive_test_methods (alive_test_t *);
 const gchar *
 get_alive_test_ports (void);
 
+gboolean
+get_alive_test_port_discovery (void);
+
+const gchar *
+get_port_discovery_ports (void);
+
+unsigned int
+get_icmp_retries (void);
+
+gint64
+get_icmp_grace_period (void);
+
 unsigned int
 get_alive_test_wait_timeout (void);
 
+unsigned int
+get_alive_test_max_pps (void);
+
+unsigned int
+get_alive_test_send_threads (void);
+
 int
 get_alive_hosts_count (void);
 
@@ -35,6 +35,115 @@ Ensure (boreas_io, dummy_test)
   assert_that (0, is_equal_to (0));
 }
 
+static GString *pushed;
+
+static int
+fake_push_strs (__attribute__ ((unused)) kb_t kb, const char *name,
+                const char **values, size_t count)
+{
+  g_string_append_printf (pushed, "%s:", name);
+  for (size_t i = 0; i < count; i++)
+    g_string_append_printf (pushed, " %s", values[i]);
+  g_string_append (pushed, ";");
+  return 0;
+}
+
+Ensure (boreas_io, alive_queue_publish)
+{
+  struct kb_operations ops = {.kb_push_strs = fake_push_strs};
+  struct kb kb = {.kb_ops = &ops};
+  alive_queue_t queue = {.kb = &kb};
+
+  pushed = g_string_new (NULL);
+
+  /* Nothing buffered. */
+  alive_queue_publish (&queue);
+  assert_that (pushed->str, is_equal_to_string (""));
+
+  /* Hosts are put on the queue in the order they were found. */
+  alive_queue_push (&queue, "192.168.0.1");
+  alive_queue_push (&queue, "192.168.0.2");
+  alive_queue_push (&queue, "2001:db8::1");
+  alive_queue_publish (&queue);
+  assert_that (pushed->str,
+               is_equal_to_string (ALIVE_DETECTION_QUEUE
+                                   ": 192.168.0.1 192.168.0.2 2001:db8::1;"));
+  assert_that (queue.head, is_null);
+
+  /* Large bursts are split into batches. */
+  g_string_truncate (pushed, 0);
+  for (int i = 0; i < ALIVE_QUEUE_BATCH + 1; i++)
+    alive_queue_push (&queue, "192.168.0.1");
+  alive_queue_publish (&queue);
+  assert_that (pushed->str, ends_with_string (
+                              ";" ALIVE_DETECTION_QUEUE ": 192.168.0.1;"));
+
+  g_string_free (pushed, TRUE);
+}
+
+Ensure (boreas_io, alive_queue_publish_ports)
+{
+  struct kb_operations ops = {.kb_push_strs = fake_push_strs};
+  struct kb kb = {.kb_ops = &ops};
+  alive_queue_t queue = {.kb = &kb};
+
+  pushed = g_string_new (NULL);
+
+  /* The ports of a kb item are pushed at once. */
+  alive_queue_push_port (&queue, "192.168.0.1", 22, 1);
+  alive_queue_push_port (&queue, "192.168.0.1", 80, 1);
+  alive_queue_publish (&queue);
+  assert_that (pushed->str,
+               is_equal_to_string (PORT_DISCOVERY_KEY
+                                   "/192.168.0.1/tcp/open: 22 80;"));
+  assert_that (queue.ports, is_null);
+
+  /* Ports already on the kb item are not added again. */
+  g_string_truncate (pushed, 0);
+  alive_queue_push_port (&queue, "192.168.0.1", 80, 1);
+  alive_queue_push_port (&queue, "192.168.0.1", 80, 1);
+  alive_queue_push_port (&queue, "192.168.0.1", 443, 1);
+  alive_queue_publish (&queue);
+  assert_that (pushed->str,
+               is_equal_to_string (PORT_DISCOVERY_KEY
+                                   "/192.168.0.1/tcp/open: 443;"));
+
+  g_hash_table_destroy (queue.published_ports);
+  g_string_free (pushed, TRUE);
+}
+
+static int
+fake_set_str (__attribute__ ((unused)) kb_t kb, const char *name,
+              const char *value, __attribute__ ((unused)) size_t len)
+{
+  g_string_append_printf (pushed, "%s= %s;", name, value);
+  return 0;
+}
+
+Ensure (boreas_io, alive_queue_publish_metrics)
+{
+  struct kb_operations ops = {.kb_set_str = fake_set_str};
+  struct kb kb = {.kb_ops = &ops};
+  alive_queue_t queue = {.kb = &kb};
+
+  pushed = g_string_new (NULL);
+
+  /* Only the latest metrics are put on the kb. */
+  alive_queue_set_metrics (&queue, "probes=1");
+  alive_queue_set_metrics (&queue, "probes=2");
+  alive_queue_publish (&queue);
+  assert_that (pushed->str,
+               is_equal_to_string (ALIVE_DETECTION_METRICS "= probes=2;"));
+  assert_that (queue.metrics, is_null);
+
+  /* Metrics are put on the kb once. */
+  g_string_truncate (pushed, 0);
+  alive_queue_publish (&queue);
+  assert_that (pushed->str, is_equal_to_string (""));
+
+  g_string_free (pushed, TRUE);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -43,6 +152,9 @@ main (int argc, char **argv)
   suite = create_test_suite ();
 
   add_test_with_context (suite, boreas_io, dummy_test);
+  add_test_with_context (suite, boreas_io, alive_queue_publish);
+  add_test_with_context (suite, boreas_io, alive_queue_publish_ports);
+  add_test_with_context (suite, boreas_io, alive_queue_publish_metrics);
 
   if (argc > 1)
     return run_single_test (suite, argv[1], create_text_reporter ());
@@ -44,7 +44,6 @@ init_cli (scanner_t *scanner, gvm_hosts_t *hosts, alive_test_t alive_test,
           const gchar *port_list, const int print_results)
 {
   GPtrArray *portranges_array;
-  gvm_host_t *host;
   int error;
 
   portranges_array = NULL;
@@ -54,19 +53,17 @@ init_cli (scanner_t *scanner, gvm_hosts_t *hosts, alive_test_t alive_test,
   scanner->print_results = print_results;
 
   /* hosts_data */
-  scanner->hosts_data = g_malloc0 (sizeof (hosts_data_t));
-  scanner->hosts_data->alivehosts =
-    g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
-  scanner->hosts_data->targethosts =
-    g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
-  for (host = gvm_hosts_next (hosts); host; host = gvm_hosts_next (hosts))
-    g_hash_table_insert (scanner->hosts_data->targethosts,
-                         gvm_host_value_str (host), host);
+  scanner->hosts_data = hosts_data_new (hosts);
 
   /* Sockets. */
   if ((error = set_all_needed_sockets (scanner, alive_test)) != 0)
     return error;
 
+  /* Pacing of probes. */
+  rate_limiter_init (&scanner->rate_limiter, get_alive_test_max_pps ());
+  scanner->route_cache = route_cache_new ();
+  scanner->arp_sweeper = arp_sweeper_new ();
+
   /* Only init portlist if either TCP-ACK or TCP-SYN ping is used. */
   if (alive_test & ALIVE_TEST_TCP_SYN_SERVICE
       || alive_test & ALIVE_TEST_TCP_ACK_SERVICE)
@@ -95,9 +92,10 @@ free_cli (scanner_t *scanner, alive_test_t alive_test)
     {
       g_array_free (scanner->ports, TRUE);
     }
-  g_hash_table_destroy (scanner->hosts_data->alivehosts);
-  g_hash_table_destroy (scanner->hosts_data->targethosts);
-  g_free (scanner->hosts_data);
+  hosts_data_free (scanner->hosts_data);
+  free_probe_batches (scanner);
+  route_cache_free (scanner->route_cache);
+  arp_sweeper_free (scanner->arp_sweeper);
 
   return close_err;
 }
@@ -112,7 +110,7 @@ run_cli_scan (scanner_t *scanner, alive_test_t alive_test)
   struct timeval start_time, end_time;
 
   gettimeofday (&start_time, NULL);
-  number_of_targets = g_hash_table_size (scanner->hosts_data->targethosts);
+  number_of_targets = scanner->hosts_data->count;
 
   if (scanner->print_results == 1)
     printf ("Alive scan started: Target has %d hosts.\n", number_of_targets);
@@ -121,50 +119,22 @@ run_cli_scan (scanner_t *scanner, alive_test_t alive_test)
   if (error)
     return error;
 
-  if (alive_test & (ALIVE_TEST_ICMP))
-    {
-      g_hash_table_foreach (scanner->hosts_data->targethosts, send_icmp,
-                            scanner);
-      wait_until_so_sndbuf_empty (scanner->icmpv4soc, 10);
-      wait_until_so_sndbuf_empty (scanner->icmpv6soc, 10);
-      usleep (500000);
-    }
-  if (alive_test & (ALIVE_TEST_TCP_SYN_SERVICE))
-    {
-      scanner->tcp_flag = 0x02; /* SYN */
-      g_hash_table_foreach (scanner->hosts_data->targethosts, send_tcp,
-                            scanner);
-      wait_until_so_sndbuf_empty (scanner->tcpv4soc, 10);
-      wait_until_so_sndbuf_empty (scanner->tcpv6soc, 10);
-      usleep (500000);
-    }
-  if (alive_test & (ALIVE_TEST_TCP_ACK_SERVICE))
-    {
-      scanner->tcp_flag = 0x10; /* ACK */
-      g_hash_table_foreach (scanner->hosts_data->targethosts, send_tcp,
-                            scanner);
-      wait_until_so_sndbuf_empty (scanner->tcpv4soc, 10);
-      wait_until_so_sndbuf_empty (scanner->tcpv6soc, 10);
-      usleep (500000);
-    }
-  if (alive_test & (ALIVE_TEST_ARP))
-    {
-      g_hash_table_foreach (scanner->hosts_data->targethosts, send_arp,
-                            scanner);
-      wait_until_so_sndbuf_empty (scanner->arpv4soc, 10);
-      wait_until_so_sndbuf_empty (scanner->arpv6soc, 10);
-      usleep (500000);
-    }
+  send_probes (scanner, alive_test, get_alive_test_send_threads ());
+  if (alive_test & ALIVE_TEST_ICMP)
+    send_icmp_retries (scanner, get_icmp_retries (), get_icmp_grace_period ());
 
   if (wait_timeout > 0 && wait_timeout <= 20)
-    sleep (wait_timeout);
+    hosts_data_wait_for_replies (scanner->hosts_data, g_get_monotonic_time (),
+                                 wait_timeout * G_USEC_PER_SEC);
   else
-    sleep (get_alive_test_wait_timeout ());
+    hosts_data_wait_for_replies (scanner->hosts_data, g_get_monotonic_time (),
+                                 get_alive_test_wait_timeout ()
+                                   * G_USEC_PER_SEC);
 
   stop_sniffer_thread (scanner, sniffer_thread_id);
 
-  number_of_dead_hosts = count_difference (scanner->hosts_data->targethosts,
-                                           scanner->hosts_data->alivehosts);
+  number_of_dead_hosts =
+    number_of_targets - hosts_data_alive_count (scanner->hosts_data);
   gettimeofday (&end_time, NULL);
   if (scanner->print_results == 1)
     printf ("Alive scan finished in %ld seconds: %d alive hosts of %d.\n",
@@ -17,9 +17,10 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#define _GNU_SOURCE /* for sendmmsg() */
+
 #include "ping.h"
 
-#include "../base/prefs.h" /* for prefs_get() */
 #include "arp.h"
 #include "util.h"
 
@@ -33,11 +34,14 @@
 #include <netinet/ip6.h>
 #include <netinet/ip_icmp.h>
 #include <netinet/tcp.h>
+#include <netpacket/packet.h> /* for struct sockaddr_ll */
+#include <pthread.h>
 #include <stdlib.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/uio.h> /* for struct iovec */
 #include <unistd.h>
 
 #undef G_LOG_DOMAIN
@@ -68,6 +72,42 @@ struct pseudohdr
   struct tcphdr tcpheader;
 };
 
+/* Number of probes sent with one sendmmsg() call. */
+#define PROBE_BATCH_SIZE 64
+/* Size of a probe buffer. Large enough for all probes sent by boreas. */
+#define PROBE_MAX_LEN 128
+
+/* Number of probe templates per batch. TCP probes have one per flag. */
+#define PROBE_TEMPLATES 2
+/* Number of targets a probe method lags behind the previous method when
+ * probing interleaved. Gives replies to earlier probes time to arrive. */
+#define INTERLEAVE_DISTANCE 256
+
+/**
+ * @brief Prebuilt probe which is copied and completed for every destination.
+ */
+struct probe_template
+{
+  u_char buf[PROBE_MAX_LEN]; /* Probe. */
+  size_t len;                /* Length of the probe, 0 if not built yet. */
+};
+
+/**
+ * @brief Preallocated probe packets which are sent with one sendmmsg() call.
+ */
+struct probe_batch
+{
+  int soc;                                          /* Socket to send on. */
+  unsigned int count;                               /* Queued probes. */
+  struct mmsghdr msgs[PROBE_BATCH_SIZE];            /* Message headers. */
+  struct iovec iovs[PROBE_BATCH_SIZE];              /* Probe buffer vectors. */
+  struct sockaddr_storage dsts[PROBE_BATCH_SIZE];   /* Destinations. */
+  u_char packets[PROBE_BATCH_SIZE][PROBE_MAX_LEN];  /* Probe buffers. */
+  guint32 targets[PROBE_BATCH_SIZE];                /* Host index + 1 or 0. */
+  struct probe_template templates[PROBE_TEMPLATES]; /* Probe templates. */
+  unsigned int probes[PROBE_TYPE_MAX];              /* Queued probes by type. */
+};
+
 /**
  * @brief Get the size of the socket send buffer.
  *
@@ -91,71 +131,251 @@ get_so_sndbuf (int soc, int *so_sndbuf)
 }
 
 /**
- * @brief Wait until output queue is small enough for sending new packets.
+ * @brief Lower the send rate if the output queue of a socket grows.
  *
- * If calls to ioctl fail in this function we might not throttle as expected
- * and only delay by a fixed amount of time.
+ * A send queue filled to more than half of the socket send buffer means we
+ * send faster than the interface can put packets on the wire.
  *
- * @param soc       Socket.
- * @param so_sndbuf Size of the socket send buffer we do not want to exceed.
+ * @param limiter Rate limiter to back off.
+ * @param soc     Socket.
  */
 static void
-throttle (int soc, int so_sndbuf)
+check_send_queue (rate_limiter_t *limiter, int soc)
 {
-  // g_warning ("%s: so_sndbuf %d", __func__, so_sndbuf);
-  int cur_so_sendbuf = -1;
+  int so_sndbuf, cur_so_sendbuf = -1;
 
-  /* Get the current size of the output queue size */
+  if (get_so_sndbuf (soc, &so_sndbuf) == -1)
+    return;
   if (ioctl (soc, SIOCOUTQ, &cur_so_sendbuf) == -1)
     {
       g_warning ("%s: ioctl error: %s", __func__, strerror (errno));
-      usleep (100000);
       return;
     }
+  if (cur_so_sendbuf >= so_sndbuf / 2)
+    rate_limiter_backoff (limiter);
+}
 
-  /* If setting of so_sndbuf or cur_so_sendbuf failed we do not enter the
-   * throttling loop. Normally this should not occur but we really do not want
-   * to get into an infinite loop here. */
-  if (cur_so_sendbuf != -1 && so_sndbuf != -1)
+/**
+ * @brief Get the socket of the scanner for the given socket type.
+ *
+ * @param scanner Scanner struct.
+ * @param type    Socket type.
+ *
+ * @return Socket, -1 if the scanner has no socket of this type.
+ */
+static int
+get_socket_of_type (scanner_t *scanner, socket_type_t type)
+{
+  switch (type)
+    {
+    case TCPV4:
+      return scanner->tcpv4soc;
+    case TCPV6:
+      return scanner->tcpv6soc;
+    case ICMPV4:
+      return scanner->icmpv4soc;
+    case ICMPV6:
+      return scanner->icmpv6soc;
+    case ARPV4:
+      return scanner->arpv4soc;
+    case ARPV6:
+      return scanner->arpv6soc;
+    case UDPV4:
+      return scanner->udpv4soc;
+    case UDPV6:
+      return scanner->udpv6soc;
+    default:
+      return -1;
+    }
+}
+
+/**
+ * @brief Get the probe batch of a socket type, allocating it if needed.
+ *
+ * @param scanner Scanner struct.
+ * @param type    Socket type the probes are sent on.
+ *
+ * @return Probe batch.
+ */
+static probe_batch_t *
+probe_batch_get (scanner_t *scanner, socket_type_t type)
+{
+  probe_batch_t *batch = scanner->probe_batches[type];
+
+  if (batch == NULL)
     {
-      /* Wait until output queue is empty enough. */
-      while (cur_so_sendbuf >= so_sndbuf)
+      batch = g_malloc0 (sizeof (probe_batch_t));
+      for (int i = 0; i < PROBE_BATCH_SIZE; i++)
         {
-          usleep (100000);
-          if (ioctl (soc, SIOCOUTQ, &cur_so_sendbuf) == -1)
-            {
-              g_warning ("%s: ioctl error: %s", __func__, strerror (errno));
-              usleep (100000);
-              /* Do not risk getting into infinite loop */
-              return;
-            }
+          batch->iovs[i].iov_base = batch->packets[i];
+          batch->msgs[i].msg_hdr.msg_iov = &batch->iovs[i];
+          batch->msgs[i].msg_hdr.msg_iovlen = 1;
+          batch->msgs[i].msg_hdr.msg_name = &batch->dsts[i];
+        }
+      scanner->probe_batches[type] = batch;
+    }
+  batch->soc = get_socket_of_type (scanner, type);
+  return batch;
+}
+
+/**
+ * @brief Get the buffer for the next probe of a batch.
+ *
+ * The probe is queued by probe_batch_commit() once it is built.
+ *
+ * @param batch Probe batch.
+ *
+ * @return Buffer of PROBE_MAX_LEN bytes. It is not cleared.
+ */
+static u_char *
+probe_batch_slot (probe_batch_t *batch)
+{
+  return batch->packets[batch->count];
+}
+
+/**
+ * @brief Send all queued probes of a batch with sendmmsg().
+ *
+ * Sending is paced by the rate limiter of the scanner. If the kernel drops
+ * packets because of full buffers the rate is lowered and the rest of the
+ * batch is retried once. Probes which can not be sent are skipped.
+ *
+ * The send times of the target hosts are recorded once sendmmsg() returned,
+ * so waiting for the rate limiter does not count as round trip time.
+ *
+ * @param scanner Scanner struct.
+ * @param batch   Probe batch.
+ */
+static void
+probe_batch_flush (scanner_t *scanner, probe_batch_t *batch)
+{
+  rate_limiter_t *limiter = &scanner->rate_limiter;
+  unsigned int sent = 0;
+  gboolean retried = FALSE;
+
+  if (batch->count == 0)
+    return;
+
+  rate_limiter_wait (limiter, batch->count);
+  while (sent < batch->count)
+    {
+      int ret;
+
+      ret = sendmmsg (batch->soc, batch->msgs + sent, batch->count - sent,
+                      MSG_NOSIGNAL);
+      if (ret >= 0)
+        {
+          sent += ret;
+          continue;
+        }
+      if (errno == EINTR)
+        continue;
+      if ((errno == ENOBUFS || errno == EAGAIN) && !retried)
+        {
+          retried = TRUE;
+          rate_limiter_backoff (limiter);
+          rate_limiter_wait (limiter, batch->count - sent);
+          continue;
         }
+      g_warning ("%s: sendmmsg(): %s", __func__, strerror (errno));
+      sent++;
     }
 
-  return;
+  for (unsigned int i = 0; i < batch->count; i++)
+    if (batch->targets[i])
+      hosts_data_probe_sent (scanner->hosts_data, batch->targets[i] - 1);
+  limiter->sent += batch->count;
+  /* One atomic add per type and batch, the metrics are shared by all
+   * sender threads. */
+  for (int type = 0; type < PROBE_TYPE_MAX; type++)
+    if (batch->probes[type])
+      {
+        g_atomic_int_add (&scanner->hosts_data->metrics.probes[type],
+                          batch->probes[type]);
+        batch->probes[type] = 0;
+      }
+  batch->count = 0;
+  check_send_queue (limiter, batch->soc);
+}
+
+/**
+ * @brief Queue the probe built in the current slot of a batch.
+ *
+ * The batch is sent once it is full. The probe belongs to the target host
+ * of scanner->probe_target.
+ *
+ * @param scanner Scanner struct.
+ * @param batch   Probe batch.
+ * @param len     Length of the probe.
+ * @param dst     Destination address.
+ * @param dst_len Length of destination address.
+ * @param type    Type of the probe, for the metrics.
+ */
+static void
+probe_batch_commit (scanner_t *scanner, probe_batch_t *batch, size_t len,
+                    const struct sockaddr *dst, socklen_t dst_len,
+                    probe_type_t type)
+{
+  unsigned int i = batch->count;
+
+  batch->probes[type]++;
+  batch->iovs[i].iov_len = len;
+  memcpy (&batch->dsts[i], dst, dst_len);
+  batch->msgs[i].msg_hdr.msg_namelen = dst_len;
+  batch->targets[i] = scanner->probe_target;
+  if (++batch->count == PROBE_BATCH_SIZE)
+    probe_batch_flush (scanner, batch);
+}
+
+/**
+ * @brief Send all probes which are still queued.
+ *
+ * @param scanner Scanner struct.
+ */
+void
+flush_probe_batches (scanner_t *scanner)
+{
+  for (int i = 0; i < SOCKET_TYPE_MAX; i++)
+    if (scanner->probe_batches[i])
+      probe_batch_flush (scanner, scanner->probe_batches[i]);
+}
+
+/**
+ * @brief Free the probe batches of the scanner. Queued probes are dropped.
+ *
+ * @param scanner Scanner struct.
+ */
+void
+free_probe_batches (scanner_t *scanner)
+{
+  for (int i = 0; i < SOCKET_TYPE_MAX; i++)
+    {
+      g_free (scanner->probe_batches[i]);
+      scanner->probe_batches[i] = NULL;
+    }
 }
 
 /**
  * @brief Send icmp ping.
  *
- * @param soc Socket to use for sending.
+ * @param scanner Scanner struct.
+ * @param soc_type Type of socket to use for sending. ICMPV6 or ARPV6.
  * @param dst Destination address to send to.
  * @param type  Type of imcp. e.g. ND_NEIGHBOR_SOLICIT or ICMP6_ECHO_REQUEST.
  */
 static void
-send_icmp_v6 (int soc, struct in6_addr *dst, int type)
+send_icmp_v6 (scanner_t *scanner, socket_type_t soc_type, struct in6_addr *dst,
+              int type)
 {
   struct sockaddr_in6 soca;
-  char sendbuf[1500];
+  probe_batch_t *batch;
   int len;
   int datalen = 56;
   struct icmp6_hdr *icmp6;
 
-  /* Throttling related variables */
-  static int so_sndbuf = -1; // socket send buffer
-  static int init = -1;
-
-  icmp6 = (struct icmp6_hdr *) sendbuf;
+  batch = probe_batch_get (scanner, soc_type);
+  icmp6 = (struct icmp6_hdr *) probe_batch_slot (batch);
+  memset (icmp6, 0, sizeof (struct icmp6_hdr));
   icmp6->icmp6_type = type; /* ND_NEIGHBOR_SOLICIT or ICMP6_ECHO_REQUEST */
   icmp6->icmp6_code = 0;
   icmp6->icmp6_id = 234;
@@ -170,165 +390,233 @@ send_icmp_v6 (int soc, struct in6_addr *dst, int type)
   soca.sin6_family = AF_INET6;
   soca.sin6_addr = *dst;
 
-  /* Get size of empty SO_SNDBUF */
-  if (init == -1)
-    {
-      if (get_so_sndbuf (soc, &so_sndbuf) == 0)
-        init = 1;
-    }
-  /* Throttle speed if needed */
-  throttle (soc, so_sndbuf);
-
-  if (sendto (soc, sendbuf, len, MSG_NOSIGNAL, (struct sockaddr *) &soca,
-              sizeof (struct sockaddr_in6))
-      < 0)
-    {
-      g_warning ("%s: sendto(): %s", __func__, strerror (errno));
-    }
+  probe_batch_commit (scanner, batch, len, (struct sockaddr *) &soca,
+                      sizeof (struct sockaddr_in6),
+                      soc_type == ARPV6 ? PROBE_ARP : PROBE_ICMP);
 }
 
 /**
  * @brief Send icmp ping.
  *
- * @param soc Socket to use for sending.
+ * @param scanner Scanner struct.
  * @param dst Destination address to send to.
  */
 static void
-send_icmp_v4 (int soc, struct in_addr *dst)
+send_icmp_v4 (scanner_t *scanner, struct in_addr *dst)
 {
-  /* datalen + MAXIPLEN + MAXICMPLEN */
-  char sendbuf[56 + 60 + 76];
   struct sockaddr_in soca;
+  probe_batch_t *batch;
 
-  int len;
+  struct probe_template *template;
   int datalen = 56;
-  struct icmphdr *icmp;
-
-  /* Throttling related variables */
-  static int so_sndbuf = -1; // socket send buffer
-  static int init = -1;
 
-  icmp = (struct icmphdr *) sendbuf;
-  icmp->type = ICMP_ECHO;
-  icmp->code = 0;
+  batch = probe_batch_get (scanner, ICMPV4);
+  /* All echo requests are the same, only build and checksum the first one. */
+  template = &batch->templates[0];
+  if (template->len == 0)
+    {
+      struct icmphdr *icmp = (struct icmphdr *) template->buf;
 
-  len = 8 + datalen;
-  icmp->checksum = 0;
-  icmp->checksum = in_cksum ((u_short *) icmp, len);
+      icmp->type = ICMP_ECHO;
+      icmp->code = 0;
+      template->len = 8 + datalen;
+      icmp->checksum = 0;
+      icmp->checksum = in_cksum ((u_short *) icmp, template->len);
+    }
+  memcpy (probe_batch_slot (batch), template->buf, template->len);
 
   memset (&soca, 0, sizeof (soca));
   soca.sin_family = AF_INET;
   soca.sin_addr = *dst;
 
-  /* Get size of empty SO_SNDBUF */
-  if (init == -1)
+  probe_batch_commit (scanner, batch, template->len,
+                      (const struct sockaddr *) &soca, sizeof (soca),
+                      PROBE_ICMP);
+}
+
+/**
+ * @brief Send icmp ping to an address. Check if ipv6 or ipv4 and start
+ * appropriate ping function.
+ *
+ * @param scanner Pointer to scanner struct.
+ * @param dst6_p Destination address. IPv4 as IPv4 mapped address.
+ */
+static void
+send_icmp_addr (scanner_t *scanner, struct in6_addr *dst6_p)
+{
+  struct in_addr dst4;
+
+  if (IN6_IS_ADDR_V4MAPPED (dst6_p) != 1)
     {
-      if (get_so_sndbuf (soc, &so_sndbuf) == 0)
-        init = 1;
+      send_icmp_v6 (scanner, ICMPV6, dst6_p, ICMP6_ECHO_REQUEST);
     }
-  /* Throttle speed if needed */
-  throttle (soc, so_sndbuf);
-
-  if (sendto (soc, sendbuf, len, MSG_NOSIGNAL, (const struct sockaddr *) &soca,
-              sizeof (struct sockaddr_in))
-      < 0)
+  else
     {
-      g_warning ("%s: sendto(): %s", __func__, strerror (errno));
+      dst4.s_addr = dst6_p->s6_addr32[3];
+      send_icmp_v4 (scanner, &dst4);
     }
 }
 
 /**
- * @brief Is called in g_hash_table_foreach(). Check if ipv6 or ipv4, get
- * correct socket and start appropriate ping function.
+ * @brief Send icmp ping to a target host.
  *
- * @param key Ip string.
- * @param value Pointer to gvm_host_t.
- * @param scanner_p Pointer to scanner struct.
+ * Only one echo request is sent. Hosts which do not reply are pinged again by
+ * send_icmp_retries().
+ *
+ * @param scanner Pointer to scanner struct.
+ * @param index Index of the target host in the hosts data of the scanner.
  */
 void
-send_icmp (gpointer key, gpointer value, gpointer scanner_p)
+send_icmp (scanner_t *scanner, guint32 index)
 {
-  scanner_t *scanner;
   struct in6_addr dst6;
-  struct in6_addr *dst6_p = &dst6;
-  struct in_addr dst4;
-  struct in_addr *dst4_p = &dst4;
-  static int count = 0;
-  int icmp_retries, grace_period = 0;
-  const char *tmp;
-  if ((icmp_retries =
-         (tmp = prefs_get ("icmp_retries")) != NULL ? atoi (tmp) : 1)
-      <= 0)
-    icmp_retries = 1;
-  else if (icmp_retries > 1)
-    grace_period =
-      (tmp = prefs_get ("icmp_grace_period")) != NULL ? atoi (tmp) : 0;
-
-  scanner = (scanner_t *) scanner_p;
-
-  // we may send multiple icmp message to reduce to chance of unwanted drops
-  for (int i = 0; i < icmp_retries; i++)
+
+  if (hosts_data_is_alive (scanner->hosts_data, index))
+    return;
+
+  dst6 = scanner->hosts_data->addrs[index];
+  if (IN6_IS_ADDR_UNSPECIFIED (&dst6))
+    return;
+  if (hosts_data_probe_queued (scanner->hosts_data, index))
+    scanner->probe_target = index + 1;
+  send_icmp_addr (scanner, &dst6);
+  scanner->probe_target = 0;
+}
+
+/**
+ * @brief Ping the target hosts which did not reply yet again.
+ *
+ * Every retry is a pass over the hosts which are not alive, started once the
+ * replies to the previous pass are not expected anymore, see
+ * hosts_data_wait_for_replies(). Hosts which replied in the meantime cost
+ * nothing and the first pass is not slowed down by the retries.
+ *
+ * @param scanner Pointer to scanner struct.
+ * @param retries Number of echo requests per host, including the first one.
+ * @param max_wait Maximum time (us) to wait for replies before a retry.
+ */
+void
+send_icmp_retries (scanner_t *scanner, unsigned int retries, gint64 max_wait)
+{
+  hosts_data_t *hosts_data = scanner->hosts_data;
+
+  for (unsigned int retry = 1; retry < retries; retry++)
     {
-      if (g_hash_table_contains (scanner->hosts_data->alivehosts, key))
-        return;
-      if (++count % BURST == 0)
-        usleep (BURST_TIMEOUT);
+      guint32 resent = 0;
 
-      if (gvm_host_get_addr6 ((gvm_host_t *) value, dst6_p) < 0)
-        g_warning ("%s: could not get addr6 from gvm_host_t", __func__);
-      if (dst6_p == NULL)
+      hosts_data_wait_for_replies (hosts_data, g_get_monotonic_time (),
+                                   max_wait);
+      for (guint32 i = 0; i < hosts_data->count; i++)
         {
-          g_warning ("%s: destination address is NULL", __func__);
-          return;
-        }
-      if (IN6_IS_ADDR_V4MAPPED (dst6_p) != 1)
-        {
-          send_icmp_v6 (scanner->icmpv6soc, dst6_p, ICMP6_ECHO_REQUEST);
+          struct in6_addr *dst6_p = &hosts_data->addrs[i];
+
+          if (hosts_data_is_alive (hosts_data, i)
+              || IN6_IS_ADDR_UNSPECIFIED (dst6_p))
+            continue;
+          hosts_data_probe_resent (hosts_data, i);
+          send_icmp_addr (scanner, dst6_p);
+          resent++;
         }
-      else
-        {
-          dst4.s_addr = dst6_p->s6_addr32[3];
-          send_icmp_v4 (scanner->icmpv4soc, dst4_p);
-        }
-      if (grace_period > 0)
-        usleep (grace_period);
+      flush_probe_batches (scanner);
+      g_debug ("%s: Retry %u: %u echo requests resent.", __func__, retry,
+               resent);
+      if (resent == 0)
+        return;
     }
 }
 
 /**
- * @brief Send tcp ping.
+ * @brief Build the IPv6 TCP probe template of a batch if it is not up to date.
  *
- * @param soc Socket to use for sending.
- * @param dst Destination address to send to.
+ * The destination address, destination port and sequence number of the
+ * template are 0 and its checksum is updated incrementally for them by every
+ * probe.
+ *
+ * @param batch Probe batch.
+ * @param src Source address.
  * @param tcp_flag  TH_SYN or TH_ACK.
+ *
+ * @return Probe template for the flag.
+ */
+static struct probe_template *
+tcp_template_v6 (probe_batch_t *batch, struct in6_addr *src, uint8_t tcp_flag)
+{
+  struct probe_template *template = &batch->templates[tcp_flag == TH_ACK];
+  struct ip6_hdr *ip = (struct ip6_hdr *) template->buf;
+  struct tcphdr *tcp =
+    (struct tcphdr *) (template->buf + sizeof (struct ip6_hdr));
+  struct v6pseudohdr pseudoheader;
+
+  if (template->len && IN6_ARE_ADDR_EQUAL (&ip->ip6_src, src)
+      && tcp->th_flags == tcp_flag)
+    return template;
+
+  memset (template->buf, 0, sizeof (template->buf));
+  /* IPv6 */
+  ip->ip6_flow = htonl ((6 << 28) | (0 << 20) | 0);
+  ip->ip6_plen = htons (20); // TCP_HDRLEN
+  ip->ip6_nxt = IPPROTO_TCP;
+  ip->ip6_hops = 255; // max value
+  ip->ip6_src = *src;
+
+  /* TCP */
+  tcp->th_sport = htons (FILTER_PORT);
+  tcp->th_seq = htonl (0);
+  tcp->th_ack = htonl (0);
+  tcp->th_x2 = 0;
+  tcp->th_off = 20 / 4; // TCP_HDRLEN / 4 (size of tcphdr in 32 bit words)
+  tcp->th_flags = tcp_flag; // TH_SYN or TH_ACK
+  tcp->th_win = htons (65535);
+  tcp->th_urp = htons (0);
+  tcp->th_sum = 0;
+
+  /* CKsum */
+  memset (&pseudoheader, 0, 38 + sizeof (struct tcphdr));
+  memcpy (&pseudoheader.s6addr, &ip->ip6_src, sizeof (struct in6_addr));
+  pseudoheader.protocol = IPPROTO_TCP;
+  pseudoheader.length = htons (sizeof (struct tcphdr));
+  memcpy ((char *) &pseudoheader.tcpheader, (char *) tcp,
+          sizeof (struct tcphdr));
+  tcp->th_sum =
+    in_cksum ((unsigned short *) &pseudoheader, 38 + sizeof (struct tcphdr));
+
+  /*  TCP_HDRLEN(20) IP6_HDRLEN(40) */
+  template->len = 40 + 20;
+  return template;
+}
+
+/**
+ * @brief Send tcp ping.
+ *
+ * The sequence number of every probe is its cookie, see tcp_cookie().
+ *
+ * @param scanner Scanner struct.
+ * @param dst_p Destination address to send to.
+ * @param ports Ports to send to.
  */
 static void
-send_tcp_v6 (scanner_t *scanner, struct in6_addr *dst_p)
+send_tcp_v6 (scanner_t *scanner, struct in6_addr *dst_p, GArray *ports)
 {
   boreas_error_t error;
   struct sockaddr_in6 soca;
   struct in6_addr src;
+  struct probe_template *template;
+  struct ip6_hdr *template_ip;
+  struct tcphdr *template_tcp;
+  uint16_t sum;
 
-  /* Throttling related variables */
-  static int so_sndbuf = -1; // socket send buffer
-  static int init = -1;
-
-  GArray *ports = scanner->ports;
   int *udpv6soc = &(scanner->udpv6soc);
-  int soc = scanner->tcpv6soc;
   uint8_t tcp_flag = scanner->tcp_flag;
-
-  u_char packet[sizeof (struct ip6_hdr) + sizeof (struct tcphdr)];
-  struct ip6_hdr *ip = (struct ip6_hdr *) packet;
-  struct tcphdr *tcp = (struct tcphdr *) (packet + sizeof (struct ip6_hdr));
+  probe_batch_t *batch = probe_batch_get (scanner, TCPV6);
 
   /* Get source address for TCP header. */
-  error = get_source_addr_v6 (udpv6soc, dst_p, &src);
+  error = route_cache_get_source_v6 (scanner->route_cache, udpv6soc, dst_p,
+                                     &src);
   if (error)
     {
-      char destination_str[INET_ADDRSTRLEN];
+      char destination_str[INET6_ADDRSTRLEN];
       inet_ntop (AF_INET6, (const void *) dst_p, destination_str,
-                 INET_ADDRSTRLEN);
+                 INET6_ADDRSTRLEN);
       g_debug ("%s: Destination: %s. %s", __func__, destination_str,
                str_boreas_error (error));
       return;
@@ -338,102 +626,134 @@ send_tcp_v6 (scanner_t *scanner, struct in6_addr *dst_p)
   if (ports->len == 0)
     return;
 
+  template = tcp_template_v6 (batch, &src, tcp_flag);
+  template_ip = (struct ip6_hdr *) template->buf;
+  template_tcp = (struct tcphdr *) (template->buf + sizeof (struct ip6_hdr));
+  /* Checksum of the template with the destination address of this host. */
+  sum = in_cksum_update (template_tcp->th_sum, &template_ip->ip6_dst, dst_p,
+                         sizeof (struct in6_addr));
+
+  memset (&soca, 0, sizeof (soca));
+  soca.sin6_family = AF_INET6;
+  soca.sin6_addr = *dst_p;
+
   /* For ports in ports array send packet. */
   for (guint i = 0; i < ports->len; i++)
     {
-      memset (packet, 0, sizeof (packet));
-      /* IPv6 */
-      ip->ip6_flow = htonl ((6 << 28) | (0 << 20) | 0);
-      ip->ip6_plen = htons (20); // TCP_HDRLEN
-      ip->ip6_nxt = IPPROTO_TCP;
-      ip->ip6_hops = 255; // max value
-
-      ip->ip6_src = src;
-      ip->ip6_dst = *dst_p;
+      u_char *packet = probe_batch_slot (batch);
+      struct ip6_hdr *ip = (struct ip6_hdr *) packet;
+      struct tcphdr *tcp = (struct tcphdr *) (packet + sizeof (struct ip6_hdr));
 
-      /* TCP */
-      tcp->th_sport = htons (FILTER_PORT);
-      tcp->th_dport = htons (g_array_index (ports, uint16_t, i));
-      tcp->th_seq = htonl (0);
-      tcp->th_ack = htonl (0);
-      tcp->th_x2 = 0;
-      tcp->th_off = 20 / 4; // TCP_HDRLEN / 4 (size of tcphdr in 32 bit words)
-      tcp->th_flags = tcp_flag; // TH_SYN or TH_ACK
-      tcp->th_win = htons (65535);
-      tcp->th_urp = htons (0);
-      tcp->th_sum = 0;
-
-      /* CKsum */
-      {
-        struct v6pseudohdr pseudoheader;
-
-        memset (&pseudoheader, 0, 38 + sizeof (struct tcphdr));
-        memcpy (&pseudoheader.s6addr, &ip->ip6_src, sizeof (struct in6_addr));
-        memcpy (&pseudoheader.d6addr, &ip->ip6_dst, sizeof (struct in6_addr));
-
-        pseudoheader.protocol = IPPROTO_TCP;
-        pseudoheader.length = htons (sizeof (struct tcphdr));
-        memcpy ((char *) &pseudoheader.tcpheader, (char *) tcp,
-                sizeof (struct tcphdr));
-        tcp->th_sum = in_cksum ((unsigned short *) &pseudoheader,
-                                38 + sizeof (struct tcphdr));
-      }
-
-      memset (&soca, 0, sizeof (soca));
-      soca.sin6_family = AF_INET6;
-      soca.sin6_addr = ip->ip6_dst;
-
-      /* Get size of empty SO_SNDBUF */
-      if (init == -1)
-        {
-          if (get_so_sndbuf (soc, &so_sndbuf) == 0)
-            init = 1;
-        }
-      /* Throttle speed if needed */
-      throttle (soc, so_sndbuf);
+      uint16_t port = g_array_index (ports, uint16_t, i);
 
-      /*  TCP_HDRLEN(20) IP6_HDRLEN(40) */
-      if (sendto (soc, (const void *) ip, 40 + 20, MSG_NOSIGNAL,
-                  (struct sockaddr *) &soca, sizeof (struct sockaddr_in6))
-          < 0)
-        {
-          g_warning ("%s: sendto():  %s", __func__, strerror (errno));
-        }
+      memcpy (packet, template->buf, template->len);
+      ip->ip6_dst = *dst_p;
+      tcp->th_dport = htons (port);
+      tcp->th_seq = htonl (tcp_cookie (scanner->cookie_key, dst_p, port));
+      tcp->th_sum = in_cksum_update (sum, &template_tcp->th_dport,
+                                     &tcp->th_dport, sizeof (tcp->th_dport));
+      tcp->th_sum = in_cksum_update (tcp->th_sum, &template_tcp->th_seq,
+                                     &tcp->th_seq, sizeof (tcp->th_seq));
+
+      probe_batch_commit (scanner, batch, template->len,
+                          (struct sockaddr *) &soca,
+                          sizeof (struct sockaddr_in6),
+                          tcp_flag == TH_ACK ? PROBE_TCP_ACK : PROBE_TCP_SYN);
     }
 }
 
+/**
+ * @brief Build the IPv4 TCP probe template of a batch if it is not up to date.
+ *
+ * The destination address, destination port and sequence number of the
+ * template are 0 and its checksum is updated incrementally for them by every
+ * probe.
+ *
+ * @param batch Probe batch.
+ * @param src Source address.
+ * @param tcp_flag  TH_SYN or TH_ACK.
+ *
+ * @return Probe template for the flag.
+ */
+static struct probe_template *
+tcp_template_v4 (probe_batch_t *batch, struct in_addr *src, uint8_t tcp_flag)
+{
+  struct probe_template *template = &batch->templates[tcp_flag == TH_ACK];
+  struct ip *ip = (struct ip *) template->buf;
+  struct tcphdr *tcp = (struct tcphdr *) (template->buf + sizeof (struct ip));
+  struct pseudohdr pseudoheader;
+
+  if (template->len && ip->ip_src.s_addr == src->s_addr
+      && tcp->th_flags == tcp_flag)
+    return template;
+
+  memset (template->buf, 0, sizeof (template->buf));
+  /* IP */
+  ip->ip_hl = 5;
+  ip->ip_off = htons (0);
+  ip->ip_v = 4;
+  ip->ip_tos = 0;
+  ip->ip_p = IPPROTO_TCP;
+  ip->ip_ttl = 0x40;
+  ip->ip_src = *src;
+  ip->ip_sum = 0;
+
+  /* TCP */
+  tcp->th_sport = htons (FILTER_PORT);
+  tcp->th_flags = tcp_flag; // TH_SYN TH_ACK;
+  tcp->th_ack = 0;
+  tcp->th_x2 = 0;
+  tcp->th_off = 5;
+  tcp->th_win = 2048;
+  tcp->th_urp = 0;
+  tcp->th_sum = 0;
+
+  /* CKsum */
+  memset (&pseudoheader, 0, 12 + sizeof (struct tcphdr));
+  pseudoheader.saddr.s_addr = src->s_addr;
+  pseudoheader.protocol = IPPROTO_TCP;
+  pseudoheader.length = htons (sizeof (struct tcphdr));
+  memcpy ((char *) &pseudoheader.tcpheader, (char *) tcp,
+          sizeof (struct tcphdr));
+  tcp->th_sum =
+    in_cksum ((unsigned short *) &pseudoheader, 12 + sizeof (struct tcphdr));
+
+  template->len = 40;
+  return template;
+}
+
 /**
  * @brief Send tcp ping.
  *
+ * The sequence number of every probe is its cookie, see tcp_cookie().
+ *
  * @param scanner Scanner struct which includes all needed data for tcp_v4 ping.
- * @param dst Destination address to send to.
+ * @param dst_p Destination address to send to.
+ * @param ports Ports to send to.
  */
 static void
-send_tcp_v4 (scanner_t *scanner, struct in_addr *dst_p)
+send_tcp_v4 (scanner_t *scanner, struct in_addr *dst_p, GArray *ports)
 {
   boreas_error_t error;
   struct sockaddr_in soca;
   struct in_addr src;
+  struct probe_template *template; /* Probe template. */
+  struct ip *template_ip;          /* IP header of the probe template. */
+  struct tcphdr *template_tcp;     /* TCP header of the probe template. */
+  uint16_t sum;                    /* Checksum with destination address. */
+  struct in6_addr dst6;            /* Destination address for the cookies. */
 
-  /* Throttling related variables */
-  static int so_sndbuf = -1; // socket send buffer
-  static int init = -1;
-
-  int soc = scanner->tcpv4soc;          /* Socket used for sending. */
-  GArray *ports = scanner->ports;       /* Ports to ping. */
   int *udpv4soc = &(scanner->udpv4soc); /* Socket used for getting src addr */
   uint8_t tcp_flag = scanner->tcp_flag; /* SYN or ACK tcp flag. */
-
-  u_char packet[sizeof (struct ip) + sizeof (struct tcphdr)];
-  struct ip *ip = (struct ip *) packet;
-  struct tcphdr *tcp = (struct tcphdr *) (packet + sizeof (struct ip));
+  probe_batch_t *batch;                 /* Batch of probes to send. */
 
   /* No ports in portlist. */
   if (ports->len == 0)
     return;
 
   /* Get source address for TCP header. */
-  error = get_source_addr_v4 (udpv4soc, dst_p, &src);
+  error = route_cache_get_source_v4 (scanner->route_cache, udpv4soc, dst_p,
+                                     &src);
   if (error)
     {
       char destination_str[INET_ADDRSTRLEN];
@@ -443,172 +763,396 @@ send_tcp_v4 (scanner_t *scanner, struct in_addr *dst_p)
       return;
     }
 
+  batch = probe_batch_get (scanner, TCPV4);
+  template = tcp_template_v4 (batch, &src, tcp_flag);
+  template_ip = (struct ip *) template->buf;
+  template_tcp = (struct tcphdr *) (template->buf + sizeof (struct ip));
+  /* Checksum of the template with the destination address of this host. */
+  sum = in_cksum_update (template_tcp->th_sum, &template_ip->ip_dst, dst_p,
+                         sizeof (struct in_addr));
+
+  memset (&soca, 0, sizeof (soca));
+  soca.sin_family = AF_INET;
+  soca.sin_addr = *dst_p;
+
+  memset (&dst6, 0, sizeof (dst6));
+  dst6.s6_addr32[2] = htonl (0xffff);
+  dst6.s6_addr32[3] = dst_p->s_addr;
+
   /* For ports in ports array send packet. */
   for (guint i = 0; i < ports->len; i++)
     {
-      memset (packet, 0, sizeof (packet));
-      /* IP */
-      ip->ip_hl = 5;
-      ip->ip_off = htons (0);
-      ip->ip_v = 4;
-      ip->ip_tos = 0;
-      ip->ip_p = IPPROTO_TCP;
-      ip->ip_id = rand ();
-      ip->ip_ttl = 0x40;
-      ip->ip_src = src;
-      ip->ip_dst = *dst_p;
-      ip->ip_sum = 0;
-
-      /* TCP */
-      tcp->th_sport = htons (FILTER_PORT);
-      tcp->th_flags = tcp_flag; // TH_SYN TH_ACK;
-      tcp->th_dport = htons (g_array_index (ports, uint16_t, i));
-      tcp->th_seq = rand ();
-      tcp->th_ack = 0;
-      tcp->th_x2 = 0;
-      tcp->th_off = 5;
-      tcp->th_win = 2048;
-      tcp->th_urp = 0;
-      tcp->th_sum = 0;
-
-      /* CKsum */
-      {
-        struct in_addr source, dest;
-        struct pseudohdr pseudoheader;
-        source.s_addr = ip->ip_src.s_addr;
-        dest.s_addr = ip->ip_dst.s_addr;
-
-        memset (&pseudoheader, 0, 12 + sizeof (struct tcphdr));
-        pseudoheader.saddr.s_addr = source.s_addr;
-        pseudoheader.daddr.s_addr = dest.s_addr;
-
-        pseudoheader.protocol = IPPROTO_TCP;
-        pseudoheader.length = htons (sizeof (struct tcphdr));
-        memcpy ((char *) &pseudoheader.tcpheader, (char *) tcp,
-                sizeof (struct tcphdr));
-        tcp->th_sum = in_cksum ((unsigned short *) &pseudoheader,
-                                12 + sizeof (struct tcphdr));
-      }
+      u_char *packet = probe_batch_slot (batch);
+      struct ip *ip = (struct ip *) packet;
+      struct tcphdr *tcp = (struct tcphdr *) (packet + sizeof (struct ip));
 
-      memset (&soca, 0, sizeof (soca));
-      soca.sin_family = AF_INET;
-      soca.sin_addr = ip->ip_dst;
+      uint16_t port = g_array_index (ports, uint16_t, i);
 
-      /* Get size of empty SO_SNDBUF */
-      if (init == -1)
-        {
-          if (get_so_sndbuf (soc, &so_sndbuf) == 0)
-            init = 1;
-        }
-      /* Throttle speed if needed */
-      throttle (soc, so_sndbuf);
-
-      if (sendto (soc, (const void *) ip, 40, MSG_NOSIGNAL,
-                  (struct sockaddr *) &soca, sizeof (soca))
-          < 0)
-        {
-          g_warning ("%s: sendto(): %s", __func__, strerror (errno));
-        }
+      memcpy (packet, template->buf, template->len);
+      ip->ip_id = rand ();
+      ip->ip_dst = *dst_p;
+      tcp->th_dport = htons (port);
+      tcp->th_seq = htonl (tcp_cookie (scanner->cookie_key, &dst6, port));
+      tcp->th_sum = in_cksum_update (sum, &template_tcp->th_dport,
+                                     &tcp->th_dport, sizeof (tcp->th_dport));
+      tcp->th_sum = in_cksum_update (tcp->th_sum, &template_tcp->th_seq,
+                                     &tcp->th_seq, sizeof (tcp->th_seq));
+
+      probe_batch_commit (scanner, batch, template->len,
+                          (struct sockaddr *) &soca, sizeof (soca),
+                          tcp_flag == TH_ACK ? PROBE_TCP_ACK : PROBE_TCP_SYN);
     }
 }
 
 /**
- * @brief Is called in g_hash_table_foreach(). Check if ipv6 or ipv4, get
- * correct socket and start appropriate ping function.
+ * @brief Send tcp ping to a target host. Check if ipv6 or ipv4, get correct
+ * socket and start appropriate ping function.
  *
- * @param key Ip string.
- * @param value Pointer to gvm_host_t.
- * @param scanner_p Pointer to scanner struct.
+ * @param scanner Pointer to scanner struct.
+ * @param index Index of the target host in the hosts data of the scanner.
  */
 void
-send_tcp (gpointer key, gpointer value, gpointer scanner_p)
+send_tcp (scanner_t *scanner, guint32 index)
 {
-  scanner_t *scanner;
   struct in6_addr dst6;
   struct in6_addr *dst6_p = &dst6;
   struct in_addr dst4;
   struct in_addr *dst4_p = &dst4;
-  static int count = 0;
-
-  scanner = (scanner_t *) scanner_p;
 
-  if (g_hash_table_contains (scanner->hosts_data->alivehosts, key))
+  if (hosts_data_is_alive (scanner->hosts_data, index))
     return;
 
-  count++;
-  if (count % BURST == 0)
-    usleep (BURST_TIMEOUT);
-
-  if (gvm_host_get_addr6 ((gvm_host_t *) value, dst6_p) < 0)
-    g_warning ("%s: could not get addr6 from gvm_host_t", __func__);
-  if (dst6_p == NULL)
-    {
-      g_warning ("%s: destination address is NULL", __func__);
-      return;
-    }
+  dst6 = scanner->hosts_data->addrs[index];
+  if (IN6_IS_ADDR_UNSPECIFIED (dst6_p))
+    return;
+  if (hosts_data_probe_queued (scanner->hosts_data, index))
+    scanner->probe_target = index + 1;
   if (IN6_IS_ADDR_V4MAPPED (dst6_p) != 1)
     {
-      send_tcp_v6 (scanner, dst6_p);
+      send_tcp_v6 (scanner, dst6_p, scanner->ports);
     }
   else
     {
       dst4.s_addr = dst6_p->s6_addr32[3];
-      send_tcp_v4 (scanner, dst4_p);
+      send_tcp_v4 (scanner, dst4_p, scanner->ports);
+    }
+  scanner->probe_target = 0;
+}
+
+/**
+ * @brief Send TCP-SYN probes to all port discovery ports of a target host.
+ *
+ * Other than send_tcp(), hosts which are alive already are probed as well.
+ * The sniffer records the port states from the replies.
+ *
+ * @param scanner Pointer to scanner struct.
+ * @param index Index of the target host in the hosts data of the scanner.
+ */
+void
+send_port_probes (scanner_t *scanner, guint32 index)
+{
+  struct in6_addr dst6 = scanner->hosts_data->addrs[index];
+  struct in_addr dst4;
+
+  if (IN6_IS_ADDR_UNSPECIFIED (&dst6))
+    return;
+  scanner->tcp_flag = TH_SYN;
+  if (IN6_IS_ADDR_V4MAPPED (&dst6) != 1)
+    send_tcp_v6 (scanner, &dst6, scanner->discovery_ports);
+  else
+    {
+      dst4.s_addr = dst6.s6_addr32[3];
+      send_tcp_v4 (scanner, &dst4, scanner->discovery_ports);
     }
 }
 
 /**
- * @brief Is called in g_hash_table_foreach(). Check if ipv6 or ipv4, get
- * correct socket and start appropriate ping function.
+ * @brief Send arp ping to a target host. Check if ipv6 or ipv4, get correct
+ * socket and start appropriate ping function.
  *
- * @param host_value_str Ip string.
- * @param value Pointer to gvm_host_t.
- * @param scanner_p Pointer to scanner struct.
+ * @param scanner Pointer to scanner struct.
+ * @param index Index of the target host in the hosts data of the scanner.
  */
 void
-send_arp (gpointer host_value_str, gpointer value, gpointer scanner_p)
+send_arp (scanner_t *scanner, guint32 index)
 {
-  scanner_t *scanner;
   struct in6_addr dst6;
   struct in6_addr *dst6_p = &dst6;
-  static int count = 0;
+  guint32 target;
 
-  scanner = (scanner_t *) scanner_p;
-
-  if (g_hash_table_contains (scanner->hosts_data->alivehosts, host_value_str))
+  if (hosts_data_is_alive (scanner->hosts_data, index))
     return;
 
-  count++;
-  if (count % BURST == 0)
-    usleep (BURST_TIMEOUT);
-
-  if (gvm_host_get_addr6 ((gvm_host_t *) value, dst6_p) < 0)
-    g_warning ("%s: could not get addr6 from gvm_host_t", __func__);
-  if (dst6_p == NULL)
-    {
-      g_warning ("%s: destination address is NULL", __func__);
-      return;
-    }
+  dst6 = scanner->hosts_data->addrs[index];
+  if (IN6_IS_ADDR_UNSPECIFIED (dst6_p))
+    return;
+  target = hosts_data_probe_queued (scanner->hosts_data, index) ? index + 1 : 0;
   if (IN6_IS_ADDR_V4MAPPED (dst6_p) != 1)
     {
       /* IPv6 does simulate ARP by using the Neighbor Discovery Protocol with
        * ICMPv6. */
-      send_icmp_v6 (scanner->arpv6soc, dst6_p, ND_NEIGHBOR_SOLICIT);
+      scanner->probe_target = target;
+      send_icmp_v6 (scanner, ARPV6, dst6_p, ND_NEIGHBOR_SOLICIT);
+      scanner->probe_target = 0;
     }
   else
     {
       char ipv4_str[INET_ADDRSTRLEN];
+      struct in_addr dst4;
+      struct sockaddr_ll addr;
+      probe_batch_t *batch;
+      int len;
 
-      /* Need to transform the IPv6 mapped IPv4 address back to an IPv4 string.
-       * We can not just use the host_value_str as it might be an IPv4 mapped
-       * IPv6 string. */
+      /* Copy the prebuilt request of a directly connected interface. */
+      dst4.s_addr = dst6_p->s6_addr32[3];
+      batch = probe_batch_get (scanner, ARPV4);
+      len = arp_sweeper_frame (scanner->arp_sweeper, &dst4,
+                               probe_batch_slot (batch), &addr);
+      if (len > 0)
+        {
+          scanner->probe_target = target;
+          probe_batch_commit (scanner, batch, len, (struct sockaddr *) &addr,
+                              sizeof (addr), PROBE_ARP);
+          scanner->probe_target = 0;
+          return;
+        }
+
+      /* Need to transform the IPv6 mapped IPv4 address back to an IPv4
+       * string. */
       if (inet_ntop (AF_INET, &(dst6_p->s6_addr32[3]), ipv4_str,
                      sizeof (ipv4_str))
           == NULL)
         {
-          g_warning ("%s: Error: %s. Skipping ARP ping for '%s'", __func__,
-                     strerror (errno), (char *) host_value_str);
+          g_warning ("%s: Error: %s. Skipping ARP ping.", __func__,
+                     strerror (errno));
+          return;
         }
+      rate_limiter_wait (&scanner->rate_limiter, 1);
       send_arp_v4 (ipv4_str);
+      hosts_data_probe_sent (scanner->hosts_data, index);
+      g_atomic_int_inc (&scanner->hosts_data->metrics.probes[PROBE_ARP]);
+    }
+}
+
+/**
+ * @brief Send the probes of all chosen alive test methods to a shard of the
+ * target hosts in one pass.
+ *
+ * The target hosts are probed in random order. Every method probes the host
+ * which the previous method probed INTERLEAVE_DISTANCE hosts ago, so hosts
+ * which already replied to an earlier method are not probed again.
+ *
+ * @param scanner Pointer to scanner struct.
+ * @param alive_test Alive test methods to use. Methods which send no probes
+ * are ignored.
+ * @param shard Number of the shard. The shard consists of the target hosts
+ * whose index modulo shards is shard.
+ * @param shards Number of shards.
+ */
+static void
+send_probes_shard (scanner_t *scanner, alive_test_t alive_test, guint32 shard,
+                   guint32 shards)
+{
+  alive_test_t methods[4];
+  unsigned int number_of_methods = 0;
+  guint32 count;
+  guint32 *order;
+  guint32 distance;
+
+  if (alive_test & ALIVE_TEST_ICMP)
+    methods[number_of_methods++] = ALIVE_TEST_ICMP;
+  if (alive_test & ALIVE_TEST_TCP_SYN_SERVICE)
+    methods[number_of_methods++] = ALIVE_TEST_TCP_SYN_SERVICE;
+  if (alive_test & ALIVE_TEST_TCP_ACK_SERVICE)
+    methods[number_of_methods++] = ALIVE_TEST_TCP_ACK_SERVICE;
+  if (alive_test & ALIVE_TEST_ARP)
+    methods[number_of_methods++] = ALIVE_TEST_ARP;
+  if (number_of_methods == 0 || shard >= scanner->hosts_data->count)
+    return;
+
+  /* Fisher-Yates shuffle of the target indices. */
+  count = (scanner->hosts_data->count - shard + shards - 1) / shards;
+  order = g_malloc (count * sizeof (*order));
+  for (guint32 i = 0; i < count; i++)
+    order[i] = shard + i * shards;
+  for (guint32 i = count - 1; i > 0; i--)
+    {
+      guint32 j = g_random_int_range (0, i + 1);
+      guint32 tmp = order[i];
+
+      order[i] = order[j];
+      order[j] = tmp;
+    }
+
+  distance = MIN (count, INTERLEAVE_DISTANCE);
+  for (guint32 pos = 0; pos < count + (number_of_methods - 1) * distance;
+       pos++)
+    {
+      for (unsigned int m = 0; m < number_of_methods; m++)
+        {
+          guint32 index;
+
+          if (pos < m * distance || pos - m * distance >= count)
+            continue;
+          index = order[pos - m * distance];
+          switch (methods[m])
+            {
+            case ALIVE_TEST_ICMP:
+              send_icmp (scanner, index);
+              break;
+            case ALIVE_TEST_TCP_SYN_SERVICE:
+              scanner->tcp_flag = TH_SYN;
+              send_tcp (scanner, index);
+              break;
+            case ALIVE_TEST_TCP_ACK_SERVICE:
+              scanner->tcp_flag = TH_ACK;
+              send_tcp (scanner, index);
+              break;
+            default:
+              send_arp (scanner, index);
+              break;
+            }
+        }
+    }
+  g_free (order);
+
+  flush_probe_batches (scanner);
+  if (alive_test & ALIVE_TEST_ICMP)
+    {
+      wait_until_so_sndbuf_empty (scanner->icmpv4soc, 10);
+      wait_until_so_sndbuf_empty (scanner->icmpv6soc, 10);
+    }
+  if (alive_test & (ALIVE_TEST_TCP_SYN_SERVICE | ALIVE_TEST_TCP_ACK_SERVICE))
+    {
+      wait_until_so_sndbuf_empty (scanner->tcpv4soc, 10);
+      wait_until_so_sndbuf_empty (scanner->tcpv6soc, 10);
+    }
+  if (alive_test & ALIVE_TEST_ARP)
+    {
+      wait_until_so_sndbuf_empty (scanner->arpv4soc, 10);
+      wait_until_so_sndbuf_empty (scanner->arpv6soc, 10);
+    }
+}
+
+/**
+ * @brief Sender thread of a shard of the target hosts.
+ */
+struct sender
+{
+  scanner_t scanner;       /* Scanner with own sockets and pacing. */
+  alive_test_t alive_test; /* Alive test methods to use. */
+  guint32 shard;           /* Shard of the target hosts to probe. */
+  guint32 shards;          /* Number of shards. */
+  pthread_t thread;        /* Thread id. */
+  gboolean started;        /* TRUE if the thread was started. */
+};
+
+/**
+ * @brief Send the probes of a shard of the target hosts. Is a thread function.
+ *
+ * Opens the sockets of the sender and closes them again once all probes were
+ * sent.
+ *
+ * @param sender_p Pointer to sender struct.
+ */
+static void *
+sender_thread (void *sender_p)
+{
+  struct sender *sender = sender_p;
+  scanner_t *scanner = &sender->scanner;
+  boreas_error_t error;
+
+  error = set_all_needed_sockets (scanner, sender->alive_test);
+  if (error)
+    {
+      int *sockets[] = {&scanner->tcpv4soc,  &scanner->tcpv6soc,
+                        &scanner->icmpv4soc, &scanner->icmpv6soc,
+                        &scanner->arpv4soc,  &scanner->arpv6soc,
+                        &scanner->udpv4soc,  &scanner->udpv6soc};
+
+      g_warning ("%s: %s. Shard %u of %u not probed.", __func__,
+                 str_boreas_error (error), sender->shard, sender->shards);
+      /* Only close the sockets opened before the error. */
+      for (size_t i = 0; i < G_N_ELEMENTS (sockets); i++)
+        if (*sockets[i] >= 0)
+          close (*sockets[i]);
+      return NULL;
+    }
+
+  send_probes_shard (scanner, sender->alive_test, sender->shard,
+                     sender->shards);
+  close_all_needed_sockets (scanner, sender->alive_test);
+  free_probe_batches (scanner);
+  return NULL;
+}
+
+/**
+ * @brief Send the probes of all chosen alive test methods to all target hosts.
+ *
+ * With more than one thread, the target hosts are split into one shard per
+ * thread. Every thread sends from its own sockets and gets an equal share of
+ * the rate limit of the scanner. The alive state of the hosts is shared, so
+ * hosts which replied to a probe of any thread are not probed again.
+ *
+ * @param scanner Pointer to scanner struct.
+ * @param alive_test Alive test methods to use. Methods which send no probes
+ * are ignored.
+ * @param threads Number of sender threads. 1 sends from the calling thread.
+ */
+void
+send_probes (scanner_t *scanner, alive_test_t alive_test, unsigned int threads)
+{
+  struct sender *senders;
+  unsigned int max_pps;
+
+  if (threads <= 1)
+    {
+      send_probes_shard (scanner, alive_test, 0, 1);
+      return;
+    }
+
+  max_pps = scanner->rate_limiter.max_pps;
+  senders = g_malloc0 (threads * sizeof (*senders));
+  for (unsigned int i = 0; i < threads; i++)
+    {
+      struct sender *sender = &senders[i];
+      scanner_t *copy = &sender->scanner;
+      int err;
+
+      *copy = *scanner;
+      /* The sockets are opened by the sender thread. */
+      copy->tcpv4soc = copy->tcpv6soc = -1;
+      copy->icmpv4soc = copy->icmpv6soc = -1;
+      copy->arpv4soc = copy->arpv6soc = -1;
+      copy->udpv4soc = copy->udpv6soc = -1;
+      memset (copy->probe_batches, 0, sizeof (copy->probe_batches));
+      rate_limiter_init (&copy->rate_limiter,
+                         max_pps ? MAX (max_pps / threads, 1) : 0);
+      copy->route_cache = route_cache_new ();
+      copy->arp_sweeper = arp_sweeper_new ();
+      sender->alive_test = alive_test;
+      sender->shard = i;
+      sender->shards = threads;
+
+      err = pthread_create (&sender->thread, NULL, sender_thread, sender);
+      if (err)
+        g_warning ("%s: pthread_create() failed: %s. Probing shard %u in the "
+                   "calling thread.",
+                   __func__, strerror (err), i);
+      else
+        sender->started = TRUE;
+    }
+
+  for (unsigned int i = 0; i < threads; i++)
+    {
+      struct sender *sender = &senders[i];
+
+      if (sender->started)
+        pthread_join (sender->thread, NULL);
+      else
+        send_probes_shard (scanner, alive_test, sender->shard, sender->shards);
+      route_cache_free (sender->scanner.route_cache);
+      arp_sweeper_free (sender->scanner.arp_sweeper);
     }
+  g_free (senders);
 }
@@ -20,12 +20,24 @@
 #ifndef BOREAS_PING_H
 #define BOREAS_PING_H
 
+#include "alivedetection.h"
+
 #include <glib.h>
 
-void send_icmp (gpointer, gpointer, gpointer);
+void send_icmp (scanner_t *, guint32);
+
+void send_icmp_retries (scanner_t *, unsigned int, gint64);
+
+void send_tcp (scanner_t *, guint32);
+
+void send_arp (scanner_t *, guint32);
+
+void send_port_probes (scanner_t *, guint32);
+
+void send_probes (scanner_t *, alive_test_t, unsigned int);
 
-void send_tcp (gpointer, gpointer, gpointer);
+void flush_probe_batches (scanner_t *);
 
-void send_arp (gpointer, gpointer, gpointer);
+void free_probe_batches (scanner_t *);
 
 #endif /* not BOREAS_PING_H */
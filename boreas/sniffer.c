@@ -21,12 +21,15 @@
 
 #include "alivedetection.h"
 #include "boreas_io.h"
+#include "util.h"
 
 #include <arpa/inet.h>
 #include <errno.h>
 #include <glib.h>
 #include <net/if_arp.h>
 #include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/tcp.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -44,6 +47,14 @@
   "(ip6 or ip or arp) and (ip6[40]=129 or icmp[icmptype] == icmp-echoreply " \
   "or dst port " ASSTR (FILTER_PORT) " or arp[6:2]=2)"
 
+/* Bytes captured per packet. Enough for the link layer (cooked) header and the
+ * IPv6, IPv4 or ARP header. */
+#define SNIFFER_SNAPLEN 128
+/* Packet buffer timeout in ms. Upper bound for the delay of a reply. */
+#define SNIFFER_TIMEOUT 10
+/* Size of the capture buffer (ring) in bytes. */
+#define SNIFFER_BUFFER_SIZE (32 * 1024 * 1024)
+
 /* Conditional variable and mutex to make sure sniffer thread already started
  * before sending out pings. */
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -52,6 +63,12 @@ pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
 /**
  * @brief open a new pcap handle ad set provided filter.
  *
+ * The handle is set up to survive reply bursts from large networks: on Linux
+ * libpcap captures through a memory mapped TPACKET_V3 ring, which is sized by
+ * the capture buffer. Packets are handed out block wise, without copying them
+ * out of the ring. Only the headers are needed to get the sender address, so
+ * the snapshot length is kept small to fit more packets into the ring.
+ *
  * @param iface interface to use.
  * @param filter pcap filter to use.
  *
@@ -61,7 +78,7 @@ static pcap_t *
 open_live (char *iface, char *filter)
 {
   /* iface considerations:
-   * pcap_open_live(iface, ...) sniffs on all interfaces(linux) if iface
+   * pcap_create(iface, ...) sniffs on all interfaces(linux) if iface
    * argument is NULL pcap_lookupnet(iface, ...) is used to set ipv4 network
    * number and mask associated with iface pcap_compile(..., mask) netmask
    * specifies the IPv4 netmask of the network on which packets are being
@@ -75,19 +92,35 @@ open_live (char *iface, char *filter)
   char errbuf[PCAP_ERRBUF_SIZE];
   pcap_t *pcap_handle;
   struct bpf_program filter_prog;
+  int ret;
 
-  /* iface, snapshot length of handle, promiscuous mode, packet buffer timeout
-   * (ms), errbuff */
   errbuf[0] = '\0';
-  pcap_handle = pcap_open_live (iface, 1500, 0, 100, errbuf);
+  pcap_handle = pcap_create (iface, errbuf);
   if (pcap_handle == NULL)
     {
       g_warning ("%s: %s", __func__, errbuf);
       return NULL;
     }
-  if (g_utf8_strlen (errbuf, -1) != 0)
+  /* Snapshot length, no promiscuous mode, packet buffer timeout (ms) and size
+   * of the capture buffer. Setting these can only fail if the handle is
+   * already activated. */
+  pcap_set_snaplen (pcap_handle, SNIFFER_SNAPLEN);
+  pcap_set_promisc (pcap_handle, 0);
+  pcap_set_timeout (pcap_handle, SNIFFER_TIMEOUT);
+  pcap_set_buffer_size (pcap_handle, SNIFFER_BUFFER_SIZE);
+
+  ret = pcap_activate (pcap_handle);
+  if (ret < 0)
     {
-      g_warning ("%s: %s", __func__, errbuf);
+      g_warning ("%s: %s: %s", __func__, pcap_statustostr (ret),
+                 pcap_geterr (pcap_handle));
+      pcap_close (pcap_handle);
+      return NULL;
+    }
+  if (ret > 0)
+    {
+      g_warning ("%s: %s: %s", __func__, pcap_statustostr (ret),
+                 pcap_geterr (pcap_handle));
     }
 
   /* handle, struct bpf_program *fp, int optimize, bpf_u_int32 netmask */
@@ -112,12 +145,97 @@ open_live (char *iface, char *filter)
   return pcap_handle;
 }
 
+/**
+ * @brief Get the port state from a reply to a TCP-SYN probe.
+ *
+ * Open ports reply with SYN-ACK, closed ports with RST-ACK. Both acknowledge
+ * the cookie sent as sequence number of the probe. Other packets, like replies
+ * to TCP-ACK probes or packets not sent in reply to a probe, are rejected.
+ *
+ * @param cookie_key Key of the cookies of the scanner.
+ * @param addr Sender address of the reply.
+ * @param tcp TCP header of the reply.
+ * @param[out] port Port the reply was sent from, in host byte order.
+ *
+ * @return 1 if the port is open, 0 if it is closed, -1 if the packet is no
+ * reply to a TCP-SYN probe.
+ */
+static int
+tcp_reply_port_state (uint32_t cookie_key, const struct in6_addr *addr,
+                      const struct tcphdr *tcp, uint16_t *port)
+{
+  int state;
+
+  if (tcp->th_dport != htons (FILTER_PORT) || !(tcp->th_flags & TH_ACK))
+    return -1;
+  if (tcp->th_flags & TH_RST)
+    state = 0;
+  else if (tcp->th_flags & TH_SYN)
+    state = 1;
+  else
+    return -1;
+
+  *port = ntohs (tcp->th_sport);
+  if (ntohl (tcp->th_ack) != tcp_cookie (cookie_key, addr, *port) + 1)
+    return -1;
+  return state;
+}
+
+/**
+ * @brief Record the port state from a reply to a port discovery probe.
+ *
+ * @param scanner Pointer to scanner.
+ * @param header Header of the captured packet.
+ * @param packet Captured packet.
+ * @param addr Sender address of the packet.
+ * @param index Index of the sender in the hosts data of the scanner.
+ */
+static void
+record_port_state (scanner_t *scanner, const struct pcap_pkthdr *header,
+                   const u_char *packet, const struct in6_addr *addr,
+                   int index)
+{
+  const u_char *ip_p = packet + 16;
+  const struct tcphdr *tcp;
+  gchar addr_str[INET6_ADDRSTRLEN];
+  unsigned int offset;
+  uint16_t port;
+  int state;
+
+  if (((const struct ip *) ip_p)->ip_v == 6)
+    {
+      if (((const struct ip6_hdr *) ip_p)->ip6_nxt != IPPROTO_TCP)
+        return;
+      offset = 16 + sizeof (struct ip6_hdr);
+    }
+  else
+    {
+      if (((const struct ip *) ip_p)->ip_p != IPPROTO_TCP)
+        return;
+      offset = 16 + ((const struct ip *) ip_p)->ip_hl * 4;
+    }
+  if (header->caplen < offset + sizeof (struct tcphdr))
+    return;
+
+  tcp = (const struct tcphdr *) (packet + offset);
+  state = tcp_reply_port_state (scanner->cookie_key, addr, tcp, &port);
+  if (state < 0
+      || hosts_data_addr_str (scanner->hosts_data, index, addr_str) == NULL)
+    return;
+  /* Leave the kb to the publisher thread, the capture must not wait. */
+  if (scanner->alive_queue != NULL)
+    alive_queue_push_port (scanner->alive_queue, addr_str, port, state);
+  else
+    put_port_on_kb (scanner, addr_str, port, state);
+}
+
 /**
  * @brief Processes single packets captured by pcap. Is a callback function.
  *
  * For every packet we check if it is ipv4 ipv6 or arp and extract the sender ip
- * address. This ip address is then inserted into the alive_hosts table if not
- * already present and if in the target table.
+ * address. If the address belongs to a target host which was not detected as
+ * alive before, the host is marked as alive and put on the queue. In port
+ * discovery mode, replies to TCP-SYN probes also record the port state.
  *
  * @param user_data Pointer to scanner.
  * @param header
@@ -126,78 +244,123 @@ open_live (char *iface, char *filter)
  * TODO: simplify and read https://tools.ietf.org/html/rfc826
  */
 static void
-got_packet (u_char *user_data,
-            __attribute__ ((unused)) const struct pcap_pkthdr *header,
+got_packet (u_char *user_data, const struct pcap_pkthdr *header,
             const u_char *packet)
 {
   struct ip *ip;
   unsigned int version;
   scanner_t *scanner;
   hosts_data_t *hosts_data;
-  gchar *addr_str = NULL;
+  struct in6_addr sniffed_addr;
+  int index;
 
   ip = (struct ip *) (packet + 16);
   version = ip->ip_v;
   scanner = (scanner_t *) user_data;
   hosts_data = (hosts_data_t *) scanner->hosts_data;
+  g_atomic_int_inc (&hosts_data->metrics.replies);
 
-  if (version == 4)
-    {
-      addr_str = g_malloc0 (INET_ADDRSTRLEN);
-      struct in_addr sniffed_addr;
-      /* was +26 (14 ETH + 12 IP) originally but was off by 2 somehow */
-      memcpy (&sniffed_addr.s_addr, packet + 26 + 2, 4);
-      if (inet_ntop (AF_INET, (const char *) &sniffed_addr, addr_str,
-                     INET_ADDRSTRLEN)
-          == NULL)
-        g_debug (
-          "%s: Failed to transform IPv4 address into string representation: %s",
-          __func__, strerror (errno));
-    }
-  else if (version == 6)
+  if (version == 6)
     {
-      addr_str = g_malloc0 (INET6_ADDRSTRLEN);
-      struct in6_addr sniffed_addr;
       /* (14 ETH + 8 IP + offset 2)  */
       memcpy (&sniffed_addr.s6_addr, packet + 24, 16);
-      if (inet_ntop (AF_INET6, (const char *) &sniffed_addr, addr_str,
-                     INET6_ADDRSTRLEN)
-          == NULL)
-        g_debug ("%s: Failed to transform IPv6 into string representation: %s",
-                 __func__, strerror (errno));
     }
-  /* TODO: check collision situations.
-   * everything not ipv4/6 is regarded as arp.
-   * It may be possible to get other types then arp replies in which case the
-   * ip from inet_ntop should be bogus. */
   else
     {
-      /* TODO: at the moment offset of 6 is set but arp header has variable
-       * sized field. */
-      /* read rfc https://tools.ietf.org/html/rfc826 for exact length or how
-      to get it */
-      struct arphdr *arp =
-        (struct arphdr *) (packet + 14 + 2 + 6 + sizeof (struct arphdr));
-      addr_str = g_malloc0 (INET_ADDRSTRLEN);
-      if (inet_ntop (AF_INET, (const char *) arp, addr_str, INET_ADDRSTRLEN)
-          == NULL)
-        g_debug ("%s: Failed to transform IP into string representation: %s",
-                 __func__, strerror (errno));
+      /* Store IPv4 addresses as IPv4 mapped IPv6 addresses. */
+      sniffed_addr.s6_addr32[0] = 0;
+      sniffed_addr.s6_addr32[1] = 0;
+      sniffed_addr.s6_addr32[2] = htonl (0xffff);
+      if (version == 4)
+        /* was +26 (14 ETH + 12 IP) originally but was off by 2 somehow */
+        memcpy (&sniffed_addr.s6_addr32[3], packet + 26 + 2, 4);
+      /* TODO: check collision situations.
+       * everything not ipv4/6 is regarded as arp.
+       * It may be possible to get other types then arp replies in which case
+       * the ip read here should be bogus. */
+      else
+        /* TODO: at the moment offset of 6 is set but arp header has variable
+         * sized field. */
+        /* read rfc https://tools.ietf.org/html/rfc826 for exact length or how
+        to get it */
+        memcpy (&sniffed_addr.s6_addr32[3],
+                packet + 14 + 2 + 6 + sizeof (struct arphdr), 4);
     }
-  /* Only put unique hosts on queue and in hash table. Use short circuit
-   * evaluation to not add hosts to the hash table which are not in our
-   * target list.*/
-  if ((g_hash_table_contains (hosts_data->targethosts, addr_str) == TRUE)
-      && (g_hash_table_add (hosts_data->alivehosts, g_strdup (addr_str))))
+
+  /* Only put unique hosts on queue. Hosts which are not in our target list
+   * are ignored. */
+  index = hosts_data_lookup (hosts_data, &sniffed_addr);
+  if (index >= 0)
+    g_atomic_int_inc (&hosts_data->metrics.replies_matched);
+  if (index >= 0 && scanner->port_discovery && (version == 4 || version == 6))
+    record_port_state (scanner, header, packet, &sniffed_addr, index);
+  if (index >= 0 && hosts_data_set_alive (hosts_data, index))
     {
+      gchar addr_str[INET6_ADDRSTRLEN];
+
+      if (hosts_data_addr_str (hosts_data, index, addr_str) == NULL)
+        {
+          g_debug ("%s: Failed to transform IP into string representation: %s",
+                   __func__, strerror (errno));
+          return;
+        }
       /* handle max_scan_hosts related restrictions. */
       handle_scan_restrictions (scanner, addr_str);
     }
-  g_free (addr_str);
 }
 
 /**
- * @brief Sniff packets by starting pcap_loop with callback function.
+ * @brief Publish the alive detection metrics.
+ *
+ * Updates the pcap statistics of the metrics first. The metrics are logged
+ * and put on the kb if one is used, by the publisher thread of the alive
+ * queue if there is one.
+ *
+ * @param scanner Pointer to scanner struct.
+ * @param since Monotonic time (us) the send rate is calculated from.
+ * @param probes_since Number of probes sent at that time.
+ *
+ * @return Number of probes sent until now.
+ */
+static gint
+publish_metrics (scanner_t *scanner, gint64 since, gint probes_since)
+{
+  struct alive_metrics *metrics = &scanner->hosts_data->metrics;
+  struct pcap_stat stats;
+  gint64 now = g_get_monotonic_time ();
+  gint probes = 0;
+  double rate = 0;
+  gchar *str;
+
+  if (pcap_stats (scanner->pcap_handle, &stats) == 0)
+    {
+      metrics->pcap_recv = stats.ps_recv;
+      metrics->pcap_drop = stats.ps_drop;
+      metrics->pcap_ifdrop = stats.ps_ifdrop;
+    }
+  for (int type = 0; type < PROBE_TYPE_MAX; type++)
+    probes += g_atomic_int_get (&metrics->probes[type]);
+  if (now > since)
+    rate = (double) (probes - probes_since) * G_USEC_PER_SEC / (now - since);
+
+  str = hosts_data_metrics_str (scanner->hosts_data, rate);
+  g_debug ("%s: %s", __func__, str);
+  /* Leave the kb to the publisher thread, the capture must not wait. */
+  if (scanner->alive_queue != NULL)
+    alive_queue_set_metrics (scanner->alive_queue, str);
+  else if (scanner->main_kb)
+    put_metrics_on_kb (scanner->main_kb, str);
+  g_free (str);
+
+  return probes;
+}
+
+/**
+ * @brief Sniff packets by calling pcap_dispatch() with callback function.
+ *
+ * Every call to pcap_dispatch() processes all packets which are currently
+ * buffered, i.e. whole blocks of the capture ring at once. Between the calls
+ * the metrics are published every METRICS_INTERVAL seconds.
  *
  * @param scanner_p Pointer to scanner struct.
  */
@@ -206,19 +369,32 @@ sniffer_thread (void *scanner_p)
 {
   int ret;
   scanner_t *scanner = (scanner_t *) scanner_p;
+  gint64 last_publish = g_get_monotonic_time ();
+  gint last_probes = 0;
 
   pthread_mutex_lock (&mutex);
   pthread_cond_signal (&cond);
   pthread_mutex_unlock (&mutex);
 
   /* reads packets until error or pcap_breakloop() */
-  if ((ret =
-         pcap_loop (scanner->pcap_handle, -1, got_packet, (u_char *) scanner))
-      == PCAP_ERROR)
-    g_debug ("%s: pcap_loop error %s", __func__,
+  do
+    {
+      gint64 now;
+
+      ret = pcap_dispatch (scanner->pcap_handle, -1, got_packet,
+                           (u_char *) scanner);
+      now = g_get_monotonic_time ();
+      if (now - last_publish >= METRICS_INTERVAL * G_USEC_PER_SEC)
+        {
+          last_probes = publish_metrics (scanner, last_publish, last_probes);
+          last_publish = now;
+        }
+    }
+  while (ret >= 0);
+
+  if (ret == PCAP_ERROR)
+    g_debug ("%s: pcap_dispatch error %s", __func__,
              pcap_geterr (scanner->pcap_handle));
-  else if (ret == 0)
-    g_debug ("%s: count of packets is exhausted", __func__);
   else if (ret == PCAP_ERROR_BREAK)
     g_debug ("%s: Loop was successfully broken after call to pcap_breakloop",
              __func__);
@@ -278,6 +454,8 @@ stop_sniffer_thread (scanner_t *scanner, pthread_t sniffer_thread_id)
   /* close handle */
   if (scanner->pcap_handle != NULL)
     {
+      /* Final metrics, with the average send rate of the whole scan. */
+      publish_metrics (scanner, scanner->hosts_data->metrics.start, 0);
       pcap_close (scanner->pcap_handle);
     }
 
@@ -35,6 +35,41 @@ Ensure (sniffer, dummy_test)
   assert_that (0, is_equal_to (0));
 }
 
+Ensure (sniffer, tcp_reply_port_state)
+{
+  struct in6_addr addr;
+  struct tcphdr tcp;
+  uint16_t port = 0;
+
+  inet_pton (AF_INET6, "::ffff:192.168.0.1", &addr);
+  memset (&tcp, 0, sizeof (tcp));
+  tcp.th_sport = htons (443);
+  tcp.th_dport = htons (FILTER_PORT);
+  tcp.th_ack = htonl (tcp_cookie (42, &addr, 443) + 1);
+
+  /* SYN-ACK from an open port. */
+  tcp.th_flags = TH_SYN | TH_ACK;
+  assert_that (tcp_reply_port_state (42, &addr, &tcp, &port), is_equal_to (1));
+  assert_that (port, is_equal_to (443));
+
+  /* RST-ACK from a closed port. */
+  tcp.th_flags = TH_RST | TH_ACK;
+  assert_that (tcp_reply_port_state (42, &addr, &tcp, &port), is_equal_to (0));
+
+  /* RST in reply to a TCP-ACK probe. */
+  tcp.th_flags = TH_RST;
+  assert_that (tcp_reply_port_state (42, &addr, &tcp, &port),
+               is_equal_to (-1));
+
+  /* Cookie of another scan or port. */
+  tcp.th_flags = TH_SYN | TH_ACK;
+  assert_that (tcp_reply_port_state (43, &addr, &tcp, &port),
+               is_equal_to (-1));
+  tcp.th_sport = htons (80);
+  assert_that (tcp_reply_port_state (42, &addr, &tcp, &port),
+               is_equal_to (-1));
+}
+
 int
 main (int argc, char **argv)
 {
@@ -43,6 +78,7 @@ main (int argc, char **argv)
   suite = create_test_suite ();
 
   add_test_with_context (suite, sniffer, dummy_test);
+  add_test_with_context (suite, sniffer, tcp_reply_port_state);
 
   if (argc > 1)
     return run_single_test (suite, argv[1], create_text_reporter ());
@@ -21,17 +21,21 @@
 
 #include "../base/networking.h" /* for range_t */
 
+#include <arpa/inet.h> /* for inet_ntop() */
 #include <errno.h>
 #include <glib.h>
 #include <ifaddrs.h> /* for getifaddrs() */
 #include <linux/sockios.h>
 #include <net/ethernet.h>
 #include <net/if.h>           /* for if_nametoindex() */
+#include <net/route.h>        /* for RTF_UP, RTF_REJECT */
 #include <netpacket/packet.h> /* for sockaddr_ll */
+#include <stdio.h> /* for fopen(), fgets(), sscanf() */
 #include <stdlib.h>
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <time.h> /* for clock_nanosleep() */
 #include <unistd.h>
 
 #undef G_LOG_DOMAIN
@@ -46,40 +50,93 @@ set_socket (socket_type_t, int *);
 /**
  * @brief Checksum calculation.
  *
- * From W.Richard Stevens "UNIX NETWORK PROGRAMMING" book. libfree/in_cksum.c
- * TODO: Section 8.7 of TCPv2 has more efficient implementation
+ * Adds 32 bit words to a 64 bit accumulator, which can not overflow for any
+ * packet size, and folds it to 16 bits at the end. The ones complement sum
+ * does not depend on the size or byte order of the words it is built from
+ * (RFC 1071), so the result is the same as summing up 16 bit words.
+ *
+ * @param addr  Buffer to checksum. Need not be aligned.
+ * @param len   Length of the buffer in bytes.
+ *
+ * @return Internet checksum of the buffer.
  **/
 uint16_t
 in_cksum (uint16_t *addr, int len)
 {
-  int nleft = len;
-  uint32_t sum = 0;
-  uint16_t *w = addr;
-  uint16_t answer = 0;
+  const unsigned char *buf = (const unsigned char *) addr;
+  uint64_t sum = 0;
+
+  for (; len >= 16; buf += 16, len -= 16)
+    {
+      uint32_t words[4];
 
-  /*
-   * Our algorithm is simple, using a 32 bit accumulator (sum), we add
-   * sequential 16 bit words to it, and at the end, fold back all the
-   * carry bits from the top 16 bits into the lower 16 bits.
-   */
-  while (nleft > 1)
+      memcpy (words, buf, sizeof (words));
+      sum += (uint64_t) words[0] + words[1] + words[2] + words[3];
+    }
+  for (; len >= 4; buf += 4, len -= 4)
     {
-      sum += *w++;
-      nleft -= 2;
+      uint32_t word;
+
+      memcpy (&word, buf, sizeof (word));
+      sum += word;
     }
+  if (len >= 2)
+    {
+      uint16_t word;
 
+      memcpy (&word, buf, sizeof (word));
+      sum += word;
+      buf += 2;
+      len -= 2;
+    }
   /* mop up an odd byte, if necessary */
-  if (nleft == 1)
+  if (len == 1)
     {
-      *(unsigned char *) (&answer) = *(unsigned char *) w;
-      sum += answer;
+      uint16_t word = 0;
+
+      *(unsigned char *) &word = *buf;
+      sum += word;
     }
 
-  /* add back carry outs from top 16 bits to low 16 bits */
-  sum = (sum >> 16) + (sum & 0xffff); /* add hi 16 to low 16 */
-  sum += (sum >> 16);                 /* add carry */
-  answer = ~sum;                      /* truncate to 16 bits */
-  return (answer);
+  /* add back carry outs, from 64 to 32 and from 32 to 16 bits */
+  sum = (sum >> 32) + (sum & 0xffffffff);
+  sum = (sum >> 32) + (sum & 0xffffffff);
+  sum = (sum >> 16) + (sum & 0xffff);
+  sum = (sum >> 16) + (sum & 0xffff);
+  return (uint16_t) ~sum;
+}
+
+/**
+ * @brief Update a checksum after a field of the checksummed data changed.
+ *
+ * Uses equation 3 of RFC 1624: HC' = ~(~HC + ~m + m').
+ *
+ * @param sum   Checksum before the change.
+ * @param old   Old value of the field.
+ * @param new   New value of the field.
+ * @param len   Length of the field in bytes. Must be even and the field must
+ *              start at an even offset of the checksummed data.
+ *
+ * @return Updated checksum.
+ */
+uint16_t
+in_cksum_update (uint16_t sum, const void *old, const void *new, int len)
+{
+  const unsigned char *old_buf = old, *new_buf = new;
+  uint32_t acc = (uint16_t) ~sum;
+
+  for (int i = 0; i < len; i += 2)
+    {
+      uint16_t old_word, new_word;
+
+      memcpy (&old_word, old_buf + i, sizeof (old_word));
+      memcpy (&new_word, new_buf + i, sizeof (new_word));
+      acc += (uint16_t) ~old_word;
+      acc += new_word;
+    }
+  acc = (acc >> 16) + (acc & 0xffff);
+  acc = (acc >> 16) + (acc & 0xffff);
+  return (uint16_t) ~acc;
 }
 
 /**
@@ -277,6 +334,384 @@ get_source_addr_v4 (int *udpv4soc, struct in_addr *dst, struct in_addr *src)
   return error;
 }
 
+/**
+ * @brief Route of the kernel routing table with its cached source address.
+ */
+struct route
+{
+  struct in6_addr dest; /* Destination prefix, IPv4 as IPv4 mapped IPv6. */
+  guint prefix_len;     /* Length of the destination prefix in bits. */
+  gboolean has_src;     /* Whether the source address was already looked up. */
+  struct in6_addr src;  /* Source address, IPv4 as IPv4 mapped IPv6. */
+};
+
+/**
+ * @brief Source addresses per route, sorted by prefix length (longest first).
+ *
+ * IPv4 and IPv6 routes are kept apart, so that a destination never gets the
+ * source address of a route of the other address family.
+ */
+struct route_cache
+{
+  GArray *routes_v4; /* Array of struct route, IPv4 routes. */
+  GArray *routes_v6; /* Array of struct route, IPv6 routes. */
+  GArray *local;     /* Array of struct in6_addr, addresses of this host. */
+};
+
+/**
+ * @brief Check if an address is within a prefix.
+ *
+ * @param addr        Address.
+ * @param prefix      Prefix.
+ * @param prefix_len  Length of the prefix in bits.
+ *
+ * @return TRUE if the first prefix_len bits are equal, else FALSE.
+ */
+static gboolean
+addr6_in_prefix (const struct in6_addr *addr, const struct in6_addr *prefix,
+                 guint prefix_len)
+{
+  guint bytes = prefix_len / 8, bits = prefix_len % 8;
+
+  if (memcmp (addr->s6_addr, prefix->s6_addr, bytes))
+    return FALSE;
+  if (bits == 0)
+    return TRUE;
+  return ((addr->s6_addr[bytes] ^ prefix->s6_addr[bytes])
+          & (0xff << (8 - bits)))
+         == 0;
+}
+
+/**
+ * @brief Add a route to the routes of a route cache. The routes are not sorted
+ * afterwards.
+ *
+ * @param routes      Routes of one address family of a route cache.
+ * @param dest        Destination prefix.
+ * @param prefix_len  Length of the destination prefix in bits.
+ */
+static void
+route_cache_add (GArray *routes, const struct in6_addr *dest,
+                 guint prefix_len)
+{
+  struct route route;
+
+  memset (&route, 0, sizeof (route));
+  route.dest = *dest;
+  route.prefix_len = prefix_len;
+  g_array_append_val (routes, route);
+}
+
+/**
+ * @brief Compare routes by prefix length, longest first.
+ *
+ * @param a First route.
+ * @param b Second route.
+ *
+ * @return Negative if a has a longer prefix than b, positive if shorter.
+ */
+static gint
+route_cmp (gconstpointer a, gconstpointer b)
+{
+  return (gint) ((const struct route *) b)->prefix_len
+         - (gint) ((const struct route *) a)->prefix_len;
+}
+
+/**
+ * @brief Add the routes of /proc/net/route to a route cache.
+ *
+ * @param cache Route cache.
+ */
+static void
+route_cache_read_v4 (route_cache_t *cache)
+{
+  FILE *file;
+  char line[256];
+
+  file = fopen ("/proc/net/route", "r");
+  if (file == NULL)
+    {
+      g_debug ("%s: Could not open /proc/net/route: %s", __func__,
+               strerror (errno));
+      return;
+    }
+  /* Iface Destination Gateway Flags RefCnt Use Metric Mask ... */
+  while (fgets (line, sizeof (line), file))
+    {
+      struct in6_addr dest;
+      unsigned int dest4, flags, mask;
+
+      if (sscanf (line, "%*s %x %*x %x %*d %*d %*d %x", &dest4, &flags, &mask)
+          != 3)
+        continue;
+      if (!(flags & RTF_UP) || (flags & RTF_REJECT))
+        continue;
+      /* Addresses are in network byte order. */
+      memset (&dest, 0, sizeof (dest));
+      dest.s6_addr32[2] = htonl (0xffff);
+      dest.s6_addr32[3] = dest4;
+      route_cache_add (cache->routes_v4, &dest,
+                       96 + __builtin_popcount (mask));
+    }
+  fclose (file);
+}
+
+/**
+ * @brief Add the routes of /proc/net/ipv6_route to a route cache.
+ *
+ * @param cache Route cache.
+ */
+static void
+route_cache_read_v6 (route_cache_t *cache)
+{
+  FILE *file;
+  char line[256];
+
+  file = fopen ("/proc/net/ipv6_route", "r");
+  if (file == NULL)
+    {
+      g_debug ("%s: Could not open /proc/net/ipv6_route: %s", __func__,
+               strerror (errno));
+      return;
+    }
+  /* Dest DestPrefixLen Src SrcPrefixLen NextHop Metric RefCnt Use Flags ... */
+  while (fgets (line, sizeof (line), file))
+    {
+      struct in6_addr dest;
+      char dest_hex[33];
+      unsigned int prefix_len, flags;
+
+      if (sscanf (line, "%32s %x %*s %*x %*s %*x %*x %*x %x", dest_hex,
+                  &prefix_len, &flags)
+          != 3)
+        continue;
+      if (strlen (dest_hex) != 32 || prefix_len > 128 || !(flags & RTF_UP)
+          || (flags & RTF_REJECT))
+        continue;
+      for (int i = 0; i < 16; i++)
+        dest.s6_addr[i] = (g_ascii_xdigit_value (dest_hex[2 * i]) << 4)
+                          | g_ascii_xdigit_value (dest_hex[2 * i + 1]);
+      route_cache_add (cache->routes_v6, &dest, prefix_len);
+    }
+  fclose (file);
+}
+
+/**
+ * @brief Add the addresses of the local interfaces to a route cache.
+ *
+ * @param cache Route cache.
+ */
+static void
+route_cache_read_local (route_cache_t *cache)
+{
+  struct ifaddrs *ifaddr, *ifa;
+
+  if (getifaddrs (&ifaddr) == -1)
+    {
+      g_debug ("%s: getifaddrs(): %s", __func__, strerror (errno));
+      return;
+    }
+  for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next)
+    {
+      struct in6_addr addr;
+
+      if (ifa->ifa_addr == NULL)
+        continue;
+      if (ifa->ifa_addr->sa_family == AF_INET)
+        {
+          memset (&addr, 0, sizeof (addr));
+          addr.s6_addr32[2] = htonl (0xffff);
+          addr.s6_addr32[3] =
+            ((struct sockaddr_in *) ifa->ifa_addr)->sin_addr.s_addr;
+        }
+      else if (ifa->ifa_addr->sa_family == AF_INET6)
+        addr = ((struct sockaddr_in6 *) ifa->ifa_addr)->sin6_addr;
+      else
+        continue;
+      g_array_append_val (cache->local, addr);
+    }
+  freeifaddrs (ifaddr);
+}
+
+/**
+ * @brief Create a route cache from the kernel routing tables.
+ *
+ * The source address the kernel chooses for a destination only depends on the
+ * route to the destination. The route cache therefore only needs to look up
+ * the source address once per route.
+ *
+ * @return Route cache, to be freed with route_cache_free().
+ */
+route_cache_t *
+route_cache_new (void)
+{
+  route_cache_t *cache;
+
+  cache = g_malloc0 (sizeof (route_cache_t));
+  cache->routes_v4 = g_array_new (FALSE, TRUE, sizeof (struct route));
+  cache->routes_v6 = g_array_new (FALSE, TRUE, sizeof (struct route));
+  cache->local = g_array_new (FALSE, TRUE, sizeof (struct in6_addr));
+  route_cache_read_v4 (cache);
+  route_cache_read_v6 (cache);
+  route_cache_read_local (cache);
+  g_array_sort (cache->routes_v4, route_cmp);
+  g_array_sort (cache->routes_v6, route_cmp);
+  g_debug ("%s: Read %u IPv4 and %u IPv6 routes.", __func__,
+           cache->routes_v4->len, cache->routes_v6->len);
+
+  return cache;
+}
+
+/**
+ * @brief Free a route cache.
+ *
+ * @param cache Route cache to free.
+ */
+void
+route_cache_free (route_cache_t *cache)
+{
+  if (cache == NULL)
+    return;
+  g_array_free (cache->routes_v4, TRUE);
+  g_array_free (cache->routes_v6, TRUE);
+  g_array_free (cache->local, TRUE);
+  g_free (cache);
+}
+
+/**
+ * @brief Find the route with the longest prefix matching a destination.
+ *
+ * Loopback and local addresses are routed by the local routing table, which
+ * is not in the cache, so no route is returned for them.
+ *
+ * @param cache   Route cache.
+ * @param routes  Routes of the address family of dst, of the route cache.
+ * @param dst     Destination address, IPv4 as IPv4 mapped IPv6.
+ *
+ * @return Route, NULL if the route to the destination is not in the cache.
+ */
+static struct route *
+route_cache_lookup (route_cache_t *cache, GArray *routes,
+                    const struct in6_addr *dst)
+{
+  if (IN6_IS_ADDR_LOOPBACK (dst)
+      || (IN6_IS_ADDR_V4MAPPED (dst) && dst->s6_addr[12] == 127))
+    return NULL;
+  for (guint i = 0; i < cache->local->len; i++)
+    if (IN6_ARE_ADDR_EQUAL (dst, &g_array_index (cache->local, struct in6_addr,
+                                                 i)))
+      return NULL;
+
+  for (guint i = 0; i < routes->len; i++)
+    {
+      struct route *route = &g_array_index (routes, struct route, i);
+
+      if (addr6_in_prefix (dst, &route->dest, route->prefix_len))
+        return route;
+    }
+  return NULL;
+}
+
+/**
+ * @brief Figure out source address for given destination using the route
+ * cache.
+ *
+ * Falls back to get_source_addr_v6() if no cached route matches the
+ * destination.
+ *
+ * @param[in]   cache     Route cache.
+ * @param[in]   udpv6soc  Location of the socket to use.
+ * @param[in]   dst       Destination address.
+ * @param[out]  src       Source address.
+ *
+ * @return 0 on success, boreas_error_t on failure.
+ */
+boreas_error_t
+route_cache_get_source_v6 (route_cache_t *cache, int *udpv6soc,
+                           struct in6_addr *dst, struct in6_addr *src)
+{
+  struct route *route;
+  boreas_error_t error;
+
+  route = route_cache_lookup (cache, cache->routes_v6, dst);
+  if (route == NULL)
+    return get_source_addr_v6 (udpv6soc, dst, src);
+  if (!route->has_src)
+    {
+      if ((error = get_source_addr_v6 (udpv6soc, dst, &route->src)) != 0)
+        return error;
+      route->has_src = TRUE;
+    }
+  *src = route->src;
+  return NO_ERROR;
+}
+
+/**
+ * @brief Figure out source address for given destination using the route
+ * cache.
+ *
+ * Falls back to get_source_addr_v4() if no cached route matches the
+ * destination.
+ *
+ * @param[in]   cache     Route cache.
+ * @param[in]   udpv4soc  Location of the socket to use.
+ * @param[in]   dst       Destination address.
+ * @param[out]  src       Source address.
+ *
+ * @return 0 on success, boreas_error_t on failure.
+ */
+boreas_error_t
+route_cache_get_source_v4 (route_cache_t *cache, int *udpv4soc,
+                           struct in_addr *dst, struct in_addr *src)
+{
+  struct route *route;
+  struct in6_addr dst6;
+  boreas_error_t error;
+
+  memset (&dst6, 0, sizeof (dst6));
+  dst6.s6_addr32[2] = htonl (0xffff);
+  dst6.s6_addr32[3] = dst->s_addr;
+  route = route_cache_lookup (cache, cache->routes_v4, &dst6);
+  if (route == NULL)
+    return get_source_addr_v4 (udpv4soc, dst, src);
+  if (!route->has_src)
+    {
+      struct in_addr src4;
+
+      if ((error = get_source_addr_v4 (udpv4soc, dst, &src4)) != 0)
+        return error;
+      route->src.s6_addr32[3] = src4.s_addr;
+      route->has_src = TRUE;
+    }
+  src->s_addr = route->src.s6_addr32[3];
+  return NO_ERROR;
+}
+
+/**
+ * @brief Get the sequence number (cookie) of a TCP probe.
+ *
+ * The cookie is a keyed hash of the destination of the probe. Replies to the
+ * probe acknowledge the cookie, which identifies the probe they belong to
+ * without keeping any state about the probes sent.
+ *
+ * @param key   Secret key, chosen randomly per scan.
+ * @param addr  Destination address. IPv4 addresses as IPv4 mapped addresses.
+ * @param port  Destination port in host byte order.
+ *
+ * @return The cookie in host byte order.
+ */
+uint32_t
+tcp_cookie (uint32_t key, const struct in6_addr *addr, uint16_t port)
+{
+  guint64 hash = key;
+
+  for (int i = 0; i < 4; i++)
+    hash = (hash ^ addr->s6_addr32[i]) * 0x9e3779b97f4a7c15ULL;
+  hash = (hash ^ port) * 0x9e3779b97f4a7c15ULL;
+  hash ^= hash >> 29;
+  return hash >> 32;
+}
+
 /**
  * @brief Put all ports of a given port range into the ports array.
  *
@@ -318,6 +753,19 @@ fill_ports_array (gpointer range, gpointer ports_array)
     }
 }
 
+/**
+ * @brief Put all ports of a given TCP port range into the ports array.
+ *
+ * @param range Pointer to a range_t.
+ * @param ports_array Pointer to an GArray.
+ */
+void
+fill_tcp_ports_array (gpointer range, gpointer ports_array)
+{
+  if (((range_t *) range)->type == PORT_PROTOCOL_TCP)
+    fill_ports_array (range, ports_array);
+}
+
 boreas_error_t
 close_all_needed_sockets (scanner_t *scanner, alive_test_t alive_test)
 {
@@ -340,7 +788,7 @@ close_all_needed_sockets (scanner_t *scanner, alive_test_t alive_test)
     }
 
   if ((alive_test & ALIVE_TEST_TCP_ACK_SERVICE)
-      || (alive_test & ALIVE_TEST_TCP_SYN_SERVICE))
+      || (alive_test & ALIVE_TEST_TCP_SYN_SERVICE) || scanner->port_discovery)
     {
       if ((close (scanner->tcpv4soc)) != 0)
         {
@@ -563,7 +1011,7 @@ set_all_needed_sockets (scanner_t *scanner, alive_test_t alive_test)
     }
 
   if ((alive_test & ALIVE_TEST_TCP_ACK_SERVICE)
-      || (alive_test & ALIVE_TEST_TCP_SYN_SERVICE))
+      || (alive_test & ALIVE_TEST_TCP_SYN_SERVICE) || scanner->port_discovery)
     {
       if ((error = set_socket (TCPV4, &(scanner->tcpv4soc))) != 0)
         return error;
@@ -587,33 +1035,434 @@ set_all_needed_sockets (scanner_t *scanner, alive_test_t alive_test)
 }
 
 /**
- * @brief Subtract two hashtables and count the remaining elements.
+ * @brief Hash an IPv6 address for the lookup table of hosts_data_t.
  *
- * The original hashtables are not changed during or after the count operation.
+ * @param addr  Address to hash.
  *
- * @param A Base Hashtable.
- * @param B Hashtable to be subtracted from A.
+ * @return Hash value.
+ */
+static guint32
+addr6_hash (const struct in6_addr *addr)
+{
+  guint64 hash;
+
+  hash = ((guint64) addr->s6_addr32[0] << 32 | addr->s6_addr32[1])
+         * 0x9e3779b97f4a7c15ULL;
+  hash ^= (guint64) addr->s6_addr32[2] << 32 | addr->s6_addr32[3];
+  hash *= 0x9e3779b97f4a7c15ULL;
+  return hash >> 32;
+}
+
+/**
+ * @brief Find the lookup table slot of an address.
+ *
+ * @param hosts_data  Hosts data.
+ * @param addr        Address to look up.
  *
- * @return count of remaining elements in A-B.
+ * @return Index of the slot holding the address or of the empty slot where it
+ * would be inserted.
  */
-int
-count_difference (GHashTable *hashtable_A, GHashTable *hashtable_B)
+static guint32
+hosts_data_slot (hosts_data_t *hosts_data, const struct in6_addr *addr)
+{
+  guint32 slot = addr6_hash (addr) & hosts_data->mask;
+
+  /* Linear probing. The table is at most half full. */
+  while (hosts_data->slots[slot] != 0
+         && !IN6_ARE_ADDR_EQUAL (
+           &hosts_data->addrs[hosts_data->slots[slot] - 1], addr))
+    slot = (slot + 1) & hosts_data->mask;
+  return slot;
+}
+
+/**
+ * @brief Create the hosts data for a list of target hosts.
+ *
+ * Hosts with the same address are only added once.
+ *
+ * @param hosts Target hosts. Must outlive the returned hosts data.
+ *
+ * @return Hosts data, to be freed with hosts_data_free().
+ */
+hosts_data_t *
+hosts_data_new (gvm_hosts_t *hosts)
 {
-  int count = 0;
+  hosts_data_t *hosts_data;
+  gvm_host_t *host;
+  guint32 max = gvm_hosts_count (hosts), slots = 2;
+
+  while (slots < 2 * max)
+    slots <<= 1;
 
-  GHashTableIter target_hosts_iter;
-  gpointer key, value;
+  hosts_data = g_malloc0 (sizeof (hosts_data_t));
+  hosts_data->hosts = g_malloc0_n (max + 1, sizeof (gvm_host_t *));
+  hosts_data->addrs = g_malloc0_n (max + 1, sizeof (struct in6_addr));
+  hosts_data->slots = g_malloc0_n (slots, sizeof (guint32));
+  hosts_data->mask = slots - 1;
+  hosts_data->alive = g_malloc0_n (max / 32 + 1, sizeof (guint));
+  hosts_data->sent = g_malloc0_n (max + 1, sizeof (gint64));
+  g_mutex_init (&hosts_data->lock);
+  g_cond_init (&hosts_data->alive_cond);
+  hosts_data->metrics.start = g_get_monotonic_time ();
 
-  for (g_hash_table_iter_init (&target_hosts_iter, hashtable_A);
-       g_hash_table_iter_next (&target_hosts_iter, &key, &value);)
+  for (host = gvm_hosts_next (hosts); host && hosts_data->count < max;
+       host = gvm_hosts_next (hosts))
     {
-      if (!g_hash_table_contains (hashtable_B, key))
+      struct in6_addr *addr = &hosts_data->addrs[hosts_data->count];
+
+      if (gvm_host_get_addr6 (host, addr) < 0)
         {
-          count++;
+          g_warning ("%s: could not get addr6 from gvm_host_t", __func__);
+          memset (addr, 0, sizeof (*addr));
+        }
+      else
+        {
+          guint32 slot = hosts_data_slot (hosts_data, addr);
+
+          if (hosts_data->slots[slot] != 0)
+            continue;
+          hosts_data->slots[slot] = hosts_data->count + 1;
         }
+      hosts_data->hosts[hosts_data->count++] = host;
+    }
+
+  return hosts_data;
+}
+
+/**
+ * @brief Free hosts data. The target hosts themselves are not freed.
+ *
+ * @param hosts_data Hosts data to free.
+ */
+void
+hosts_data_free (hosts_data_t *hosts_data)
+{
+  if (hosts_data == NULL)
+    return;
+  g_free (hosts_data->hosts);
+  g_free (hosts_data->addrs);
+  g_free (hosts_data->slots);
+  g_free (hosts_data->alive);
+  g_free (hosts_data->sent);
+  g_mutex_clear (&hosts_data->lock);
+  g_cond_clear (&hosts_data->alive_cond);
+  g_free (hosts_data);
+}
+
+/**
+ * @brief Look up a target host by its address.
+ *
+ * @param hosts_data  Hosts data.
+ * @param addr        Address, IPv4 addresses as IPv4 mapped IPv6 addresses.
+ *
+ * @return Index of the target host, -1 if the address is not a target.
+ */
+int
+hosts_data_lookup (hosts_data_t *hosts_data, const struct in6_addr *addr)
+{
+  guint32 index = hosts_data->slots[hosts_data_slot (hosts_data, addr)];
+
+  return (int) index - 1;
+}
+
+/* Send time of a target host whose first probe is queued but not sent. */
+#define SENT_QUEUED -1
+/* Send time of a target host which was probed more than once. */
+#define SENT_AGAIN -2
+
+/**
+ * @brief Remember that the probes of an alive test method are queued for a
+ * target host.
+ *
+ * Only the probes of the first method are used for round trip time samples.
+ * A reply after probes of several methods can not be matched to one of them,
+ * so the host gives no sample at all then (Karn's algorithm).
+ *
+ * @param hosts_data  Hosts data.
+ * @param index       Index of the target host.
+ *
+ * @return TRUE if these are the first probes for the host and their send time
+ * is to be recorded with hosts_data_probe_sent(), else FALSE.
+ */
+gboolean
+hosts_data_probe_queued (hosts_data_t *hosts_data, guint32 index)
+{
+  if (hosts_data->sent[index] == 0)
+    {
+      hosts_data->sent[index] = SENT_QUEUED;
+      return TRUE;
     }
+  hosts_data_probe_resent (hosts_data, index);
+  return FALSE;
+}
 
-  return count;
+/**
+ * @brief Remember that the first probe queued for a target host is sent.
+ *
+ * Does nothing for hosts without queued first probe or whose send time is
+ * already recorded.
+ *
+ * @param hosts_data  Hosts data.
+ * @param index       Index of the target host.
+ */
+void
+hosts_data_probe_sent (hosts_data_t *hosts_data, guint32 index)
+{
+  if (hosts_data->sent[index] == SENT_QUEUED)
+    hosts_data->sent[index] = g_get_monotonic_time ();
+}
+
+/**
+ * @brief Remember that a probe is sent to a target host again.
+ *
+ * A reply can not be matched to one of the probes, so it is not used as round
+ * trip time sample (Karn's algorithm).
+ *
+ * @param hosts_data  Hosts data.
+ * @param index       Index of the target host.
+ */
+void
+hosts_data_probe_resent (hosts_data_t *hosts_data, guint32 index)
+{
+  hosts_data->sent[index] = SENT_AGAIN;
+}
+
+/**
+ * @brief Update the round trip time estimate with a new sample.
+ *
+ * Uses the smoothing of RFC 6298 section 2. Must be called with the lock of
+ * the hosts data held.
+ *
+ * @param hosts_data  Hosts data.
+ * @param rtt         Round trip time sample in us.
+ */
+static void
+hosts_data_add_rtt (hosts_data_t *hosts_data, gint64 rtt)
+{
+  int bucket = 0;
+
+  while (bucket < RTT_BUCKETS - 1 && rtt >= (1000 << bucket))
+    bucket++;
+  hosts_data->metrics.rtt_histogram[bucket]++;
+
+  if (hosts_data->rtt_samples++ == 0)
+    {
+      hosts_data->srtt = rtt;
+      hosts_data->rttvar = rtt / 2;
+      return;
+    }
+  hosts_data->rttvar =
+    (3 * hosts_data->rttvar + ABS (hosts_data->srtt - rtt)) / 4;
+  hosts_data->srtt = (7 * hosts_data->srtt + rtt) / 8;
+}
+
+/**
+ * @brief Mark a target host as alive. Safe to call from multiple threads.
+ *
+ * If the probes of only one alive test method were sent to the host, the time
+ * since then is used as round trip time sample. Threads waiting in
+ * hosts_data_wait_for_replies() are woken up.
+ *
+ * @param hosts_data  Hosts data.
+ * @param index       Index of the target host.
+ *
+ * @return TRUE if the host was not marked as alive before, else FALSE.
+ */
+gboolean
+hosts_data_set_alive (hosts_data_t *hosts_data, guint32 index)
+{
+  guint bit = 1U << (index % 32);
+  gint64 sent = hosts_data->sent[index];
+
+  if (g_atomic_int_or (&hosts_data->alive[index / 32], bit) & bit)
+    return FALSE;
+  g_atomic_int_inc (&hosts_data->alive_count);
+
+  g_mutex_lock (&hosts_data->lock);
+  if (sent > 0)
+    hosts_data_add_rtt (hosts_data, g_get_monotonic_time () - sent);
+  g_cond_broadcast (&hosts_data->alive_cond);
+  g_mutex_unlock (&hosts_data->lock);
+  return TRUE;
+}
+
+/**
+ * @brief Get the time to wait for a reply after a probe was sent.
+ *
+ * Must be called with the lock of the hosts data held.
+ *
+ * @param hosts_data  Hosts data.
+ * @param max_wait    Maximum time to wait in us.
+ *
+ * @return The retransmission timeout of RFC 6298, clamped to
+ * MIN_REPLY_TIMEOUT and max_wait, or max_wait if there are too few round trip
+ * time samples.
+ */
+static gint64
+hosts_data_reply_timeout (hosts_data_t *hosts_data, gint64 max_wait)
+{
+  gint64 rto;
+
+  if (hosts_data->rtt_samples < MIN_RTT_SAMPLES)
+    return max_wait;
+  rto = hosts_data->srtt + 4 * hosts_data->rttvar;
+  return CLAMP (rto, MIN_REPLY_TIMEOUT * 1000, max_wait);
+}
+
+/**
+ * @brief Wait for the replies to the probes sent so far.
+ *
+ * Returns as soon as all target hosts are alive. Otherwise, once enough round
+ * trip times were measured, returns when no more replies are to be expected,
+ * i.e. when the retransmission timeout of RFC 6298 (but at least
+ * MIN_REPLY_TIMEOUT) passed since the last probe was sent. Never waits longer
+ * than max_wait.
+ *
+ * @param hosts_data  Hosts data.
+ * @param last_sent   Monotonic time (us) the last probe was sent.
+ * @param max_wait    Maximum time to wait after the last probe in us.
+ */
+void
+hosts_data_wait_for_replies (hosts_data_t *hosts_data, gint64 last_sent,
+                             gint64 max_wait)
+{
+  g_mutex_lock (&hosts_data->lock);
+  while (hosts_data_alive_count (hosts_data) < hosts_data->count)
+    {
+      gint64 wait = hosts_data_reply_timeout (hosts_data, max_wait);
+
+      if (g_get_monotonic_time () >= last_sent + wait)
+        break;
+      /* Woken up on every new alive host, which may adapt the deadline. */
+      g_cond_wait_until (&hosts_data->alive_cond, &hosts_data->lock,
+                         last_sent + wait);
+    }
+  g_debug ("%s: Waited %" G_GINT64_FORMAT " ms, smoothed RTT %" G_GINT64_FORMAT
+           " ms.",
+           __func__, (g_get_monotonic_time () - last_sent) / 1000,
+           hosts_data->srtt / 1000);
+  g_mutex_unlock (&hosts_data->lock);
+}
+
+/**
+ * @brief Wait for the replies to probes sent to hosts which are alive.
+ *
+ * Unlike hosts_data_wait_for_replies(), does not return early if all target
+ * hosts are alive. Used for probes whose replies do not change the alive
+ * state, like port discovery probes.
+ *
+ * @param hosts_data  Hosts data.
+ * @param last_sent   Monotonic time (us) the last probe was sent.
+ * @param max_wait    Maximum time to wait after the last probe in us.
+ */
+void
+hosts_data_wait_reply_timeout (hosts_data_t *hosts_data, gint64 last_sent,
+                               gint64 max_wait)
+{
+  gint64 remaining;
+
+  g_mutex_lock (&hosts_data->lock);
+  remaining = last_sent + hosts_data_reply_timeout (hosts_data, max_wait)
+              - g_get_monotonic_time ();
+  g_mutex_unlock (&hosts_data->lock);
+  if (remaining > 0)
+    g_usleep (remaining);
+}
+
+/**
+ * @brief Format the alive detection metrics.
+ *
+ * Includes the probes sent per type, the captured and matched replies, the
+ * pcap statistics, the alive hosts, the send rate and the round trip times.
+ *
+ * @param hosts_data  Hosts data holding the metrics.
+ * @param rate        Send rate in packets per second.
+ *
+ * @return Metrics as space separated key=value pairs. Free with g_free().
+ */
+gchar *
+hosts_data_metrics_str (hosts_data_t *hosts_data, double rate)
+{
+  struct alive_metrics *metrics = &hosts_data->metrics;
+  GString *str;
+
+  str = g_string_new (NULL);
+  g_string_append_printf (
+    str,
+    "probes_icmp=%d probes_tcp_syn=%d probes_tcp_ack=%d probes_arp=%d "
+    "replies=%d replies_matched=%d pcap_recv=%u pcap_drop=%u pcap_ifdrop=%u "
+    "alive=%u/%u rate=%.0f",
+    g_atomic_int_get (&metrics->probes[PROBE_ICMP]),
+    g_atomic_int_get (&metrics->probes[PROBE_TCP_SYN]),
+    g_atomic_int_get (&metrics->probes[PROBE_TCP_ACK]),
+    g_atomic_int_get (&metrics->probes[PROBE_ARP]),
+    g_atomic_int_get (&metrics->replies),
+    g_atomic_int_get (&metrics->replies_matched), metrics->pcap_recv,
+    metrics->pcap_drop, metrics->pcap_ifdrop,
+    hosts_data_alive_count (hosts_data), hosts_data->count, rate);
+
+  g_mutex_lock (&hosts_data->lock);
+  g_string_append_printf (str, " srtt_ms=%" G_GINT64_FORMAT
+                               " rttvar_ms=%" G_GINT64_FORMAT " rtt_ms=",
+                          hosts_data->srtt / 1000, hosts_data->rttvar / 1000);
+  for (int i = 0; i < RTT_BUCKETS; i++)
+    g_string_append_printf (str, "%s%s%d:%u", i ? "," : "",
+                            i < RTT_BUCKETS - 1 ? "<" : ">=",
+                            1 << (i < RTT_BUCKETS - 1 ? i : i - 1),
+                            metrics->rtt_histogram[i]);
+  g_mutex_unlock (&hosts_data->lock);
+
+  return g_string_free (str, FALSE);
+}
+
+/**
+ * @brief Check if a target host was detected as alive.
+ *
+ * @param hosts_data  Hosts data.
+ * @param index       Index of the target host.
+ *
+ * @return TRUE if the host is alive, else FALSE.
+ */
+gboolean
+hosts_data_is_alive (hosts_data_t *hosts_data, guint32 index)
+{
+  return (g_atomic_int_get (&hosts_data->alive[index / 32])
+          & (1U << (index % 32)))
+         != 0;
+}
+
+/**
+ * @brief Get the number of target hosts which were detected as alive.
+ *
+ * @param hosts_data  Hosts data.
+ *
+ * @return Number of alive hosts.
+ */
+guint32
+hosts_data_alive_count (hosts_data_t *hosts_data)
+{
+  return g_atomic_int_get (&hosts_data->alive_count);
+}
+
+/**
+ * @brief Get the string representation of the address of a target host.
+ *
+ * IPv4 mapped addresses are written as IPv4 addresses.
+ *
+ * @param hosts_data  Hosts data.
+ * @param index       Index of the target host.
+ * @param[out] buf    Buffer of at least INET6_ADDRSTRLEN bytes.
+ *
+ * @return buf on success, NULL on error.
+ */
+const char *
+hosts_data_addr_str (hosts_data_t *hosts_data, guint32 index, char *buf)
+{
+  const struct in6_addr *addr = &hosts_data->addrs[index];
+
+  if (IN6_IS_ADDR_V4MAPPED (addr))
+    return inet_ntop (AF_INET, &addr->s6_addr32[3], buf, INET6_ADDRSTRLEN);
+  return inet_ntop (AF_INET6, addr, buf, INET6_ADDRSTRLEN);
 }
 
 /**
@@ -657,3 +1506,117 @@ wait_until_so_sndbuf_empty (int soc, int timeout)
       usleep (100000);
     }
 }
+
+/**
+ * @brief Initialise a rate limiter.
+ *
+ * @param[out] limiter  Rate limiter to initialise.
+ * @param[in]  max_pps  Maximum number of packets per second. 0 for no limit.
+ */
+void
+rate_limiter_init (rate_limiter_t *limiter, unsigned int max_pps)
+{
+  limiter->max_pps = max_pps;
+  limiter->pps = max_pps;
+  limiter->tokens = BURST;
+  limiter->last_refill = g_get_monotonic_time ();
+  limiter->last_adjust = limiter->last_refill;
+  limiter->sent = 0;
+}
+
+/**
+ * @brief Refill the token bucket for the time passed since the last refill.
+ *
+ * If no backoff happened during the last second the rate is raised by 10%
+ * until max_pps is reached again.
+ *
+ * @param limiter Rate limiter.
+ * @param now     Current monotonic time in microseconds.
+ */
+static void
+rate_limiter_refill (rate_limiter_t *limiter, gint64 now)
+{
+  if (limiter->pps < limiter->max_pps
+      && now - limiter->last_adjust > G_USEC_PER_SEC)
+    {
+      limiter->pps = MIN (limiter->max_pps, limiter->pps + limiter->pps / 10);
+      limiter->last_adjust = now;
+    }
+
+  if (now > limiter->last_refill)
+    {
+      limiter->tokens +=
+        (double) (now - limiter->last_refill) * limiter->pps / G_USEC_PER_SEC;
+      if (limiter->tokens > BURST)
+        limiter->tokens = BURST;
+      limiter->last_refill = now;
+    }
+}
+
+/**
+ * @brief Wait until the given number of packets may be sent.
+ *
+ * Sleeps until an absolute deadline on the monotonic clock so that pacing
+ * does not drift with the time spent on building and sending packets.
+ *
+ * @param limiter Rate limiter.
+ * @param packets Number of packets to be sent.
+ */
+void
+rate_limiter_wait (rate_limiter_t *limiter, unsigned int packets)
+{
+  gint64 now, deadline;
+  struct timespec ts;
+
+  if (limiter->max_pps == 0)
+    return;
+
+  now = g_get_monotonic_time ();
+  rate_limiter_refill (limiter, now);
+  if (limiter->tokens >= packets)
+    {
+      limiter->tokens -= packets;
+      return;
+    }
+
+  deadline = now
+             + (gint64) ((packets - limiter->tokens) * G_USEC_PER_SEC
+                         / limiter->pps);
+  ts.tv_sec = deadline / G_USEC_PER_SEC;
+  ts.tv_nsec = (deadline % G_USEC_PER_SEC) * 1000;
+  while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    ;
+
+  /* All tokens up to the deadline are used up by this send. */
+  limiter->tokens = 0;
+  limiter->last_refill = deadline;
+}
+
+/**
+ * @brief Halve the rate of a rate limiter.
+ *
+ * Called when packets were dropped or the send queue keeps growing. Backoffs
+ * happening in quick succession are only applied once. The rate is not lowered
+ * below MIN_PPS, unless max_pps is lower than that.
+ *
+ * @param limiter Rate limiter.
+ */
+void
+rate_limiter_backoff (rate_limiter_t *limiter)
+{
+  gint64 now;
+
+  if (limiter->max_pps == 0)
+    return;
+
+  now = g_get_monotonic_time ();
+  if (now - limiter->last_adjust < G_USEC_PER_SEC / 10
+      && limiter->pps < limiter->max_pps)
+    return;
+
+  limiter->pps = MIN (limiter->max_pps, MAX (MIN_PPS, limiter->pps / 2));
+  limiter->tokens = 0;
+  limiter->last_adjust = now;
+  g_debug ("%s: Lowered send rate to %u packets per second.", __func__,
+           limiter->pps);
+}
@@ -28,6 +28,9 @@
 uint16_t
 in_cksum (uint16_t *addr, int len);
 
+uint16_t
+in_cksum_update (uint16_t, const void *, const void *, int);
+
 int
 get_source_mac_addr (char *, uint8_t *);
 
@@ -37,8 +40,27 @@ get_source_addr_v6 (int *, struct in6_addr *, struct in6_addr *);
 boreas_error_t
 get_source_addr_v4 (int *, struct in_addr *, struct in_addr *);
 
+route_cache_t *
+route_cache_new (void);
+
+void
+route_cache_free (route_cache_t *);
+
+boreas_error_t
+route_cache_get_source_v6 (route_cache_t *, int *, struct in6_addr *,
+                           struct in6_addr *);
+
+boreas_error_t
+route_cache_get_source_v4 (route_cache_t *, int *, struct in_addr *,
+                           struct in_addr *);
+
+uint32_t
+tcp_cookie (uint32_t, const struct in6_addr *, uint16_t);
+
 void fill_ports_array (gpointer, gpointer);
 
+void fill_tcp_ports_array (gpointer, gpointer);
+
 boreas_error_t
 set_all_needed_sockets (scanner_t *, alive_test_t);
 
@@ -48,9 +70,56 @@ close_all_needed_sockets (scanner_t *, alive_test_t);
 void
 wait_until_so_sndbuf_empty (int, int);
 
-/* Misc hashtable functions. */
+/* Pacing of outgoing packets. */
+
+void
+rate_limiter_init (rate_limiter_t *, unsigned int);
+
+void
+rate_limiter_wait (rate_limiter_t *, unsigned int);
+
+void
+rate_limiter_backoff (rate_limiter_t *);
+
+/* Target hosts and their alive state. */
+
+hosts_data_t *
+hosts_data_new (gvm_hosts_t *);
+
+void
+hosts_data_free (hosts_data_t *);
 
 int
-count_difference (GHashTable *, GHashTable *);
+hosts_data_lookup (hosts_data_t *, const struct in6_addr *);
+
+gboolean
+hosts_data_probe_queued (hosts_data_t *, guint32);
+
+void
+hosts_data_probe_sent (hosts_data_t *, guint32);
+
+void
+hosts_data_probe_resent (hosts_data_t *, guint32);
+
+gboolean
+hosts_data_set_alive (hosts_data_t *, guint32);
+
+void
+hosts_data_wait_for_replies (hosts_data_t *, gint64, gint64);
+
+void
+hosts_data_wait_reply_timeout (hosts_data_t *, gint64, gint64);
+
+gboolean
+hosts_data_is_alive (hosts_data_t *, guint32);
+
+guint32
+hosts_data_alive_count (hosts_data_t *);
+
+const char *
+hosts_data_addr_str (hosts_data_t *, guint32, char *);
+
+gchar *
+hosts_data_metrics_str (hosts_data_t *, double);
 
 #endif /* not BOREAS_UTIL_H */
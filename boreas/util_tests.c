@@ -219,6 +219,321 @@ Ensure (util, fill_ports_array)
   assert_that (g_array_index (ports_garray, uint16_t, 7), is_equal_to (10));
   assert_that (g_array_index (ports_garray, uint16_t, 8), is_equal_to (10));
   g_array_free (ports_garray, TRUE);
+
+  /* Only TCP ports. */
+  /* 1,2,5,6,10,10 */
+  ports_garray = g_array_new (FALSE, TRUE, sizeof (uint16_t));
+  portranges_array = port_range_ranges (port_list);
+  g_ptr_array_foreach (portranges_array, fill_tcp_ports_array, ports_garray);
+  array_free (portranges_array);
+  assert_that (ports_garray->len, is_equal_to (6));
+  assert_that (g_array_index (ports_garray, uint16_t, 3), is_equal_to (6));
+  assert_that (g_array_index (ports_garray, uint16_t, 4), is_equal_to (10));
+  g_array_free (ports_garray, TRUE);
+}
+
+Ensure (util, tcp_cookie)
+{
+  struct in6_addr addr, other_addr;
+  uint32_t cookie;
+
+  inet_pton (AF_INET6, "::ffff:192.168.0.1", &addr);
+  inet_pton (AF_INET6, "::ffff:192.168.0.2", &other_addr);
+
+  /* The cookie only depends on the key and the destination. */
+  cookie = tcp_cookie (42, &addr, 80);
+  assert_that (tcp_cookie (42, &addr, 80), is_equal_to (cookie));
+  assert_that (tcp_cookie (43, &addr, 80), is_not_equal_to (cookie));
+  assert_that (tcp_cookie (42, &other_addr, 80), is_not_equal_to (cookie));
+  assert_that (tcp_cookie (42, &addr, 443), is_not_equal_to (cookie));
+}
+
+Ensure (util, rate_limiter)
+{
+  rate_limiter_t limiter;
+  gint64 start;
+
+  /* No limit. */
+  rate_limiter_init (&limiter, 0);
+  start = g_get_monotonic_time ();
+  rate_limiter_wait (&limiter, 100000);
+  assert_that (g_get_monotonic_time () - start < G_USEC_PER_SEC / 10);
+  rate_limiter_backoff (&limiter);
+  assert_that (limiter.pps, is_equal_to (0));
+
+  /* A full burst is sent without delay, the next 100 packets at 1000 pps. */
+  rate_limiter_init (&limiter, 1000);
+  start = g_get_monotonic_time ();
+  rate_limiter_wait (&limiter, BURST);
+  assert_that (g_get_monotonic_time () - start < G_USEC_PER_SEC / 20);
+  rate_limiter_wait (&limiter, 100);
+  assert_that (g_get_monotonic_time () - start >= G_USEC_PER_SEC / 10);
+
+  /* Backoff halves the rate once in quick succession. */
+  rate_limiter_backoff (&limiter);
+  assert_that (limiter.pps, is_equal_to (500));
+  rate_limiter_backoff (&limiter);
+  assert_that (limiter.pps, is_equal_to (500));
+
+  /* Rate never drops below MIN_PPS. */
+  limiter.pps = MIN_PPS + 1;
+  limiter.last_adjust = 0;
+  rate_limiter_backoff (&limiter);
+  assert_that (limiter.pps, is_equal_to (MIN_PPS));
+
+  /* Backoff never raises the rate above a max_pps below MIN_PPS. */
+  rate_limiter_init (&limiter, MIN_PPS / 2);
+  rate_limiter_backoff (&limiter);
+  assert_that (limiter.pps, is_equal_to (MIN_PPS / 2));
+  limiter.pps = MIN_PPS / 4;
+  limiter.last_adjust = 0;
+  rate_limiter_backoff (&limiter);
+  assert_that (limiter.pps, is_equal_to (MIN_PPS / 2));
+}
+
+Ensure (util, in_cksum)
+{
+  unsigned char buf[67], copy[66], odd[4];
+  uint16_t sum, updated, field;
+
+  for (size_t i = 0; i < sizeof (buf); i++)
+    buf[i] = (i * 37 + 11) & 0xff;
+
+  /* A buffer with its checksum in it sums up to 0. */
+  buf[0] = buf[1] = 0;
+  sum = in_cksum ((uint16_t *) buf, 64);
+  memcpy (buf, &sum, sizeof (sum));
+  assert_that (in_cksum ((uint16_t *) buf, 64), is_equal_to (0));
+
+  /* Unaligned buffer. */
+  memcpy (copy, buf + 1, sizeof (copy));
+  assert_that (in_cksum ((uint16_t *) (buf + 1), sizeof (copy)),
+               is_equal_to (in_cksum ((uint16_t *) copy, sizeof (copy))));
+
+  /* Odd length is padded with a zero byte. */
+  memcpy (odd, buf, 3);
+  odd[3] = 0;
+  assert_that (in_cksum ((uint16_t *) buf, 3),
+               is_equal_to (in_cksum ((uint16_t *) odd, 4)));
+
+  /* Incremental update gives the same result as a full calculation. */
+  sum = in_cksum ((uint16_t *) buf, 64);
+  field = 0xbeef;
+  updated = in_cksum_update (sum, buf + 20, &field, sizeof (field));
+  memcpy (buf + 20, &field, sizeof (field));
+  assert_that (updated, is_equal_to (in_cksum ((uint16_t *) buf, 64)));
+}
+
+Ensure (util, hosts_data)
+{
+  gvm_hosts_t *hosts;
+  hosts_data_t *hosts_data;
+  struct in6_addr addr;
+  char addr_str[INET6_ADDRSTRLEN];
+  int index;
+
+  hosts = gvm_hosts_new ("192.168.0.0/24,2001:db8::1");
+  hosts_data = hosts_data_new (hosts);
+  assert_that (hosts_data->count, is_equal_to (255));
+  assert_that (hosts_data_alive_count (hosts_data), is_equal_to (0));
+
+  /* IPv4 addresses are looked up as IPv4 mapped IPv6 addresses. */
+  inet_pton (AF_INET6, "::ffff:192.168.0.42", &addr);
+  index = hosts_data_lookup (hosts_data, &addr);
+  assert_that (index, is_greater_than (-1));
+  assert_that (hosts_data_addr_str (hosts_data, index, addr_str),
+               is_not_null);
+  assert_that (addr_str, is_equal_to_string ("192.168.0.42"));
+
+  inet_pton (AF_INET6, "2001:db8::1", &addr);
+  index = hosts_data_lookup (hosts_data, &addr);
+  assert_that (index, is_greater_than (-1));
+  assert_that (hosts_data_addr_str (hosts_data, index, addr_str),
+               is_not_null);
+  assert_that (addr_str, is_equal_to_string ("2001:db8::1"));
+
+  inet_pton (AF_INET6, "::ffff:192.168.1.1", &addr);
+  assert_that (hosts_data_lookup (hosts_data, &addr), is_equal_to (-1));
+
+  /* Hosts are only marked as alive once. */
+  assert_that (hosts_data_is_alive (hosts_data, index), is_false);
+  assert_that (hosts_data_set_alive (hosts_data, index), is_true);
+  assert_that (hosts_data_set_alive (hosts_data, index), is_false);
+  assert_that (hosts_data_is_alive (hosts_data, index), is_true);
+  assert_that (hosts_data_alive_count (hosts_data), is_equal_to (1));
+
+  hosts_data_free (hosts_data);
+  gvm_hosts_free (hosts);
+}
+
+Ensure (util, hosts_data_metrics_str)
+{
+  gvm_hosts_t *hosts;
+  hosts_data_t *hosts_data;
+  gchar *str;
+
+  hosts = gvm_hosts_new ("192.168.0.1-4");
+  hosts_data = hosts_data_new (hosts);
+  hosts_data->metrics.probes[PROBE_ICMP] = 4;
+  hosts_data->metrics.probes[PROBE_TCP_SYN] = 80;
+  hosts_data->metrics.replies = 3;
+  hosts_data->metrics.replies_matched = 2;
+  hosts_data_set_alive (hosts_data, 0);
+
+  /* 500 us, 3 ms and 10 s round trip times. */
+  hosts_data_add_rtt (hosts_data, 500);
+  hosts_data_add_rtt (hosts_data, 3000);
+  hosts_data_add_rtt (hosts_data, 10 * G_USEC_PER_SEC);
+  assert_that (hosts_data->metrics.rtt_histogram[0], is_equal_to (1));
+  assert_that (hosts_data->metrics.rtt_histogram[2], is_equal_to (1));
+  assert_that (hosts_data->metrics.rtt_histogram[RTT_BUCKETS - 1],
+               is_equal_to (1));
+
+  str = hosts_data_metrics_str (hosts_data, 1000);
+  assert_that (str, contains_string ("probes_icmp=4 probes_tcp_syn=80 "));
+  assert_that (str, contains_string ("replies=3 replies_matched=2 "));
+  assert_that (str, contains_string ("alive=1/4 rate=1000 "));
+  assert_that (str, contains_string ("rtt_ms=<1:1,<2:0,<4:1,"));
+  assert_that (str, ends_with_string (",>=1024:1"));
+  g_free (str);
+
+  hosts_data_free (hosts_data);
+  gvm_hosts_free (hosts);
+}
+
+Ensure (util, route_cache)
+{
+  route_cache_t cache;
+  struct in6_addr addr;
+  struct route *route;
+
+  cache.routes_v4 = g_array_new (FALSE, TRUE, sizeof (struct route));
+  cache.routes_v6 = g_array_new (FALSE, TRUE, sizeof (struct route));
+  cache.local = g_array_new (FALSE, TRUE, sizeof (struct in6_addr));
+  inet_pton (AF_INET6, "::ffff:0.0.0.0", &addr);
+  route_cache_add (cache.routes_v4, &addr, 96);
+  inet_pton (AF_INET6, "::ffff:10.1.0.0", &addr);
+  route_cache_add (cache.routes_v4, &addr, 96 + 16);
+  inet_pton (AF_INET6, "::ffff:10.0.0.0", &addr);
+  route_cache_add (cache.routes_v4, &addr, 96 + 8);
+  inet_pton (AF_INET6, "2001:db8::", &addr);
+  route_cache_add (cache.routes_v6, &addr, 33);
+  inet_pton (AF_INET6, "::", &addr);
+  route_cache_add (cache.routes_v6, &addr, 0);
+  inet_pton (AF_INET6, "::ffff:10.1.2.4", &addr);
+  g_array_append_val (cache.local, addr);
+  g_array_sort (cache.routes_v4, route_cmp);
+  g_array_sort (cache.routes_v6, route_cmp);
+
+  /* Longest prefix wins. */
+  inet_pton (AF_INET6, "::ffff:10.1.2.3", &addr);
+  route = route_cache_lookup (&cache, cache.routes_v4, &addr);
+  assert_that (route, is_not_null);
+  assert_that (route->prefix_len, is_equal_to (96 + 16));
+
+  inet_pton (AF_INET6, "::ffff:10.2.0.1", &addr);
+  route = route_cache_lookup (&cache, cache.routes_v4, &addr);
+  assert_that (route, is_not_null);
+  assert_that (route->prefix_len, is_equal_to (96 + 8));
+
+  inet_pton (AF_INET6, "::ffff:192.168.0.1", &addr);
+  route = route_cache_lookup (&cache, cache.routes_v4, &addr);
+  assert_that (route, is_not_null);
+  assert_that (route->prefix_len, is_equal_to (96));
+
+  /* Prefix lengths which are not a multiple of 8. */
+  inet_pton (AF_INET6, "2001:db8:7fff::1", &addr);
+  route = route_cache_lookup (&cache, cache.routes_v6, &addr);
+  assert_that (route, is_not_null);
+  assert_that (route->prefix_len, is_equal_to (33));
+  inet_pton (AF_INET6, "2001:db8:8000::1", &addr);
+  route = route_cache_lookup (&cache, cache.routes_v6, &addr);
+  assert_that (route, is_not_null);
+  assert_that (route->prefix_len, is_equal_to (0));
+
+  /* IPv4 destinations never match IPv6 routes. */
+  g_array_remove_index (cache.routes_v4, cache.routes_v4->len - 1);
+  inet_pton (AF_INET6, "::ffff:192.168.0.1", &addr);
+  assert_that (route_cache_lookup (&cache, cache.routes_v4, &addr), is_null);
+
+  /* Loopback and local destinations are not looked up. */
+  inet_pton (AF_INET6, "::ffff:127.0.0.2", &addr);
+  assert_that (route_cache_lookup (&cache, cache.routes_v4, &addr), is_null);
+  inet_pton (AF_INET6, "::ffff:10.1.2.4", &addr);
+  assert_that (route_cache_lookup (&cache, cache.routes_v4, &addr), is_null);
+  inet_pton (AF_INET6, "::1", &addr);
+  assert_that (route_cache_lookup (&cache, cache.routes_v6, &addr), is_null);
+
+  g_array_free (cache.routes_v4, TRUE);
+  g_array_free (cache.routes_v6, TRUE);
+  g_array_free (cache.local, TRUE);
+}
+
+Ensure (util, hosts_data_wait_for_replies)
+{
+  gvm_hosts_t *hosts;
+  hosts_data_t *hosts_data;
+  gint64 start, waited;
+
+  hosts = gvm_hosts_new ("192.168.0.1,192.168.0.2");
+  hosts_data = hosts_data_new (hosts);
+
+  /* No round trip times known yet, wait for max_wait. */
+  start = g_get_monotonic_time ();
+  hosts_data_wait_for_replies (hosts_data, start, G_USEC_PER_SEC / 10);
+  waited = g_get_monotonic_time () - start;
+  assert_that (waited >= G_USEC_PER_SEC / 10);
+
+  /* Fast replies, wait for MIN_REPLY_TIMEOUT only. */
+  for (int i = 0; i < MIN_RTT_SAMPLES; i++)
+    hosts_data_add_rtt (hosts_data, 1000);
+  assert_that (hosts_data->srtt, is_equal_to (1000));
+  start = g_get_monotonic_time ();
+  hosts_data_wait_for_replies (hosts_data, start, 10 * G_USEC_PER_SEC);
+  waited = g_get_monotonic_time () - start;
+  assert_that (waited >= MIN_REPLY_TIMEOUT * 1000);
+  assert_that (waited < 10 * MIN_REPLY_TIMEOUT * 1000);
+
+  /* All hosts alive, return immediately. */
+  assert_that (hosts_data_probe_queued (hosts_data, 0), is_true);
+  hosts_data_probe_sent (hosts_data, 0);
+  hosts_data_set_alive (hosts_data, 0);
+  hosts_data_set_alive (hosts_data, 1);
+  assert_that (hosts_data->rtt_samples, is_equal_to (MIN_RTT_SAMPLES + 1));
+  start = g_get_monotonic_time ();
+  hosts_data_wait_for_replies (hosts_data, start, 10 * G_USEC_PER_SEC);
+  waited = g_get_monotonic_time () - start;
+  assert_that (waited < G_USEC_PER_SEC / 10);
+
+  hosts_data_free (hosts_data);
+  gvm_hosts_free (hosts);
+}
+
+Ensure (util, hosts_data_rtt_sample_of_first_probe_only)
+{
+  gvm_hosts_t *hosts;
+  hosts_data_t *hosts_data;
+
+  hosts = gvm_hosts_new ("192.168.0.1,192.168.0.2");
+  hosts_data = hosts_data_new (hosts);
+
+  /* Host 0 is probed by two methods, a reply matches none of them. */
+  assert_that (hosts_data_probe_queued (hosts_data, 0), is_true);
+  hosts_data_probe_sent (hosts_data, 0);
+  assert_that (hosts_data_probe_queued (hosts_data, 0), is_false);
+  hosts_data_probe_sent (hosts_data, 0);
+  hosts_data_set_alive (hosts_data, 0);
+  assert_that (hosts_data->rtt_samples, is_equal_to (0));
+
+  /* Host 1 is probed by one method, with several probes. */
+  assert_that (hosts_data_probe_queued (hosts_data, 1), is_true);
+  hosts_data_probe_sent (hosts_data, 1);
+  hosts_data_probe_sent (hosts_data, 1);
+  hosts_data_set_alive (hosts_data, 1);
+  assert_that (hosts_data->rtt_samples, is_equal_to (1));
+
+  hosts_data_free (hosts_data);
+  gvm_hosts_free (hosts);
 }
 
 int
@@ -229,10 +544,19 @@ main (int argc, char **argv)
   suite = create_test_suite ();
 
   add_test_with_context (suite, util, fill_ports_array);
+  add_test_with_context (suite, util, tcp_cookie);
   add_test_with_context (suite, util, set_all_needed_sockets);
   add_test_with_context (suite, util, set_socket);
   add_test_with_context (suite, util, get_source_addr_v4);
   add_test_with_context (suite, util, get_source_addr_v6);
+  add_test_with_context (suite, util, rate_limiter);
+  add_test_with_context (suite, util, in_cksum);
+  add_test_with_context (suite, util, hosts_data);
+  add_test_with_context (suite, util, hosts_data_wait_for_replies);
+  add_test_with_context (suite, util,
+                         hosts_data_rtt_sample_of_first_probe_only);
+  add_test_with_context (suite, util, route_cache);
+  add_test_with_context (suite, util, hosts_data_metrics_str);
 
   if (argc > 1)
     return run_single_test (suite, argv[1], create_text_reporter ());
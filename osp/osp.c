@@ -29,8 +29,8 @@
 
 #include <assert.h>        /* for assert */
 #include <gnutls/gnutls.h> /* for gnutls_session_int, gnutls_session_t */
+#include <poll.h>          /* for poll, POLLIN */
 #include <stdarg.h>        /* for va_list */
-#include <stdio.h>         /* for FILE, fprintf and related functions */
 #include <stdlib.h>        /* for NULL, atoi */
 #include <string.h>        /* for strcmp, strlen, strncpy */
 #include <sys/socket.h>    /* for AF_UNIX, connect, socket, SOCK_STREAM */
@@ -52,6 +52,20 @@ struct osp_connection
   int socket;               /**< Socket. */
   char *host;               /**< Host. */
   int port;                 /**< Port. */
+  int pending;              /**< Commands sent but not read yet. */
+  GString *buffer;          /**< Received data not read yet, or NULL. */
+  gchar *pool_key;          /**< Key in the connection pool, if pooled. */
+};
+
+/**
+ * @brief Struct holding idle OSP connections for reuse.
+ */
+struct osp_connection_pool
+{
+  GMutex lock;        /**< Protects the tables. */
+  GHashTable *idle;   /**< Queue of idle connections per key. */
+  GHashTable *resume; /**< TLS session data per key. */
+  guint max_idle;     /**< Maximum number of idle connections per key. */
 };
 
 /**
@@ -121,6 +135,12 @@ static int
 osp_send_command (osp_connection_t *, entity_t *, const char *, ...)
   __attribute__ ((__format__ (__printf__, 3, 4)));
 
+static int
+osp_send_command_streamed (osp_connection_t *, entity_t *, const char *,
+                           entity_stream_callback_t, gpointer, const char *,
+                           ...)
+  __attribute__ ((__format__ (__printf__, 6, 7)));
+
 /**
  * @brief Open a new connection to an OSP server.
  *
@@ -129,12 +149,14 @@ osp_send_command (osp_connection_t *, entity_t *, const char *, ...)
  * @param[in]   cacert  CA public key.
  * @param[in]   cert    Client public key.
  * @param[in]   key     Client private key.
+ * @param[in]   resume  Data of an earlier TLS session to resume, or NULL.
  *
  * @return New osp connection, NULL if error.
  */
-osp_connection_t *
-osp_connection_new (const char *host, int port, const char *cacert,
-                    const char *cert, const char *key)
+static osp_connection_t *
+osp_connection_open (const char *host, int port, const char *cacert,
+                     const char *cert, const char *key,
+                     const gnutls_datum_t *resume)
 {
   osp_connection_t *connection;
 
@@ -172,8 +194,8 @@ osp_connection_new (const char *host, int port, const char *cacert,
         return NULL;
 
       connection = g_malloc0 (sizeof (*connection));
-      connection->socket = gvm_server_open_with_cert (
-        &connection->session, host, port, cacert, cert, key);
+      connection->socket = gvm_server_open_with_cert_resume (
+        &connection->session, host, port, cacert, cert, key, resume);
     }
   if (connection->socket == -1)
     {
@@ -186,6 +208,24 @@ osp_connection_new (const char *host, int port, const char *cacert,
   return connection;
 }
 
+/**
+ * @brief Open a new connection to an OSP server.
+ *
+ * @param[in]   host    Host of OSP server.
+ * @param[in]   port    Port of OSP server.
+ * @param[in]   cacert  CA public key.
+ * @param[in]   cert    Client public key.
+ * @param[in]   key     Client private key.
+ *
+ * @return New osp connection, NULL if error.
+ */
+osp_connection_t *
+osp_connection_new (const char *host, int port, const char *cacert,
+                    const char *cert, const char *key)
+{
+  return osp_connection_open (host, port, cacert, cert, key, NULL);
+}
+
 /**
  * @brief Send a command to an OSP server.
  *
@@ -230,6 +270,57 @@ out:
   return rc;
 }
 
+/**
+ * @brief Send a command to an OSP server, streaming elements of the response.
+ *
+ * @param[in]   connection  Connection to OSP server.
+ * @param[out]  response    Response from OSP server, without the streamed
+ *                          elements.
+ * @param[in]   name        Name of the elements to stream.
+ * @param[in]   callback    Called for each streamed element.
+ * @param[in]   user_data   Passed to the callback.
+ * @param[in]   fmt         OSP Command to send.
+ *
+ * @return 0 and response, 1 if error.
+ */
+static int
+osp_send_command_streamed (osp_connection_t *connection, entity_t *response,
+                           const char *name, entity_stream_callback_t callback,
+                           gpointer user_data, const char *fmt, ...)
+{
+  va_list ap;
+  int rc = 1;
+
+  va_start (ap, fmt);
+
+  if (!connection || !fmt || !response)
+    goto out;
+
+  if (*connection->host == '/')
+    {
+      if (gvm_socket_vsendf (connection->socket, fmt, ap) == -1)
+        goto out;
+      if (read_entity_streamed_s (connection->socket, name, callback,
+                                  user_data, response))
+        goto out;
+    }
+  else
+    {
+      if (gvm_server_vsendf (&connection->session, fmt, ap) == -1)
+        goto out;
+      if (read_entity_streamed (&connection->session, name, callback,
+                                user_data, response))
+        goto out;
+    }
+
+  rc = 0;
+
+out:
+  va_end (ap);
+
+  return rc;
+}
+
 /**
  * @brief Close a connection to an OSP server.
  *
@@ -246,9 +337,345 @@ osp_connection_close (osp_connection_t *connection)
   else
     gvm_server_close (connection->socket, connection->session);
   g_free (connection->host);
+  g_free (connection->pool_key);
+  if (connection->buffer)
+    g_string_free (connection->buffer, TRUE);
   g_free (connection);
 }
 
+/**
+ * @brief Send a command to an OSP server without waiting for the response.
+ *
+ * Several commands can be sent before their responses are read with
+ * osp_connection_read, so that the server can work on all of them without
+ * waiting for a round trip each.  The server must keep the connection open
+ * for this.
+ *
+ * @param[in]   connection  Connection to OSP server.
+ * @param[in]   command     OSP command to send.
+ *
+ * @return 0 success, 1 if error.
+ */
+int
+osp_connection_send (osp_connection_t *connection, const char *command)
+{
+  int rc;
+
+  if (!connection || !command)
+    return 1;
+
+  if (*connection->host == '/')
+    rc = gvm_socket_send (connection->socket, command, strlen (command));
+  else
+    rc = gvm_server_send (&connection->session, command, strlen (command));
+  if (rc)
+    return 1;
+
+  connection->pending++;
+  return 0;
+}
+
+/**
+ * @brief Try read the response to the oldest command sent with
+ *        osp_connection_send.
+ *
+ * Responses received together with this one are kept on the connection for
+ * the next read.  On timeout the part of the response received so far is
+ * kept as well, so the read can be tried again.
+ *
+ * @param[in]   connection  Connection to OSP server.
+ * @param[in]   timeout     Server idle time before giving up, in seconds.  0
+ *                          to wait forever.
+ * @param[out]  response    Response from OSP server.
+ *
+ * @return 0 and response, 1 if error, 2 on timeout.
+ */
+int
+osp_connection_try_read (osp_connection_t *connection, int timeout,
+                         entity_t *response)
+{
+  int rc;
+
+  if (!connection || !response || connection->pending <= 0)
+    return 1;
+
+  if (connection->buffer == NULL)
+    connection->buffer = g_string_new (NULL);
+  if (*connection->host == '/')
+    rc = try_read_entity_buffered_s (connection->socket, timeout,
+                                     connection->buffer, response);
+  else
+    rc = try_read_entity_buffered (&connection->session, timeout,
+                                   connection->buffer, response);
+  if (rc == -4)
+    return 2;
+  if (rc)
+    {
+      /* The connection is out of step with the commands now. */
+      connection->pending = -1;
+      return 1;
+    }
+
+  connection->pending--;
+  return 0;
+}
+
+/**
+ * @brief Read the response to the oldest command sent with
+ *        osp_connection_send.
+ *
+ * Responses received together with this one are kept on the connection for
+ * the next read.
+ *
+ * @param[in]   connection  Connection to OSP server.
+ * @param[out]  response    Response from OSP server.
+ *
+ * @return 0 and response, 1 if error.
+ */
+int
+osp_connection_read (osp_connection_t *connection, entity_t *response)
+{
+  return osp_connection_try_read (connection, 0, response);
+}
+
+/**
+ * @brief Check whether an idle connection can still be used.
+ *
+ * The server may have closed the connection in the meantime.  Any data or
+ * end of file waiting on an idle connection means it cannot be reused.
+ *
+ * @param[in]   connection  Idle connection to OSP server.
+ *
+ * @return 1 if the connection is usable, 0 otherwise.
+ */
+static int
+osp_connection_usable (osp_connection_t *connection)
+{
+  struct pollfd pollfd;
+
+  if (connection->pending)
+    return 0;
+  if (connection->buffer)
+    {
+      gsize i;
+
+      /* Anything but whitespace left after the last response is unexpected. */
+      for (i = 0; i < connection->buffer->len; i++)
+        if (!g_ascii_isspace (connection->buffer->str[i]))
+          return 0;
+      g_string_truncate (connection->buffer, 0);
+    }
+  if (*connection->host != '/'
+      && gnutls_record_check_pending (connection->session))
+    return 0;
+
+  pollfd.fd = connection->socket;
+  pollfd.events = POLLIN;
+  pollfd.revents = 0;
+  return poll (&pollfd, 1, 0) == 0;
+}
+
+/**
+ * @brief Free a queue of idle connections.
+ *
+ * @param[in]   queue  Queue of idle connections.
+ */
+static void
+osp_connection_queue_free (gpointer queue)
+{
+  g_queue_free_full ((GQueue *) queue, (GDestroyNotify) osp_connection_close);
+}
+
+/**
+ * @brief Free TLS session data.
+ *
+ * @param[in]   datum  Session data.
+ */
+static void
+osp_resume_data_free (gpointer datum)
+{
+  gnutls_free (((gnutls_datum_t *) datum)->data);
+  g_free (datum);
+}
+
+/**
+ * @brief Create a pool of OSP connections.
+ *
+ * Connections taken from the pool with osp_connection_pool_get and given back
+ * with osp_connection_pool_put are kept open for the next command to the
+ * same server.  New TLS connections resume the last session to the server,
+ * which saves most of the handshake.
+ *
+ * @param[in]   max_idle  Maximum number of idle connections kept per server.
+ *
+ * @return New connection pool.
+ */
+osp_connection_pool_t *
+osp_connection_pool_new (guint max_idle)
+{
+  osp_connection_pool_t *pool;
+
+  pool = g_malloc0 (sizeof (*pool));
+  g_mutex_init (&pool->lock);
+  pool->idle = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                      osp_connection_queue_free);
+  pool->resume = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+                                        osp_resume_data_free);
+  pool->max_idle = max_idle;
+  return pool;
+}
+
+/**
+ * @brief Close all idle connections of a pool and free the pool.
+ *
+ * Connections still taken from the pool must be closed by the caller with
+ * osp_connection_close.
+ *
+ * @param[in]   pool  Connection pool.
+ */
+void
+osp_connection_pool_free (osp_connection_pool_t *pool)
+{
+  if (!pool)
+    return;
+
+  g_hash_table_destroy (pool->idle);
+  g_hash_table_destroy (pool->resume);
+  g_mutex_clear (&pool->lock);
+  g_free (pool);
+}
+
+/**
+ * @brief Get a connection to an OSP server from a pool.
+ *
+ * An idle connection to the server with the same credentials is reused if
+ * possible, else a new one is opened.
+ *
+ * @param[in]   pool    Connection pool.
+ * @param[in]   host    Host of OSP server.
+ * @param[in]   port    Port of OSP server.
+ * @param[in]   cacert  CA public key.
+ * @param[in]   cert    Client public key.
+ * @param[in]   key     Client private key.
+ *
+ * @return Connection to give back with osp_connection_pool_put, NULL if error.
+ */
+osp_connection_t *
+osp_connection_pool_get (osp_connection_pool_t *pool, const char *host,
+                         int port, const char *cacert, const char *cert,
+                         const char *key)
+{
+  osp_connection_t *connection;
+  gnutls_datum_t resume;
+  gchar *pool_key, *credentials, *credentials_hash;
+  GQueue *queue;
+
+  if (!pool || !host)
+    return NULL;
+
+  /* Credentials are part of the key, so a connection is never reused with
+   * other credentials than the ones it was opened with. */
+  credentials = g_strdup_printf ("%s\n%s\n%s", cacert ? cacert : "",
+                                 cert ? cert : "", key ? key : "");
+  credentials_hash =
+    g_compute_checksum_for_string (G_CHECKSUM_SHA256, credentials, -1);
+  g_free (credentials);
+  pool_key = g_strdup_printf ("%s\n%d\n%s", host, port, credentials_hash);
+  g_free (credentials_hash);
+
+  resume.data = NULL;
+  resume.size = 0;
+  g_mutex_lock (&pool->lock);
+  queue = g_hash_table_lookup (pool->idle, pool_key);
+  while (queue && (connection = g_queue_pop_head (queue)))
+    {
+      if (osp_connection_usable (connection))
+        {
+          g_mutex_unlock (&pool->lock);
+          g_free (pool_key);
+          return connection;
+        }
+      osp_connection_close (connection);
+    }
+  if (*host != '/')
+    {
+      gnutls_datum_t *data = g_hash_table_lookup (pool->resume, pool_key);
+
+      if (data)
+        {
+          resume.data = gnutls_malloc (data->size);
+          memcpy (resume.data, data->data, data->size);
+          resume.size = data->size;
+        }
+    }
+  g_mutex_unlock (&pool->lock);
+
+  connection = osp_connection_open (host, port, cacert, cert, key,
+                                    resume.size ? &resume : NULL);
+  gnutls_free (resume.data);
+  if (connection == NULL)
+    {
+      g_free (pool_key);
+      return NULL;
+    }
+  connection->pool_key = pool_key;
+  return connection;
+}
+
+/**
+ * @brief Give a connection back to the pool it was taken from.
+ *
+ * The connection is closed instead if it has unread responses, was not taken
+ * from a pool or the pool already holds enough idle connections.
+ *
+ * @param[in]   pool        Connection pool.
+ * @param[in]   connection  Connection taken from the pool.
+ */
+void
+osp_connection_pool_put (osp_connection_pool_t *pool,
+                         osp_connection_t *connection)
+{
+  GQueue *queue;
+
+  if (!connection)
+    return;
+  if (!pool || !connection->pool_key || connection->pending)
+    {
+      osp_connection_close (connection);
+      return;
+    }
+
+  g_mutex_lock (&pool->lock);
+
+  if (*connection->host != '/')
+    {
+      gnutls_datum_t *data = g_malloc0 (sizeof (*data));
+
+      if (gnutls_session_get_data2 (connection->session, data) == 0)
+        g_hash_table_replace (pool->resume, g_strdup (connection->pool_key),
+                              data);
+      else
+        g_free (data);
+    }
+
+  queue = g_hash_table_lookup (pool->idle, connection->pool_key);
+  if (queue == NULL)
+    {
+      queue = g_queue_new ();
+      g_hash_table_insert (pool->idle, g_strdup (connection->pool_key), queue);
+    }
+  if (g_queue_get_length (queue) < pool->max_idle)
+    {
+      g_queue_push_tail (queue, connection);
+      connection = NULL;
+    }
+
+  g_mutex_unlock (&pool->lock);
+
+  if (connection)
+    osp_connection_close (connection);
+}
+
 /**
  * @brief Gets additional status info about the feed.
  *
@@ -785,6 +1212,40 @@ osp_get_scan_status_ext (osp_connection_t *connection,
   return status;
 }
 
+/**
+ * @brief Get the scan and its progress from a get_scans response.
+ *
+ * @param[in]   entity  Response to a get_scans command.
+ * @param[out]  scan    The scan element of the response, or NULL.
+ * @param[out]  error   Pointer to error, if any.
+ *
+ * @return Scan progress if success, -1 if error.
+ */
+static int
+get_scans_response_progress (entity_t entity, entity_t *scan, char **error)
+{
+  entity_t child;
+  const char *progress;
+
+  child = entity_child (entity, "scan");
+  progress = child ? entity_attribute (child, "progress") : NULL;
+  if (progress == NULL)
+    {
+      if (error)
+        {
+          const char *text;
+
+          text = child ? NULL : entity_attribute (entity, "status_text");
+          *error = g_strdup (text ? text
+                                  : "Invalid get_scans response from scanner");
+        }
+      return -1;
+    }
+  if (scan)
+    *scan = child;
+  return atoi (progress);
+}
+
 /**
  * @brief Get a scan from an OSP server, optionally removing the results.
  *
@@ -800,11 +1261,45 @@ osp_get_scan_status_ext (osp_connection_t *connection,
 int
 osp_get_scan_pop (osp_connection_t *connection, const char *scan_id,
                   char **report_xml, int details, int pop_results, char **error)
+{
+  osp_get_scan_pop_opts_t opts;
+
+  opts.scan_id = scan_id;
+  opts.details = details;
+  opts.pop_results = pop_results;
+  opts.max_results = 0;
+  return osp_get_scan_pop_ext (connection, opts, report_xml, NULL, error);
+}
+
+/**
+ * @brief Get a scan from an OSP server, optionally a page of results only.
+ *
+ * With max_results the scanner returns at most that many results per call.
+ * As the returned results are popped, the next call continues where this one
+ * stopped.  With details set to 0 no results are fetched at all, which is a
+ * cheap way to poll the progress of a scan.
+ *
+ * @param[in]   connection  Connection to an OSP server.
+ * @param[in]   opts        Struct containing the options to apply.
+ * @param[out]  report_xml  Scans report, or NULL.
+ * @param[out]  more        Set to 1 if the scanner may have more results,
+ *                          else 0.  Can be NULL.
+ * @param[out]  error       Pointer to error, if any.
+ *
+ * @return Scan progress if success, -1 if error.
+ */
+int
+osp_get_scan_pop_ext (osp_connection_t *connection,
+                      osp_get_scan_pop_opts_t opts, char **report_xml,
+                      int *more, char **error)
 {
   entity_t entity, child;
+  GString *command;
   int progress;
   int rc;
 
+  if (more)
+    *more = 0;
   if (!connection)
     {
       if (error)
@@ -812,12 +1307,22 @@ osp_get_scan_pop (osp_connection_t *connection, const char *scan_id,
                            "to scanner. Not valid connection");
       return -1;
     }
-  assert (scan_id);
-  rc = osp_send_command (connection, &entity,
-                         "<get_scans scan_id='%s'"
-                         " details='%d'"
-                         " pop_results='%d'/>",
-                         scan_id, pop_results ? 1 : 0, details ? 1 : 0);
+  assert (opts.scan_id);
+  /* Without popping the same results would be returned again and again. */
+  assert (opts.max_results == 0 || opts.pop_results);
+
+  command = g_string_new (NULL);
+  xml_string_append (command,
+                     "<get_scans scan_id='%s'"
+                     " details='%d'"
+                     " pop_results='%d'",
+                     opts.scan_id, opts.details ? 1 : 0,
+                     opts.pop_results ? 1 : 0);
+  if (opts.max_results > 0)
+    g_string_append_printf (command, " max_results='%d'", opts.max_results);
+  g_string_append (command, "/>");
+  rc = osp_send_command (connection, &entity, "%s", command->str);
+  g_string_free (command, TRUE);
   if (rc)
     {
       if (error)
@@ -825,18 +1330,20 @@ osp_get_scan_pop (osp_connection_t *connection, const char *scan_id,
       return -1;
     }
 
-  child = entity_child (entity, "scan");
-  if (!child)
+  progress = get_scans_response_progress (entity, &child, error);
+  if (progress < 0)
     {
-      const char *text = entity_attribute (entity, "status_text");
-
-      assert (text);
-      if (error)
-        *error = g_strdup (text);
       free_entity (entity);
       return -1;
     }
-  progress = atoi (entity_attribute (child, "progress"));
+  if (more && opts.max_results > 0)
+    {
+      entity_t results = entity_child (child, "results");
+
+      if (results
+          && xml_count_entities (results->entities) >= opts.max_results)
+        *more = 1;
+    }
   if (report_xml)
     {
       GString *string;
@@ -849,6 +1356,61 @@ osp_get_scan_pop (osp_connection_t *connection, const char *scan_id,
   return progress;
 }
 
+/**
+ * @brief Get a scan from an OSP server, passing each result to a callback.
+ *
+ * The results are handed to the callback while the response is read, instead
+ * of collecting the whole report in memory first.
+ *
+ * @param[in]   connection  Connection to an OSP server.
+ * @param[in]   scan_id     ID of scan to get.
+ * @param[in]   details     0 for no scan details, 1 otherwise.
+ * @param[in]   pop_results 0 to leave results, 1 to pop results from scanner.
+ * @param[in]   callback    Called with each result element, which is freed
+ *                          afterwards.  Returns 0 to continue, else to stop.
+ * @param[in]   user_data   Passed to the callback.
+ * @param[out]  error       Pointer to error, if any.
+ *
+ * @return Scan progress if success, -1 if error.
+ */
+int
+osp_get_scan_pop_stream (osp_connection_t *connection, const char *scan_id,
+                         int details, int pop_results,
+                         entity_stream_callback_t callback, gpointer user_data,
+                         char **error)
+{
+  entity_t entity;
+  int progress;
+  int rc;
+
+  if (!connection)
+    {
+      if (error)
+        *error = g_strdup ("Couldn't send get_scan command "
+                           "to scanner. Not valid connection");
+      return -1;
+    }
+  assert (scan_id);
+  assert (callback);
+  rc = osp_send_command_streamed (connection, &entity, "result", callback,
+                                  user_data,
+                                  "<get_scans scan_id='%s'"
+                                  " details='%d'"
+                                  " pop_results='%d'/>",
+                                  scan_id, details ? 1 : 0,
+                                  pop_results ? 1 : 0);
+  if (rc)
+    {
+      if (error)
+        *error = g_strdup ("Couldn't send get_scans command to scanner");
+      return -1;
+    }
+
+  progress = get_scans_response_progress (entity, NULL, error);
+  free_entity (entity);
+  return progress;
+}
+
 /**
  * @brief Get a scan from an OSP server.
  *
@@ -918,29 +1480,17 @@ osp_stop_scan (osp_connection_t *connection, const char *scan_id, char **error)
 }
 
 /**
- * @brief Concatenate options as xml.
+ * @brief Append an option as xml.
  *
  * @param[in]     key      Tag name for xml element.
  * @param[in]     value    Text for xml element.
- * @param[in,out] pstr     Parameters as xml concatenated xml elements.
+ * @param[in,out] xml      XML string buffer to append to.
  *
  */
 static void
-option_concat_as_xml (gpointer key, gpointer value, gpointer pstr)
+option_append_as_xml (gpointer key, gpointer value, gpointer xml)
 {
-  char *options_str, *tmp, *key_escaped, *value_escaped;
-
-  options_str = *(char **) pstr;
-
-  key_escaped = g_markup_escape_text ((char *) key, -1);
-  value_escaped = g_markup_escape_text ((char *) value, -1);
-  tmp = g_strdup_printf ("%s<%s>%s</%s>", options_str ? options_str : "",
-                         key_escaped, value_escaped, key_escaped);
-
-  g_free (options_str);
-  g_free (key_escaped);
-  g_free (value_escaped);
-  *(char **) pstr = tmp;
+  xml_string_append_element ((GString *) xml, (char *) key, (char *) value);
 }
 
 /**
@@ -961,7 +1511,7 @@ osp_start_scan (osp_connection_t *connection, const char *target,
                 char **error)
 {
   entity_t entity;
-  char *options_str = NULL;
+  GString *xml;
   int status;
   int rc;
 
@@ -974,16 +1524,19 @@ osp_start_scan (osp_connection_t *connection, const char *target,
     }
 
   assert (target);
-  /* Construct options string. */
+  xml = g_string_new ("<start_scan target='");
+  xml_string_append_text (xml, target, -1);
+  g_string_append (xml, "' ports='");
+  xml_string_append_text (xml, ports, -1);
+  g_string_append (xml, "' scan_id='");
+  xml_string_append_text (xml, scan_id, -1);
+  g_string_append (xml, "'><scanner_params>");
   if (options)
-    g_hash_table_foreach (options, option_concat_as_xml, &options_str);
+    g_hash_table_foreach (options, option_append_as_xml, xml);
+  g_string_append (xml, "</scanner_params></start_scan>");
 
-  rc = osp_send_command (connection, &entity,
-                         "<start_scan target='%s' ports='%s' scan_id='%s'>"
-                         "<scanner_params>%s</scanner_params></start_scan>",
-                         target, ports ? ports : "", scan_id ? scan_id : "",
-                         options_str ? options_str : "");
-  g_free (options_str);
+  rc = osp_send_command (connection, &entity, "%s", xml->str);
+  g_string_free (xml, TRUE);
   if (rc)
     {
       if (error)
@@ -1125,8 +1678,11 @@ vt_group_append_as_xml (osp_vt_group_t *vt_group, GString *xml_string)
 static void
 vt_value_append_as_xml (gpointer id, gchar *value, GString *xml_string)
 {
-  xml_string_append (xml_string, "<vt_value id=\"%s\">%s</vt_value>",
-                     id ? id : "", value ? value : "");
+  g_string_append (xml_string, "<vt_value id=\"");
+  xml_string_append_text (xml_string, id, -1);
+  g_string_append (xml_string, "\">");
+  xml_string_append_text (xml_string, value, -1);
+  g_string_append (xml_string, "</vt_value>");
 }
 
 /**
@@ -1138,10 +1694,38 @@ vt_value_append_as_xml (gpointer id, gchar *value, GString *xml_string)
 static void
 vt_single_append_as_xml (osp_vt_single_t *vt_single, GString *xml_string)
 {
-  xml_string_append (xml_string, "<vt_single id=\"%s\">", vt_single->vt_id);
+  g_string_append (xml_string, "<vt_single id=\"");
+  xml_string_append_text (xml_string, vt_single->vt_id, -1);
+  g_string_append (xml_string, "\">");
   g_hash_table_foreach (vt_single->vt_values, (GHFunc) vt_value_append_as_xml,
                         xml_string);
-  xml_string_append (xml_string, "</vt_single>");
+  g_string_append (xml_string, "</vt_single>");
+}
+
+/**
+ * @brief Size of the chunks a start_scan command is sent in.
+ */
+#define START_SCAN_CHUNK_SIZE 65536
+
+/**
+ * @brief Send the XML built so far and empty the buffer.
+ *
+ * @param[in]     connection  Connection to an OSP server.
+ * @param[in,out] xml         XML to send.
+ *
+ * @return 0 on success, 1 if error.
+ */
+static int
+osp_send_chunk (osp_connection_t *connection, GString *xml)
+{
+  int rc;
+
+  if (*connection->host == '/')
+    rc = gvm_socket_send (connection->socket, xml->str, xml->len);
+  else
+    rc = gvm_server_send (&connection->session, xml->str, xml->len);
+  g_string_truncate (xml, 0);
+  return rc ? 1 : 0;
 }
 
 /**
@@ -1157,15 +1741,10 @@ int
 osp_start_scan_ext (osp_connection_t *connection, osp_start_scan_opts_t opts,
                     char **error)
 {
-  gchar *scanner_params_xml = NULL;
   GString *xml;
   GSList *list_item;
-  int list_count;
   int rc, status;
   entity_t entity;
-  gchar *cmd;
-  char filename[] = "/tmp/osp-cmd-XXXXXX";
-  int fd;
 
   if (!connection)
     {
@@ -1175,12 +1754,13 @@ osp_start_scan_ext (osp_connection_t *connection, osp_start_scan_opts_t opts,
       return -1;
     }
 
-  fd = mkstemp (filename);
-  FILE *file = fdopen (fd, "w");
+  /* The command is sent in chunks while it is built, so that a selection of
+   * many VTs is never held in memory as a whole. */
 
-  xml = g_string_sized_new (10240);
-  g_string_append (xml, "<start_scan");
-  xml_string_append (xml, " scan_id=\"%s\">", opts.scan_id ? opts.scan_id : "");
+  xml = g_string_sized_new (START_SCAN_CHUNK_SIZE + 10240);
+  g_string_append (xml, "<start_scan scan_id=\"");
+  xml_string_append_text (xml, opts.scan_id, -1);
+  g_string_append (xml, "\">");
 
   g_string_append (xml, "<targets>");
   g_slist_foreach (opts.targets, (GFunc) target_append_as_xml, xml);
@@ -1188,57 +1768,32 @@ osp_start_scan_ext (osp_connection_t *connection, osp_start_scan_opts_t opts,
 
   g_string_append (xml, "<scanner_params>");
   if (opts.scanner_params)
-    {
-      scanner_params_xml = NULL;
-      g_hash_table_foreach (opts.scanner_params, (GHFunc) option_concat_as_xml,
-                            &scanner_params_xml);
-      if (scanner_params_xml)
-        g_string_append (xml, scanner_params_xml);
-      g_free (scanner_params_xml);
-    }
+    g_hash_table_foreach (opts.scanner_params, option_append_as_xml, xml);
   g_string_append (xml, "</scanner_params>");
 
   g_string_append (xml, "<vt_selection>");
   g_slist_foreach (opts.vt_groups, (GFunc) vt_group_append_as_xml, xml);
 
-  fprintf (file, "%s", xml->str);
-
-  g_string_free (xml, TRUE);
-
-  xml = g_string_new ("");
-  list_item = opts.vts;
-  list_count = 0;
-  while (list_item)
+  rc = 0;
+  for (list_item = opts.vts; list_item && rc == 0; list_item = list_item->next)
     {
-      list_count++;
       vt_single_append_as_xml (list_item->data, xml);
-
-      list_item = list_item->next;
-
-      if (list_count == 1000)
-        {
-          fprintf (file, "%s", xml->str);
-
-          g_string_free (xml, TRUE);
-          xml = g_string_new ("");
-          list_count = 0;
-        }
+      if (xml->len >= START_SCAN_CHUNK_SIZE)
+        rc = osp_send_chunk (connection, xml);
     }
 
   g_string_append (xml, "</vt_selection>");
   g_string_append (xml, "</start_scan>");
 
-  fprintf (file, "%s", xml->str);
-  fflush (file);
-  fclose (file);
+  if (rc == 0)
+    rc = osp_send_chunk (connection, xml);
   g_string_free (xml, TRUE);
 
-  g_file_get_contents (filename, &cmd, NULL, NULL);
-
-  rc = osp_send_command (connection, &entity, "%s", cmd);
-
-  g_free (cmd);
-  unlink (filename);
+  if (rc == 0)
+    {
+      connection->pending++;
+      rc = osp_connection_read (connection, &entity);
+    }
 
   if (rc)
     {
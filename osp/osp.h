@@ -33,6 +33,8 @@
 
 typedef struct osp_connection osp_connection_t;
 
+typedef struct osp_connection_pool osp_connection_pool_t;
+
 typedef struct osp_credential osp_credential_t;
 
 typedef struct osp_target osp_target_t;
@@ -93,6 +95,30 @@ osp_connection_new (const char *, int, const char *, const char *,
 void
 osp_connection_close (osp_connection_t *);
 
+int
+osp_connection_send (osp_connection_t *, const char *);
+
+int
+osp_connection_try_read (osp_connection_t *, int, entity_t *);
+
+int
+osp_connection_read (osp_connection_t *, entity_t *);
+
+/* OSP connection pooling */
+
+osp_connection_pool_t *
+osp_connection_pool_new (guint);
+
+void
+osp_connection_pool_free (osp_connection_pool_t *);
+
+osp_connection_t *
+osp_connection_pool_get (osp_connection_pool_t *, const char *, int,
+                         const char *, const char *, const char *);
+
+void
+osp_connection_pool_put (osp_connection_pool_t *, osp_connection_t *);
+
 /* OSP commands */
 int
 osp_check_feed (osp_connection_t *, int *, int *, char **, char **);
@@ -147,6 +173,22 @@ osp_get_scan (osp_connection_t *, const char *, char **, int, char **);
 int
 osp_get_scan_pop (osp_connection_t *, const char *, char **, int, int, char **);
 
+typedef struct
+{
+  const char *scan_id; ///< UUID of the scan to get.
+  int details;         ///< 0 for no scan details and results, 1 otherwise.
+  int pop_results;     ///< 0 to leave results, 1 to pop results from scanner.
+  int max_results;     ///< Maximum number of results to get, 0 for all.
+} osp_get_scan_pop_opts_t;
+
+int
+osp_get_scan_pop_ext (osp_connection_t *, osp_get_scan_pop_opts_t, char **,
+                      int *, char **);
+
+int
+osp_get_scan_pop_stream (osp_connection_t *, const char *, int, int,
+                         entity_stream_callback_t, gpointer, char **);
+
 osp_scan_status_t
 osp_get_scan_status_ext (osp_connection_t *, osp_get_scan_status_opts_t,
                          char **);
@@ -21,6 +21,7 @@
 
 #include <cgreen/cgreen.h>
 #include <cgreen/mocks.h>
+#include <sys/socket.h>
 
 Describe (osp);
 BeforeEach (osp)
@@ -98,6 +99,309 @@ Ensure (osp, target_append_as_xml)
   osp_target_free (target);
 }
 
+static int
+count_result (entity_t result, gpointer user_data)
+{
+  int *count = (int *) user_data;
+
+  if (entity_attribute (result, "name"))
+    (*count)++;
+  return 0;
+}
+
+Ensure (osp, osp_get_scan_pop_stream_passes_results_to_callback)
+{
+  osp_connection_t *conn;
+  int sockets[2];
+  int count;
+  const char *response;
+
+  assert_that (socketpair (AF_UNIX, SOCK_STREAM, 0, sockets), is_equal_to (0));
+
+  /* The response is buffered in the socket before the command is sent. */
+  response = "<get_scans_response status='200' status_text='OK'>"
+             "<scan id='s1' progress='42' status='running'>"
+             "<results>"
+             "<result name='r1'>1</result>"
+             "<result name='r2'>2</result>"
+             "</results>"
+             "</scan>"
+             "</get_scans_response>";
+  assert_that (write (sockets[1], response, strlen (response)),
+               is_equal_to (strlen (response)));
+
+  conn = g_malloc0 (sizeof (*conn));
+  conn->host = g_strdup ("/test.sock");
+  conn->socket = sockets[0];
+
+  count = 0;
+  assert_that (
+    osp_get_scan_pop_stream (conn, "s1", 0, 1, count_result, &count, NULL),
+    is_equal_to (42));
+  assert_that (count, is_equal_to (2));
+
+  osp_connection_close (conn);
+  close (sockets[1]);
+}
+
+Ensure (osp, osp_connection_read_returns_pipelined_responses_in_order)
+{
+  osp_connection_t *conn;
+  entity_t entity;
+  int sockets[2];
+  const char *responses, *rest;
+
+  assert_that (socketpair (AF_UNIX, SOCK_STREAM, 0, sockets), is_equal_to (0));
+
+  /* Both responses and the start of the third arrive in a single read. */
+  responses = "<get_scans_response status='200' status_text='OK'>"
+              "<scan id='s1'/></get_scans_response>\n"
+              "<get_scans_response status='200' status_text='OK'>"
+              "<scan id='s2'/></get_scans_response>\n"
+              "<get_scans_response status='200' status_text='OK'>"
+              "<scan id=";
+  rest = "'s3'/></get_scans_response>";
+  assert_that (write (sockets[1], responses, strlen (responses)),
+               is_equal_to (strlen (responses)));
+
+  conn = g_malloc0 (sizeof (*conn));
+  conn->host = g_strdup ("/test.sock");
+  conn->socket = sockets[0];
+
+  assert_that (osp_connection_read (conn, &entity), is_equal_to (1));
+  assert_that (osp_connection_send (conn, "<get_scans scan_id='s1'/>"),
+               is_equal_to (0));
+  assert_that (osp_connection_send (conn, "<get_scans scan_id='s2'/>"),
+               is_equal_to (0));
+  assert_that (osp_connection_send (conn, "<get_scans scan_id='s3'/>"),
+               is_equal_to (0));
+
+  assert_that (osp_connection_read (conn, &entity), is_equal_to (0));
+  assert_that (entity_attribute (entity_child (entity, "scan"), "id"),
+               is_equal_to_string ("s1"));
+  free_entity (entity);
+  assert_that (osp_connection_read (conn, &entity), is_equal_to (0));
+  assert_that (entity_attribute (entity_child (entity, "scan"), "id"),
+               is_equal_to_string ("s2"));
+  free_entity (entity);
+
+  assert_that (write (sockets[1], rest, strlen (rest)),
+               is_equal_to (strlen (rest)));
+  assert_that (osp_connection_read (conn, &entity), is_equal_to (0));
+  assert_that (entity_attribute (entity_child (entity, "scan"), "id"),
+               is_equal_to_string ("s3"));
+  free_entity (entity);
+  assert_that (conn->pending, is_equal_to (0));
+  assert_that (conn->buffer->len, is_equal_to (0));
+
+  osp_connection_close (conn);
+  close (sockets[1]);
+}
+
+Ensure (osp, osp_connection_pool_reuses_idle_connections)
+{
+  osp_connection_pool_t *pool;
+  osp_connection_t *conn;
+  gchar *credentials_hash;
+  int sockets[2];
+
+  assert_that (socketpair (AF_UNIX, SOCK_STREAM, 0, sockets), is_equal_to (0));
+
+  pool = osp_connection_pool_new (1);
+
+  conn = g_malloc0 (sizeof (*conn));
+  conn->host = g_strdup ("/nonexistent/osp.sock");
+  conn->socket = sockets[0];
+  credentials_hash =
+    g_compute_checksum_for_string (G_CHECKSUM_SHA256, "\n\n", -1);
+  conn->pool_key =
+    g_strdup_printf ("%s\n%d\n%s", conn->host, 0, credentials_hash);
+  g_free (credentials_hash);
+
+  osp_connection_pool_put (pool, conn);
+  assert_that (osp_connection_pool_get (pool, "/nonexistent/osp.sock", 0, NULL,
+                                        NULL, NULL),
+               is_equal_to (conn));
+
+  /* Data waiting on an idle connection means it cannot be reused. */
+  osp_connection_pool_put (pool, conn);
+  assert_that (write (sockets[1], "x", 1), is_equal_to (1));
+  assert_that (osp_connection_pool_get (pool, "/nonexistent/osp.sock", 0, NULL,
+                                        NULL, NULL),
+               is_null);
+
+  osp_connection_pool_free (pool);
+  close (sockets[1]);
+}
+
+Ensure (osp, osp_get_scan_pop_ext_reports_more_results)
+{
+  osp_connection_t *conn;
+  osp_get_scan_pop_opts_t opts;
+  int sockets[2];
+  int more;
+  char command[256];
+  const char *response;
+  ssize_t len;
+
+  assert_that (socketpair (AF_UNIX, SOCK_STREAM, 0, sockets), is_equal_to (0));
+
+  response = "<get_scans_response status='200' status_text='OK'>"
+             "<scan id='s1' progress='10' status='running'>"
+             "<results><result name='r1'/><result name='r2'/></results>"
+             "</scan>"
+             "</get_scans_response>";
+  assert_that (write (sockets[1], response, strlen (response)),
+               is_equal_to (strlen (response)));
+
+  conn = g_malloc0 (sizeof (*conn));
+  conn->host = g_strdup ("/test.sock");
+  conn->socket = sockets[0];
+
+  opts.scan_id = "s1";
+  opts.details = 1;
+  opts.pop_results = 1;
+  opts.max_results = 2;
+  more = 0;
+  assert_that (osp_get_scan_pop_ext (conn, opts, NULL, &more, NULL),
+               is_equal_to (10));
+  assert_that (more, is_equal_to (1));
+
+  len = read (sockets[1], command, sizeof (command) - 1);
+  assert_that (len, is_greater_than (0));
+  command[len] = '\0';
+  assert_that (command, is_equal_to_string ("<get_scans scan_id='s1'"
+                                            " details='1'"
+                                            " pop_results='1'"
+                                            " max_results='2'/>"));
+
+  osp_connection_close (conn);
+  close (sockets[1]);
+}
+
+Ensure (osp, osp_get_scan_pop_sends_details_and_pop_results)
+{
+  osp_connection_t *conn;
+  int sockets[2];
+  char command[256];
+  char *report_xml;
+  const char *response;
+  ssize_t len;
+
+  assert_that (socketpair (AF_UNIX, SOCK_STREAM, 0, sockets), is_equal_to (0));
+
+  response = "<get_scans_response status='200' status_text='OK'>"
+             "<scan id='s1' progress='30' status='running'/>"
+             "</get_scans_response>";
+  assert_that (write (sockets[1], response, strlen (response)),
+               is_equal_to (strlen (response)));
+
+  conn = g_malloc0 (sizeof (*conn));
+  conn->host = g_strdup ("/test.sock");
+  conn->socket = sockets[0];
+
+  report_xml = NULL;
+  assert_that (osp_get_scan_pop (conn, "s1", &report_xml, 0, 1, NULL),
+               is_equal_to (30));
+  assert_that (report_xml, is_not_null);
+  g_free (report_xml);
+
+  len = read (sockets[1], command, sizeof (command) - 1);
+  assert_that (len, is_greater_than (0));
+  command[len] = '\0';
+  assert_that (command, is_equal_to_string ("<get_scans scan_id='s1'"
+                                            " details='0'"
+                                            " pop_results='1'/>"));
+
+  osp_connection_close (conn);
+  close (sockets[1]);
+}
+
+Ensure (osp, osp_get_scan_pop_returns_status_text_on_error)
+{
+  osp_connection_t *conn;
+  int sockets[2];
+  char *error;
+  const char *response;
+
+  assert_that (socketpair (AF_UNIX, SOCK_STREAM, 0, sockets), is_equal_to (0));
+
+  response = "<get_scans_response status='404' status_text='No such scan'/>";
+  assert_that (write (sockets[1], response, strlen (response)),
+               is_equal_to (strlen (response)));
+
+  conn = g_malloc0 (sizeof (*conn));
+  conn->host = g_strdup ("/test.sock");
+  conn->socket = sockets[0];
+
+  error = NULL;
+  assert_that (osp_get_scan_pop (conn, "s1", NULL, 1, 0, &error),
+               is_equal_to (-1));
+  assert_that (error, is_equal_to_string ("No such scan"));
+  g_free (error);
+
+  osp_connection_close (conn);
+  close (sockets[1]);
+}
+
+Ensure (osp, osp_start_scan_ext_sends_current_vt_values)
+{
+  osp_connection_t *conn;
+  osp_start_scan_opts_t opts;
+  osp_vt_single_t *vt;
+  int sockets[2];
+  char command[1024];
+  const char *response;
+  ssize_t len;
+
+  assert_that (socketpair (AF_UNIX, SOCK_STREAM, 0, sockets), is_equal_to (0));
+
+  response = "<start_scan_response status='200' status_text='OK'/>";
+  assert_that (write (sockets[1], response, strlen (response)),
+               is_equal_to (strlen (response)));
+
+  conn = g_malloc0 (sizeof (*conn));
+  conn->host = g_strdup ("/test.sock");
+  conn->socket = sockets[0];
+
+  vt = osp_vt_single_new ("1.2.3");
+  osp_vt_single_add_value (vt, "1", "a&b");
+
+  memset (&opts, 0, sizeof (opts));
+  opts.scan_id = "s1";
+  opts.vts = g_slist_append (NULL, vt);
+
+  assert_that (osp_start_scan_ext (conn, opts, NULL), is_equal_to (0));
+  len = read (sockets[1], command, sizeof (command) - 1);
+  assert_that (len, is_greater_than (0));
+  command[len] = '\0';
+  assert_that (command,
+               is_equal_to_string ("<start_scan scan_id=\"s1\">"
+                                   "<targets></targets>"
+                                   "<scanner_params></scanner_params>"
+                                   "<vt_selection>"
+                                   "<vt_single id=\"1.2.3\">"
+                                   "<vt_value id=\"1\">a&amp;b</vt_value>"
+                                   "</vt_single>"
+                                   "</vt_selection>"
+                                   "</start_scan>"));
+
+  /* A changed VT value is serialized again by the next start_scan. */
+  osp_vt_single_add_value (vt, "1", "c");
+  assert_that (write (sockets[1], response, strlen (response)),
+               is_equal_to (strlen (response)));
+  assert_that (osp_start_scan_ext (conn, opts, NULL), is_equal_to (0));
+  len = read (sockets[1], command, sizeof (command) - 1);
+  assert_that (len, is_greater_than (0));
+  command[len] = '\0';
+  assert_that (command,
+               contains_string ("<vt_value id=\"1\">c</vt_value>"));
+
+  g_slist_free_full (opts.vts, (GDestroyNotify) osp_vt_single_free);
+  osp_connection_close (conn);
+  close (sockets[1]);
+}
+
 /* Test suite. */
 
 int
@@ -113,6 +417,19 @@ main (int argc, char **argv)
   add_test_with_context (suite, osp, osp_new_conn_ret_null);
   add_test_with_context (suite, osp, osp_target_add_alive_test_methods);
   add_test_with_context (suite, osp, target_append_as_xml);
+  add_test_with_context (suite, osp,
+                         osp_get_scan_pop_stream_passes_results_to_callback);
+  add_test_with_context (
+    suite, osp, osp_connection_read_returns_pipelined_responses_in_order);
+  add_test_with_context (suite, osp,
+                         osp_connection_pool_reuses_idle_connections);
+  add_test_with_context (suite, osp, osp_get_scan_pop_ext_reports_more_results);
+  add_test_with_context (suite, osp,
+                         osp_get_scan_pop_sends_details_and_pop_results);
+  add_test_with_context (suite, osp,
+                         osp_get_scan_pop_returns_status_text_on_error);
+  add_test_with_context (suite, osp,
+                         osp_start_scan_ext_sends_current_vt_values);
 
   if (argc > 1)
     return run_single_test (suite, argv[1], create_text_reporter ());
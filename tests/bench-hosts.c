@@ -0,0 +1,338 @@
+/* Copyright (C) 2022 Greenbone Networks GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * @file
+ * @brief Stand-alone tool to benchmark module "hosts".
+ *
+ * This file generates synthetic target definitions (large CIDR blocks, long
+ * mixed host lists, heavy exclude lists and IPv6 ranges) and measures the
+ * time and peak resident set size of parsing, deduplicating, excluding,
+ * shuffling and looking up hosts in them.
+ *
+ * Usage: bench-hosts [rounds [workload]]
+ */
+
+#include "../base/hosts.h" /* for gvm_hosts_new_with_max, gvm_hosts_... */
+
+#include <arpa/inet.h> /* for inet_pton */
+#include <glib.h>      /* for g_string_new, g_get_monotonic_time, ... */
+#include <stdio.h>     /* for printf, fprintf, fopen, fgets, NULL, stderr */
+#include <stdlib.h>    /* for atoi, atol */
+#include <string.h>    /* for strcmp, strncmp */
+
+/**
+ * @brief Number of lookups done with gvm_host_find_in_hosts per round.
+ *
+ * Each lookup is linear in the size of the collection, so this is kept
+ * well below the size of the collections.
+ */
+#define BENCH_FIND_LOOKUPS 200
+
+/**
+ * @brief A single benchmark workload.
+ */
+typedef struct
+{
+  const char *name;   /**< Name of the workload, used for selection. */
+  gchar *hosts_str;   /**< Target definition. */
+  gchar *exclude_str; /**< Exclude definition, NULL for none. */
+  unsigned int max;   /**< Max hosts passed to the *_with_max functions. */
+} bench_workload_t;
+
+/**
+ * @brief Reset the peak RSS (VmHWM) of the process.
+ *
+ * Supported since Linux 4.0. If it fails, the reported peak RSS is the peak
+ * since process start.
+ */
+static void
+peak_rss_reset (void)
+{
+  FILE *file;
+
+  file = fopen ("/proc/self/clear_refs", "w");
+  if (file == NULL)
+    return;
+  fputs ("5", file);
+  fclose (file);
+}
+
+/**
+ * @brief Get the peak RSS (VmHWM) of the process.
+ *
+ * @return Peak RSS in kB, 0 if unknown.
+ */
+static long
+peak_rss_kb (void)
+{
+  FILE *file;
+  char line[256];
+  long kb = 0;
+
+  file = fopen ("/proc/self/status", "r");
+  if (file == NULL)
+    return 0;
+  while (fgets (line, sizeof (line), file))
+    if (strncmp (line, "VmHWM:", 6) == 0)
+      {
+        kb = atol (line + 6);
+        break;
+      }
+  fclose (file);
+  return kb;
+}
+
+/**
+ * @brief Print the result of a measurement.
+ *
+ * @param[in] workload  Workload name.
+ * @param[in] operation Name of the measured operation.
+ * @param[in] start     Start time, from g_get_monotonic_time.
+ * @param[in] count     Number of hosts after the operation.
+ */
+static void
+bench_report (const char *workload, const char *operation, gint64 start,
+              size_t count)
+{
+  gint64 elapsed = g_get_monotonic_time () - start;
+
+  printf ("%-10s %-10s %10.3f ms %10ld kB %10zu hosts\n", workload, operation,
+          elapsed / 1000.0, peak_rss_kb (), count);
+}
+
+/**
+ * @brief Generate a large IPv4 CIDR workload.
+ */
+static gchar *
+gen_cidr4 (void)
+{
+  return g_strdup ("10.0.0.0/14");
+}
+
+/**
+ * @brief Generate a 100k element list mixing single IPv4 addresses, short
+ *        ranges, hostnames and IPv6 addresses, with ~10% duplicates.
+ */
+static gchar *
+gen_mixed (void)
+{
+  GString *str = g_string_new (NULL);
+  int i;
+
+  for (i = 0; i < 100000; i++)
+    {
+      int n = i % 10 == 9 ? i / 2 : i;
+
+      if (str->len)
+        g_string_append_c (str, ',');
+      switch (n % 4)
+        {
+        case 0:
+          g_string_append_printf (str, "10.%d.%d.%d", (n >> 16) & 0xff,
+                                  (n >> 8) & 0xff, n & 0xff);
+          break;
+        case 1:
+          g_string_append_printf (str, "172.16.%d.1-4", n & 0xff);
+          break;
+        case 2:
+          g_string_append_printf (str, "host-%d.example.com", n);
+          break;
+        default:
+          g_string_append_printf (str, "2001:db8::%x:%x", (n >> 16) & 0xffff,
+                                  n & 0xffff);
+          break;
+        }
+    }
+  return g_string_free (str, FALSE);
+}
+
+/**
+ * @brief Generate a /16 target with an exclude list of 20k single addresses
+ *        and short ranges.
+ */
+static gchar *
+gen_exclude (void)
+{
+  GString *str = g_string_new (NULL);
+  int i;
+
+  for (i = 0; i < 20000; i++)
+    {
+      if (str->len)
+        g_string_append_c (str, ',');
+      if (i % 8 == 0)
+        g_string_append_printf (str, "192.168.%d.%d-%d", (i * 3) & 0xff,
+                                i & 0x7f, (i & 0x7f) + 64);
+      else
+        g_string_append_printf (str, "192.168.%d.%d", (i * 7) & 0xff,
+                                (i * 13) & 0xff);
+    }
+  return g_string_free (str, FALSE);
+}
+
+/**
+ * @brief Generate an IPv6 workload of a CIDR block and long/short ranges.
+ */
+static gchar *
+gen_ipv6 (void)
+{
+  return g_strdup ("2001:db8::/112,2001:db8:1::1:0-2001:db8:1::2:ffff,"
+                   "2001:db8:2::1-ffff");
+}
+
+/**
+ * @brief Run all operations of a workload once.
+ *
+ * @param[in] workload  The workload.
+ *
+ * @return 0 on success, -1 on error.
+ */
+static int
+bench_run (const bench_workload_t *workload)
+{
+  gvm_hosts_t *hosts;
+  gint64 start;
+  size_t i, step;
+
+  peak_rss_reset ();
+  start = g_get_monotonic_time ();
+  hosts = gvm_hosts_new_with_max (workload->hosts_str, workload->max);
+  if (hosts == NULL)
+    {
+      fprintf (stderr, "%s: Failed to parse hosts.\n", workload->name);
+      return -1;
+    }
+  bench_report (workload->name, "new", start, gvm_hosts_count (hosts));
+  if (gvm_hosts_duplicated (hosts))
+    printf ("%-10s %-10s %10u duplicates removed\n", workload->name, "dedup",
+            gvm_hosts_duplicated (hosts));
+
+  if (workload->exclude_str)
+    {
+      peak_rss_reset ();
+      start = g_get_monotonic_time ();
+      if (gvm_hosts_exclude_with_max (hosts, workload->exclude_str,
+                                      workload->max)
+          == -1)
+        {
+          fprintf (stderr, "%s: Failed to exclude hosts.\n", workload->name);
+          gvm_hosts_free (hosts);
+          return -1;
+        }
+      bench_report (workload->name, "exclude", start, gvm_hosts_count (hosts));
+    }
+
+  peak_rss_reset ();
+  start = g_get_monotonic_time ();
+  gvm_hosts_shuffle (hosts);
+  bench_report (workload->name, "shuffle", start, gvm_hosts_count (hosts));
+
+  /* Resolving is a no-op for IP addresses, but deduplicates again if any
+   * hostname resolves. Only run it where no DNS lookups are involved. */
+  if (strcmp (workload->name, "mixed"))
+    {
+      GSList *unresolved;
+
+      peak_rss_reset ();
+      start = g_get_monotonic_time ();
+      unresolved = gvm_hosts_resolve (hosts);
+      bench_report (workload->name, "resolve", start, gvm_hosts_count (hosts));
+      g_slist_free_full (unresolved, g_free);
+    }
+
+  peak_rss_reset ();
+  start = g_get_monotonic_time ();
+  step = gvm_hosts_count (hosts) / BENCH_FIND_LOOKUPS;
+  if (step == 0)
+    step = 1;
+  for (i = 0; i < gvm_hosts_count (hosts); i += step)
+    {
+      struct in6_addr addr;
+      gvm_host_t *host = hosts->hosts[gvm_hosts_count (hosts) - 1 - i];
+
+      if (gvm_host_type (host) == HOST_TYPE_NAME)
+        {
+          if (gvm_host_find_in_hosts (host, NULL, hosts) == NULL)
+            fprintf (stderr, "%s: Host not found.\n", workload->name);
+          continue;
+        }
+      gvm_host_get_addr6 (host, &addr);
+      if (gvm_host_find_in_hosts (host, &addr, hosts) == NULL)
+        fprintf (stderr, "%s: Host not found.\n", workload->name);
+    }
+  bench_report (workload->name, "find", start, gvm_hosts_count (hosts));
+
+  gvm_hosts_free (hosts);
+  return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  bench_workload_t workloads[4];
+  int rounds = 1, round, i, ret = 0;
+
+  if (argc > 1)
+    rounds = atoi (argv[1]);
+  if (rounds <= 0)
+    {
+      fprintf (stderr, "Usage: %s [rounds [cidr4|mixed|exclude|ipv6]]\n",
+               argv[0]);
+      return 1;
+    }
+
+  workloads[0].name = "cidr4";
+  workloads[0].hosts_str = gen_cidr4 ();
+  workloads[0].exclude_str = NULL;
+  workloads[0].max = 0;
+  workloads[1].name = "mixed";
+  workloads[1].hosts_str = gen_mixed ();
+  workloads[1].exclude_str = NULL;
+  workloads[1].max = 0;
+  workloads[2].name = "exclude";
+  workloads[2].hosts_str = g_strdup ("192.168.0.0/16");
+  workloads[2].exclude_str = gen_exclude ();
+  workloads[2].max = 0;
+  workloads[3].name = "ipv6";
+  workloads[3].hosts_str = gen_ipv6 ();
+  workloads[3].exclude_str = g_strdup ("2001:db8::/120,2001:db8:2::1-ff");
+  workloads[3].max = 0;
+
+  printf ("%-10s %-10s %13s %13s %16s\n", "workload", "operation", "time",
+          "peak rss", "count");
+  for (round = 0; round < rounds && ret == 0; round++)
+    for (i = 0; i < (int) G_N_ELEMENTS (workloads); i++)
+      {
+        if (argc > 2 && strcmp (argv[2], workloads[i].name))
+          continue;
+        if (bench_run (&workloads[i]))
+          {
+            ret = 2;
+            break;
+          }
+      }
+
+  for (i = 0; i < (int) G_N_ELEMENTS (workloads); i++)
+    {
+      g_free (workloads[i].hosts_str);
+      g_free (workloads[i].exclude_str);
+    }
+  return ret;
+}
@@ -0,0 +1,329 @@
+/* Copyright (C) 2022 Greenbone Networks GmbH
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+/**
+ * @file
+ * @brief Stand-alone tool to benchmark the XML readers of module "xmlutils".
+ *
+ * This file generates a synthetic scan report with many results and measures
+ * the time and peak resident set size of reading it from a socket into an
+ * entity_t tree (GMarkup) and into an element_t tree (libxml2), including a
+ * walk over all results.
+ *
+ * Usage: bench-xml [rounds [results]]
+ */
+
+#include "../util/xmlutils.h" /* for read_entity_s, read_element_s, ... */
+
+#include <glib.h>       /* for g_string_new, g_get_monotonic_time, ... */
+#include <stdio.h>      /* for printf, fprintf, fopen, fgets, NULL, stderr */
+#include <stdlib.h>     /* for atoi, atol */
+#include <string.h>     /* for strncmp */
+#include <sys/socket.h> /* for socketpair, send, shutdown */
+#include <unistd.h>     /* for close */
+
+/**
+ * @brief Default number of results in the generated report.
+ */
+#define BENCH_RESULTS 50000
+
+/**
+ * @brief Data written to the reading side of the benchmark.
+ */
+typedef struct
+{
+  int socket;        /**< Socket to write to. */
+  const GString *xml; /**< Report to write. */
+} bench_writer_t;
+
+/**
+ * @brief Reset the peak RSS (VmHWM) of the process.
+ *
+ * Supported since Linux 4.0. If it fails, the reported peak RSS is the peak
+ * since process start.
+ */
+static void
+peak_rss_reset (void)
+{
+  FILE *file;
+
+  file = fopen ("/proc/self/clear_refs", "w");
+  if (file == NULL)
+    return;
+  fputs ("5", file);
+  fclose (file);
+}
+
+/**
+ * @brief Get the peak RSS (VmHWM) of the process.
+ *
+ * @return Peak RSS in kB, 0 if unknown.
+ */
+static long
+peak_rss_kb (void)
+{
+  FILE *file;
+  char line[256];
+  long kb = 0;
+
+  file = fopen ("/proc/self/status", "r");
+  if (file == NULL)
+    return 0;
+  while (fgets (line, sizeof (line), file))
+    if (strncmp (line, "VmHWM:", 6) == 0)
+      {
+        kb = atol (line + 6);
+        break;
+      }
+  fclose (file);
+  return kb;
+}
+
+/**
+ * @brief Print the result of a measurement.
+ *
+ * @param[in] reader  Name of the measured reader.
+ * @param[in] start   Start time, from g_get_monotonic_time.
+ * @param[in] count   Number of results found in the tree.
+ */
+static void
+bench_report (const char *reader, gint64 start, size_t count)
+{
+  gint64 elapsed = g_get_monotonic_time () - start;
+
+  printf ("%-10s %10.3f ms %10ld kB %10zu results\n", reader,
+          elapsed / 1000.0, peak_rss_kb (), count);
+}
+
+/**
+ * @brief Generate a report in the format of an OSP get_scans response.
+ *
+ * @param[in] results  Number of results.
+ *
+ * @return Report.
+ */
+static GString *
+gen_report (int results)
+{
+  GString *xml = g_string_new (NULL);
+  int i;
+
+  g_string_append (xml, "<get_scans_response status=\"200\" status_text=\"OK\">"
+                        "<scan id=\"f8b5f3d4-3c2a-4e51-9e2b-7b8f4a0e1d2c\""
+                        " target=\"192.168.0.0/16\" progress=\"100\""
+                        " status=\"finished\"><results>");
+  for (i = 0; i < results; i++)
+    g_string_append_printf (
+      xml,
+      "<result name=\"Result %d\" type=\"Alarm\" severity=\"%d.%d\""
+      " host=\"192.168.%d.%d\" hostname=\"host-%d.example.com\""
+      " test_id=\"1.3.6.1.4.1.25623.1.0.%d\" port=\"%d/tcp\" qod=\"80\""
+      " uri=\"\">Installed version: %d.%d &amp; fixed version: %d.%d"
+      " &lt;see references&gt;</result>",
+      i, i % 10, i % 7, (i >> 8) & 0xff, i & 0xff, i, 100000 + i % 5000,
+      1 + i % 65535, i % 3, i % 11, i % 3 + 1, i % 11);
+  g_string_append (xml, "</results></scan></get_scans_response>");
+  return xml;
+}
+
+/**
+ * @brief Write the report to the socket, from a separate thread.
+ *
+ * @param[in] data  The bench_writer_t.
+ *
+ * @return NULL.
+ */
+static gpointer
+bench_write (gpointer data)
+{
+  bench_writer_t *writer = data;
+  gsize offset = 0;
+
+  while (offset < writer->xml->len)
+    {
+      ssize_t count;
+
+      /* No SIGPIPE if the reader has shut down after a failed read. */
+      count = send (writer->socket, writer->xml->str + offset,
+                    writer->xml->len - offset, MSG_NOSIGNAL);
+      if (count <= 0)
+        break;
+      offset += count;
+    }
+  return NULL;
+}
+
+/**
+ * @brief Start writing the report into a new socket pair.
+ *
+ * @param[in]  writer   Writer, filled in.
+ * @param[in]  xml      Report to write.
+ * @param[out] sockets  The socket pair.  Read from sockets[0].
+ *
+ * @return Writer thread, NULL on error.
+ */
+static GThread *
+bench_writer_start (bench_writer_t *writer, const GString *xml, int *sockets)
+{
+  if (socketpair (AF_UNIX, SOCK_STREAM, 0, sockets))
+    {
+      perror ("socketpair");
+      return NULL;
+    }
+  writer->socket = sockets[1];
+  writer->xml = xml;
+  return g_thread_new ("bench-xml-writer", bench_write, writer);
+}
+
+/**
+ * @brief Wait for the writer and close the socket pair.
+ *
+ * The reading side is shut down first, so that a writer still blocked on a
+ * full socket buffer after a failed read gets an error instead of waiting
+ * forever.
+ *
+ * @param[in] thread   Writer thread.
+ * @param[in] sockets  The socket pair.
+ */
+static void
+bench_writer_finish (GThread *thread, int *sockets)
+{
+  shutdown (sockets[0], SHUT_RDWR);
+  g_thread_join (thread);
+  close (sockets[0]);
+  close (sockets[1]);
+}
+
+/**
+ * @brief Read the report into an entity_t tree and walk the results.
+ *
+ * @param[in] xml  Report.
+ *
+ * @return 0 on success, -1 on error.
+ */
+static int
+bench_entity (const GString *xml)
+{
+  bench_writer_t writer;
+  GThread *thread;
+  entity_t entity, results;
+  entities_t children;
+  int sockets[2];
+  size_t count = 0;
+  gint64 start;
+
+  peak_rss_reset ();
+  start = g_get_monotonic_time ();
+  thread = bench_writer_start (&writer, xml, sockets);
+  if (thread == NULL)
+    return -1;
+  if (read_entity_s (sockets[0], &entity))
+    {
+      fprintf (stderr, "entity: Failed to read report.\n");
+      bench_writer_finish (thread, sockets);
+      return -1;
+    }
+  results = entity_child (entity_child (entity, "scan"), "results");
+  children = results ? results->entities : NULL;
+  while (first_entity (children))
+    {
+      if (entity_attribute (first_entity (children), "host"))
+        count++;
+      children = next_entities (children);
+    }
+  bench_report ("entity", start, count);
+
+  free_entity (entity);
+  bench_writer_finish (thread, sockets);
+  return 0;
+}
+
+/**
+ * @brief Read the report into an element_t tree and walk the results.
+ *
+ * @param[in] xml  Report.
+ *
+ * @return 0 on success, -1 on error.
+ */
+static int
+bench_element (const GString *xml)
+{
+  bench_writer_t writer;
+  GThread *thread;
+  element_t element, result;
+  int sockets[2];
+  size_t count = 0;
+  gint64 start;
+
+  peak_rss_reset ();
+  start = g_get_monotonic_time ();
+  thread = bench_writer_start (&writer, xml, sockets);
+  if (thread == NULL)
+    return -1;
+  if (read_element_s (sockets[0], &element))
+    {
+      fprintf (stderr, "element: Failed to read report.\n");
+      bench_writer_finish (thread, sockets);
+      return -1;
+    }
+  result = element_first_child (
+    element_child (element_child (element, "scan"), "results"));
+  while (result)
+    {
+      gchar *host;
+
+      host = element_attribute (result, "host");
+      if (host)
+        count++;
+      g_free (host);
+      result = element_next (result);
+    }
+  bench_report ("element", start, count);
+
+  element_free (element);
+  bench_writer_finish (thread, sockets);
+  return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  GString *xml;
+  int rounds = 1, results = BENCH_RESULTS, round, ret = 0;
+
+  if (argc > 1)
+    rounds = atoi (argv[1]);
+  if (argc > 2)
+    results = atoi (argv[2]);
+  if (rounds <= 0 || results <= 0)
+    {
+      fprintf (stderr, "Usage: %s [rounds [results]]\n", argv[0]);
+      return 1;
+    }
+
+  xml = gen_report (results);
+  printf ("report of %d results, %zu bytes\n", results, xml->len);
+  printf ("%-10s %13s %13s %18s\n", "reader", "time", "peak rss", "count");
+  for (round = 0; round < rounds && ret == 0; round++)
+    if (bench_entity (xml) || bench_element (xml))
+      ret = 2;
+
+  g_string_free (xml, TRUE);
+  return ret;
+}
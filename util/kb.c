@@ -899,6 +899,52 @@ redis_push_str (kb_t kb, const char *name, const char *value)
   return rc;
 }
 
+/**
+ * @brief Push several entries under a given key with one command.
+ *
+ * The entries end up in the same order as if pushed one after the other with
+ * redis_push_str().
+ *
+ * @param[in] kb  KB handle where to store the items.
+ * @param[in] name  Key to push to.
+ * @param[in] values Values to push.
+ * @param[in] count Number of values.
+ *
+ * @return 0 on success, non-null on error.
+ */
+static int
+redis_push_strs (kb_t kb, const char *name, const char **values, size_t count)
+{
+  struct kb_redis *kbr;
+  redisReply *rep = NULL;
+  const char **argv;
+  int rc = 0;
+
+  if (!values)
+    return -1;
+  if (count == 0)
+    return 0;
+
+  kbr = redis_kb (kb);
+  if (get_redis_ctx (kbr) < 0)
+    return -1;
+
+  /* LPUSH name value1 ... valueN */
+  argv = g_malloc ((count + 2) * sizeof (*argv));
+  argv[0] = "LPUSH";
+  argv[1] = name;
+  memcpy (argv + 2, values, count * sizeof (*argv));
+  rep = redisCommandArgv (kbr->rctx, count + 2, argv, NULL);
+  g_free (argv);
+  if (!rep || rep->type == REDIS_REPLY_ERROR)
+    rc = -1;
+
+  if (rep)
+    freeReplyObject (rep);
+
+  return rc;
+}
+
 /**
  * @brief Pops a single KB string item.
  *
@@ -1865,6 +1911,7 @@ static const struct kb_operations KBRedisOperations = {
   .kb_get_nvt_all = redis_get_nvt_all,
   .kb_get_nvt_oids = redis_get_oids,
   .kb_push_str = redis_push_str,
+  .kb_push_strs = redis_push_strs,
   .kb_pop_str = redis_pop_str,
   .kb_get_all = redis_get_all,
   .kb_get_pattern = redis_get_pattern,
@@ -230,6 +230,14 @@ struct kb_operations
   int (*kb_lnk_reset) (kb_t);           /**< Reset connection to KB. */
   int (*kb_flush) (kb_t, const char *); /**< Flush redis DB. */
   int (*kb_get_kb_index) (kb_t);        /**< Get kb index. */
+
+  /* Added after the other members, so that their offsets stay the same for
+   * consumers built against older headers. */
+  /**
+   * Function provided by an implementation to push several values under a key
+   * at once. Optional.
+   */
+  int (*kb_push_strs) (kb_t, const char *, const char **, size_t);
 };
 
 /**
@@ -409,6 +417,36 @@ kb_item_push_str (kb_t kb, const char *name, const char *value)
   return kb->kb_ops->kb_push_str (kb, name, value);
 }
 
+/**
+ * @brief Push new values under a given key.
+ *
+ * Same as pushing the values one after the other with kb_item_push_str(), but
+ * in one operation if the implementation supports it.
+ *
+ * @param[in] kb     KB handle where to store the items.
+ * @param[in] name   Key to push to.
+ * @param[in] values Values to push.
+ * @param[in] count  Number of values.
+ * @return 0 on success, non-null on error.
+ */
+static inline int
+kb_item_push_strs (kb_t kb, const char *name, const char **values,
+                   size_t count)
+{
+  assert (kb);
+  assert (kb->kb_ops);
+
+  if (kb->kb_ops->kb_push_strs == NULL)
+    {
+      for (size_t i = 0; i < count; i++)
+        if (kb_item_push_str (kb, name, values[i]))
+          return -1;
+      return 0;
+    }
+
+  return kb->kb_ops->kb_push_strs (kb, name, values, count);
+}
+
 /**
  * @brief Pop a single KB string item.
  * @param[in] kb  KB handle where to fetch the item.
@@ -58,6 +58,94 @@ server_new_internal (unsigned int, const char *, const gchar *, const gchar *,
                      const gchar *, gnutls_session_t *,
                      gnutls_certificate_credentials_t *);
 
+/* Tracing. */
+
+/**
+ * @brief Maximum number of payload bytes included in each debug message.
+ */
+static gsize trace_limit = GVM_TRACE_PAYLOAD_DEFAULT;
+
+/**
+ * @brief Number of payload bytes sent, updated atomically.
+ *
+ * 64 bits wide on all platforms, so long running processes do not wrap the
+ * counter after 4 GiB on 32 bit systems.
+ */
+static guint64 trace_bytes_sent = 0;
+
+/**
+ * @brief Number of payload bytes received, updated atomically.
+ */
+static guint64 trace_bytes_received = 0;
+
+/**
+ * @brief Set how much of each payload is included in debug messages.
+ *
+ * Formatting whole payloads is expensive for large transfers even if debug
+ * messages are filtered out afterwards, so payloads are truncated.
+ *
+ * @param[in]  limit  Maximum number of payload bytes per message.  0 to trace
+ *                    no payload at all, G_MAXSIZE to trace all of it.
+ */
+void
+gvm_server_set_trace_limit (gsize limit)
+{
+  trace_limit = limit;
+}
+
+/**
+ * @brief Count payload sent or received and log the start of it.
+ *
+ * @param[in]  direction  Whether the payload was sent or received.
+ * @param[in]  payload    Payload.
+ * @param[in]  length     Length of payload.
+ * @param[in]  quiet      Whether to only count the payload.  Useful for
+ *                        hiding passwords.
+ */
+void
+gvm_server_trace (gvm_trace_direction_t direction, const char *payload,
+                  gsize length, int quiet)
+{
+  const char *arrow;
+  gsize limit;
+
+  if (direction == GVM_TRACE_SENT)
+    {
+      __atomic_fetch_add (&trace_bytes_sent, length, __ATOMIC_RELAXED);
+      arrow = "=>";
+    }
+  else
+    {
+      __atomic_fetch_add (&trace_bytes_received, length, __ATOMIC_RELAXED);
+      arrow = "<=";
+    }
+
+  limit = trace_limit;
+  if (quiet || limit == 0)
+    return;
+
+  if (length > limit)
+    g_debug ("%s %.*s[... %" G_GSIZE_FORMAT " more bytes]", arrow,
+             (int) MIN (limit, G_MAXINT), payload, length - limit);
+  else
+    g_debug ("%s %.*s", arrow, (int) length, payload);
+}
+
+/**
+ * @brief Get the number of payload bytes sent and received by this process.
+ *
+ * @param[out]  sent      Return location for the bytes sent, or NULL.
+ * @param[out]  received  Return location for the bytes received, or NULL.
+ */
+void
+gvm_server_trace_bytes (guint64 *sent, guint64 *received)
+{
+  if (sent)
+    *sent = __atomic_load_n (&trace_bytes_sent, __ATOMIC_RELAXED);
+  if (received)
+    *received = __atomic_load_n (&trace_bytes_received, __ATOMIC_RELAXED);
+}
+
 /* Connections. */
 
 /**
@@ -321,13 +409,15 @@ client_cert_callback (gnutls_session_t session,
  * @param[in]  pub_mem   Public key.
  * @param[in]  priv_mem  Private key.
  * @param[in]  verify    Whether to verify.
+ * @param[in]  resume    Data of an earlier session to resume, or NULL.
  *
  * @return 0 on success, -1 on error.
  */
-int
-gvm_server_open_verify (gnutls_session_t *session, const char *host, int port,
-                        const char *ca_mem, const char *pub_mem,
-                        const char *priv_mem, int verify)
+static int
+server_open_internal (gnutls_session_t *session, const char *host, int port,
+                      const char *ca_mem, const char *pub_mem,
+                      const char *priv_mem, int verify,
+                      const gnutls_datum_t *resume)
 {
   int ret;
   int server_socket;
@@ -373,6 +463,10 @@ gvm_server_open_verify (gnutls_session_t *session, const char *host, int port,
                                                 client_cert_callback);
     }
 
+  if (resume && resume->size
+      && gnutls_session_set_data (*session, resume->data, resume->size))
+    g_debug ("%s: Failed to set data of session to resume", __func__);
+
   /* Create the port string. */
 
   port_string = g_strdup_printf ("%i", port);
@@ -458,6 +552,55 @@ gvm_server_open_verify (gnutls_session_t *session, const char *host, int port,
   return server_socket;
 }
 
+/**
+ * @brief Connect to the server using a given host, port and cert.
+ *
+ * @param[in]  session   Pointer to GNUTLS session.
+ * @param[in]  host      Host to connect to.
+ * @param[in]  port      Port to connect to.
+ * @param[in]  ca_mem    CA cert.
+ * @param[in]  pub_mem   Public key.
+ * @param[in]  priv_mem  Private key.
+ * @param[in]  verify    Whether to verify.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int
+gvm_server_open_verify (gnutls_session_t *session, const char *host, int port,
+                        const char *ca_mem, const char *pub_mem,
+                        const char *priv_mem, int verify)
+{
+  return server_open_internal (session, host, port, ca_mem, pub_mem, priv_mem,
+                               verify, NULL);
+}
+
+/**
+ * @brief Connect to the server, resuming an earlier TLS session if possible.
+ *
+ * Verify if all cert args are given.  If the server does not accept the
+ * session data a full handshake is done.
+ *
+ * @param[in]  session   Pointer to GNUTLS session.
+ * @param[in]  host      Host to connect to.
+ * @param[in]  port      Port to connect to.
+ * @param[in]  ca_mem    CA cert.
+ * @param[in]  pub_mem   Public key.
+ * @param[in]  priv_mem  Private key.
+ * @param[in]  resume    Data of the earlier session from
+ *                       gnutls_session_get_data2, or NULL.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int
+gvm_server_open_with_cert_resume (gnutls_session_t *session, const char *host,
+                                  int port, const char *ca_mem,
+                                  const char *pub_mem, const char *priv_mem,
+                                  const gnutls_datum_t *resume)
+{
+  return server_open_internal (session, host, port, ca_mem, pub_mem, priv_mem,
+                               ca_mem && pub_mem && priv_mem, resume);
+}
+
 /**
  * @brief Connect to the server using a given host, port and cert.
  *
@@ -592,35 +735,114 @@ gvm_server_attach (int socket, gnutls_session_t *session)
 }
 
 /**
- * @brief Send a string to the server.
+ * @brief Largest output buffer kept for the next command, in bytes.
+ */
+#define SEND_BUFFER_KEEP 1048576
+
+/**
+ * @brief Free an output buffer.
+ *
+ * @param[in]  buffer  Output buffer.
+ */
+static void
+send_buffer_free (gpointer buffer)
+{
+  g_string_free ((GString *) buffer, TRUE);
+}
+
+/**
+ * @brief Output buffer of the thread, reused for every formatted command.
+ */
+static GPrivate send_buffer = G_PRIVATE_INIT (send_buffer_free);
+
+/**
+ * @brief Format a command into the output buffer of the thread.
+ *
+ * A command which is only a string ("%s") is not copied at all.
+ *
+ * @param[in]   fmt     Format of string to send.
+ * @param[in]   ap      Args for fmt.
+ * @param[out]  length  Length of the formatted string.
+ *
+ * @return The formatted string, NULL on error.
+ */
+static const char *
+send_buffer_vprintf (const char *fmt, va_list ap, gsize *length)
+{
+  GString *buffer;
+  va_list aq;
+  int len;
+
+  if (strcmp (fmt, "%s") == 0)
+    {
+      const char *string = va_arg (ap, const char *);
+
+      *length = string ? strlen (string) : 0;
+      return string;
+    }
+
+  buffer = g_private_get (&send_buffer);
+  if (buffer == NULL)
+    {
+      buffer = g_string_sized_new (4096);
+      g_private_set (&send_buffer, buffer);
+    }
+
+  va_copy (aq, ap);
+  len = g_vsnprintf (buffer->str, buffer->allocated_len, fmt, aq);
+  va_end (aq);
+  if (len < 0)
+    return NULL;
+  if ((gsize) len >= buffer->allocated_len)
+    {
+      g_string_set_size (buffer, len);
+      va_copy (aq, ap);
+      len = g_vsnprintf (buffer->str, buffer->allocated_len, fmt, aq);
+      va_end (aq);
+      if (len < 0)
+        return NULL;
+    }
+  buffer->len = len;
+
+  *length = len;
+  return buffer->str;
+}
+
+/**
+ * @brief Release memory of the output buffer after a large command.
+ */
+static void
+send_buffer_trim (void)
+{
+  GString *buffer;
+
+  buffer = g_private_get (&send_buffer);
+  if (buffer && buffer->allocated_len > SEND_BUFFER_KEEP)
+    g_private_replace (&send_buffer, g_string_sized_new (4096));
+}
+
+/**
+ * @brief Send a buffer to the server.
  *
  * @param[in]  session  Pointer to GNUTLS session.
- * @param[in]  fmt      Format of string to send.
- * @param[in]  ap       Args for fmt.
+ * @param[in]  string   Buffer to send.
+ * @param[in]  left     Length of buffer.
  * @param[in]  quiet    Whether to log debug and info messages.  Useful for
  *                      hiding passwords.
  *
  * @return 0 on success, 1 if server closed connection, -1 on error.
  */
 static int
-gvm_server_vsendf_internal (gnutls_session_t *session, const char *fmt,
-                            va_list ap, int quiet)
+server_send_internal (gnutls_session_t *session, const char *string,
+                      gsize left, int quiet)
 {
-  char *sref, *string;
-  int rc = 0, left;
-
-  left = vasprintf (&string, fmt, ap);
-  if (left == -1)
-    string = NULL;
-
-  sref = string;
   while (left > 0)
     {
       ssize_t count;
 
       if (quiet == 0)
-        g_debug ("   send %d from %.*s[...]", left, left < 30 ? left : 30,
-                 string);
+        g_debug ("   send %" G_GSIZE_FORMAT " from %.*s[...]", left,
+                 left < 30 ? (int) left : 30, string);
       count = gnutls_record_send (*session, string, left);
       if (count < 0)
         {
@@ -635,70 +857,55 @@ gvm_server_vsendf_internal (gnutls_session_t *session, const char *fmt,
               continue;
             }
           g_warning ("Failed to write to server: %s", gnutls_strerror (count));
-          rc = -1;
-          goto out;
+          return -1;
         }
       if (count == 0)
         {
           /* Server closed connection. */
           if (quiet == 0)
             g_debug ("=  server closed");
-          rc = 1;
-          goto out;
+          return 1;
         }
-      if (quiet == 0)
-        g_debug ("=> %.*s", (int) count, string);
+      gvm_server_trace (GVM_TRACE_SENT, string, count, quiet);
       string += count;
       left -= count;
     }
   if (quiet == 0)
     g_debug ("=> done");
 
-out:
-  g_free (sref);
-  return rc;
+  return 0;
 }
 
 /**
- * @brief Send a string to the server.
+ * @brief Send a buffer to the server.
  *
  * @param[in]  socket   Socket.
- * @param[in]  fmt      Format of string to send.
- * @param[in]  ap       Args for fmt.
+ * @param[in]  string   Buffer to send.
+ * @param[in]  left     Length of buffer.
  * @param[in]  quiet    Whether to log debug and info messages.  Useful for
  *                      hiding passwords.
  *
- * @return 0 on success, 1 if server closed connection, -1 on error.
+ * @return 0 on success, -1 on error.
  */
 static int
-unix_vsendf_internal (int socket, const char *fmt, va_list ap, int quiet)
+unix_send_internal (int socket, const char *string, gsize left, int quiet)
 {
-  char *string_start, *string;
-  int rc = 0, left;
-
-  left = vasprintf (&string, fmt, ap);
-  if (left == -1)
-    string = NULL;
-
-  string_start = string;
   while (left > 0)
     {
       ssize_t count;
 
       if (quiet == 0)
-        g_debug ("   send %d from %.*s[...]", left, left < 30 ? left : 30,
-                 string);
+        g_debug ("   send %" G_GSIZE_FORMAT " from %.*s[...]", left,
+                 left < 30 ? (int) left : 30, string);
       count = write (socket, string, left);
       if (count < 0)
         {
           if (errno == EINTR || errno == EAGAIN)
             continue;
           g_warning ("Failed to write to server: %s", strerror (errno));
-          rc = -1;
-          goto out;
+          return -1;
         }
-      if (quiet == 0)
-        g_debug ("=> %.*s", (int) count, string);
+      gvm_server_trace (GVM_TRACE_SENT, string, count, quiet);
 
       string += count;
       left -= count;
@@ -706,11 +913,112 @@ unix_vsendf_internal (int socket, const char *fmt, va_list ap, int quiet)
   if (quiet == 0)
     g_debug ("=> done");
 
-out:
-  g_free (string_start);
+  return 0;
+}
+
+/**
+ * @brief Send a string to the server.
+ *
+ * @param[in]  session  Pointer to GNUTLS session.
+ * @param[in]  fmt      Format of string to send.
+ * @param[in]  ap       Args for fmt.
+ * @param[in]  quiet    Whether to log debug and info messages.  Useful for
+ *                      hiding passwords.
+ *
+ * @return 0 on success, 1 if server closed connection, -1 on error.
+ */
+static int
+gvm_server_vsendf_internal (gnutls_session_t *session, const char *fmt,
+                            va_list ap, int quiet)
+{
+  const char *string;
+  gsize length;
+  int rc;
+
+  string = send_buffer_vprintf (fmt, ap, &length);
+  if (string == NULL)
+    return -1;
+
+  rc = server_send_internal (session, string, length, quiet);
+  send_buffer_trim ();
   return rc;
 }
 
+/**
+ * @brief Send a string to the server.
+ *
+ * @param[in]  socket   Socket.
+ * @param[in]  fmt      Format of string to send.
+ * @param[in]  ap       Args for fmt.
+ * @param[in]  quiet    Whether to log debug and info messages.  Useful for
+ *                      hiding passwords.
+ *
+ * @return 0 on success, 1 if server closed connection, -1 on error.
+ */
+static int
+unix_vsendf_internal (int socket, const char *fmt, va_list ap, int quiet)
+{
+  const char *string;
+  gsize length;
+  int rc;
+
+  string = send_buffer_vprintf (fmt, ap, &length);
+  if (string == NULL)
+    return -1;
+
+  rc = unix_send_internal (socket, string, length, quiet);
+  send_buffer_trim ();
+  return rc;
+}
+
+/**
+ * @brief Send a buffer to the server, without formatting or copying it.
+ *
+ * @param[in]  session  Pointer to GNUTLS session.
+ * @param[in]  string   Buffer to send.
+ * @param[in]  length   Length of buffer.
+ *
+ * @return 0 on success, 1 if server closed connection, -1 on error.
+ */
+int
+gvm_server_send (gnutls_session_t *session, const char *string, gsize length)
+{
+  return server_send_internal (session, string, length, 0);
+}
+
+/**
+ * @brief Send a buffer to the socket, without formatting or copying it.
+ *
+ * @param[in]  socket   Socket.
+ * @param[in]  string   Buffer to send.
+ * @param[in]  length   Length of buffer.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int
+gvm_socket_send (int socket, const char *string, gsize length)
+{
+  return unix_send_internal (socket, string, length, 0);
+}
+
+/**
+ * @brief Send a buffer to the connection, without formatting or copying it.
+ *
+ * @param[in]  connection  Connection.
+ * @param[in]  string      Buffer to send.
+ * @param[in]  length      Length of buffer.
+ *
+ * @return 0 on success, 1 if server closed connection, -1 on error.
+ */
+int
+gvm_connection_send (gvm_connection_t *connection, const char *string,
+                     gsize length)
+{
+  if (connection->tls)
+    return server_send_internal (&connection->session, string, length, 0);
+  return unix_send_internal (connection->socket, string, length, 0);
+}
+
 /**
  * @brief Send a string to the connection.
  *
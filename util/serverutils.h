@@ -57,6 +57,29 @@ typedef struct
   gchar *priv_key;    ///< The private key.
 } gvm_connection_t;
 
+/**
+ * @brief Default number of payload bytes included in each debug message.
+ */
+#define GVM_TRACE_PAYLOAD_DEFAULT 256
+
+/**
+ * @brief Direction of traced payload.
+ */
+typedef enum
+{
+  GVM_TRACE_SENT,    ///< Sent to the peer.
+  GVM_TRACE_RECEIVED ///< Received from the peer.
+} gvm_trace_direction_t;
+
+void
+gvm_server_set_trace_limit (gsize);
+
+void
+gvm_server_trace (gvm_trace_direction_t, const char *, gsize, int);
+
+void
+gvm_server_trace_bytes (guint64 *, guint64 *);
+
 void
 gvm_connection_free (gvm_connection_t *);
 
@@ -76,6 +99,11 @@ int
 gvm_server_open_with_cert (gnutls_session_t *, const char *, int, const char *,
                            const char *, const char *);
 
+int
+gvm_server_open_with_cert_resume (gnutls_session_t *, const char *, int,
+                                  const char *, const char *, const char *,
+                                  const gnutls_datum_t *);
+
 int
 gvm_server_close (int, gnutls_session_t);
 
@@ -91,6 +119,15 @@ gvm_server_vsendf (gnutls_session_t *, const char *, va_list);
 int
 gvm_socket_vsendf (int, const char *, va_list);
 
+int
+gvm_server_send (gnutls_session_t *, const char *, gsize);
+
+int
+gvm_socket_send (int, const char *, gsize);
+
+int
+gvm_connection_send (gvm_connection_t *, const char *, gsize);
+
 int
 gvm_server_sendf_xml (gnutls_session_t *, const char *, ...);
 int
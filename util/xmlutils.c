@@ -26,18 +26,26 @@
  * There are examples of using this interface in omp.c.
  */
 
+/* string.h in glibc needs this for memmem. */
+#define _GNU_SOURCE
+
 #include "xmlutils.h"
 
 #include <assert.h>      /* for assert */
 #include <errno.h>       /* for errno, EAGAIN, EINTR */
-#include <fcntl.h>       /* for fcntl, F_SETFL, O_NONBLOCK */
+#include <fcntl.h>       /* for fcntl, open, F_SETFL, O_NONBLOCK */
 #include <glib.h>        /* for g_free, GSList, g_markup_parse_context_free */
 #include <glib/gtypes.h> /* for GPOINTER_TO_INT, GINT_TO_POINTER, gsize */
+#include <libxml/SAX2.h>
 #include <libxml/parser.h>
 #include <libxml/tree.h>
-#include <string.h> /* for strcmp, strerror, strlen */
-#include <time.h>   /* for time, time_t */
-#include <unistd.h> /* for ssize_t */
+#include <poll.h>     /* for poll, POLLIN, POLLOUT */
+#include <stdio.h>    /* for fdopen, fread, fclose */
+#include <string.h>   /* for memmem, strcmp, strerror, strlen */
+#include <sys/mman.h> /* for mmap, madvise, munmap */
+#include <sys/stat.h> /* for fstat, S_ISREG */
+#include <time.h>     /* for time, time_t */
+#include <unistd.h>   /* for close, ssize_t */
 
 #undef G_LOG_DOMAIN
 /**
@@ -311,13 +319,15 @@ handle_start_element (GMarkupParseContext *context, const gchar *element_name,
 
   (void) context;
   (void) error;
+  entity = make_entity (element_name, NULL);
   if (data->current)
     {
       entity_t current = (entity_t) data->current->data;
-      entity = add_entity (&current->entities, element_name, NULL);
+
+      /* Prepend, to avoid walking the children for every new child.  The
+       * children are put in order when the element ends. */
+      current->entities = g_slist_prepend (current->entities, entity);
     }
-  else
-    entity = add_entity (NULL, element_name, NULL);
 
   add_attributes (entity, attribute_names, attribute_values);
 
@@ -381,11 +391,14 @@ handle_end_element (GMarkupParseContext *context, const gchar *element_name,
                     gpointer user_data, GError **error)
 {
   context_data_t *data = (context_data_t *) user_data;
+  entity_t entity;
 
   (void) context;
   (void) error;
   (void) element_name;
   assert (data->current && data->first);
+  entity = (entity_t) data->current->data;
+  entity->entities = g_slist_reverse (entity->entities);
   if (data->current == data->first)
     {
       assert (strcmp (element_name,
@@ -480,6 +493,104 @@ xml_handle_text (context_data_t *context, const gchar *text, gsize text_len)
   handle_text (NULL, text, text_len, context, NULL);
 }
 
+/**
+ * @brief Elements handed to a callback as soon as they are parsed.
+ */
+typedef struct
+{
+  const gchar *name;                 ///< Name of the elements to stream.
+  entity_stream_callback_t callback; ///< Called for each element.
+  gpointer user_data;                ///< Passed to the callback.
+} entity_stream_t;
+
+/**
+ * @brief XML context while streaming elements.
+ */
+typedef struct
+{
+  context_data_t *context;       ///< Context of the entity handlers.
+  const entity_stream_t *stream; ///< Elements to stream.
+} stream_context_data_t;
+
+/**
+ * @brief Handle the start of an XML element while streaming.
+ *
+ * @param[in]  context           Parser context.
+ * @param[in]  element_name      XML element name.
+ * @param[in]  attribute_names   XML attribute name.
+ * @param[in]  attribute_values  XML attribute values.
+ * @param[in]  user_data         Stream context data.
+ * @param[in]  error             Error parameter.
+ */
+static void
+stream_start_element (GMarkupParseContext *context, const gchar *element_name,
+                      const gchar **attribute_names,
+                      const gchar **attribute_values, gpointer user_data,
+                      GError **error)
+{
+  stream_context_data_t *data = (stream_context_data_t *) user_data;
+
+  handle_start_element (context, element_name, attribute_names,
+                        attribute_values, data->context, error);
+}
+
+/**
+ * @brief Handle the end of an XML element while streaming.
+ *
+ * Elements with the streamed name are detached from their parent, handed to
+ * the callback and freed, so that the tree does not grow with them.  The
+ * parent is still open, so the element is its first child.
+ *
+ * @param[in]  context           Parser context.
+ * @param[in]  element_name      XML element name.
+ * @param[in]  user_data         Stream context data.
+ * @param[in]  error             Error parameter.
+ */
+static void
+stream_end_element (GMarkupParseContext *context, const gchar *element_name,
+                    gpointer user_data, GError **error)
+{
+  stream_context_data_t *data = (stream_context_data_t *) user_data;
+  context_data_t *context_data = data->context;
+  entity_t entity, parent;
+
+  if (context_data->current == NULL
+      || context_data->current == context_data->first
+      || strcmp (element_name, data->stream->name))
+    {
+      handle_end_element (context, element_name, context_data, error);
+      return;
+    }
+
+  entity = (entity_t) context_data->current->data;
+  parent = (entity_t) context_data->current->next->data;
+  handle_end_element (context, element_name, context_data, error);
+  parent->entities = g_slist_remove (parent->entities, entity);
+
+  if (data->stream->callback (entity, data->stream->user_data))
+    g_set_error (error, G_MARKUP_ERROR, G_MARKUP_ERROR_INVALID_CONTENT,
+                 "Callback stopped reading at element %s", element_name);
+  free_entity (entity);
+}
+
+/**
+ * @brief Handle additional text of an XML element while streaming.
+ *
+ * @param[in]  context           Parser context.
+ * @param[in]  text              The text.
+ * @param[in]  text_len          Length of the text.
+ * @param[in]  user_data         Stream context data.
+ * @param[in]  error             Error parameter.
+ */
+static void
+stream_text (GMarkupParseContext *context, const gchar *text, gsize text_len,
+             gpointer user_data, GError **error)
+{
+  stream_context_data_t *data = (stream_context_data_t *) user_data;
+
+  handle_text (context, text, text_len, data->context, error);
+}
+
 /**
  * @brief Handle an OMP XML parsing error.
  *
@@ -496,7 +607,48 @@ handle_error (GMarkupParseContext *context, GError *error, gpointer user_data)
 }
 
 /**
- * @brief Try read an XML entity tree from the manager.
+ * @brief Wait until a non-blocking socket is ready or the timeout is reached.
+ *
+ * Blocks in poll() instead of retrying the read, so waiting for a busy server
+ * costs no CPU.
+ *
+ * @param[in]  socket     Socket to wait for.
+ * @param[in]  events     Events to wait for, POLLIN or POLLOUT.
+ * @param[in]  last_time  Time data was last received.
+ * @param[in]  timeout    Server idle time before giving up, in seconds.
+ *
+ * @return 0 if the socket is ready or the wait was interrupted, -1 on error,
+ *         -4 on timeout.
+ */
+static int
+wait_for_socket (int socket, short events, time_t last_time, int timeout)
+{
+  struct pollfd pollfd;
+  time_t remaining;
+  int ret;
+
+  remaining = timeout - (time (NULL) - last_time);
+  if (remaining <= 0)
+    return -4;
+
+  pollfd.fd = socket;
+  pollfd.events = events;
+  pollfd.revents = 0;
+  ret = poll (&pollfd, 1, remaining * 1000);
+  if (ret < 0)
+    {
+      if (errno == EINTR)
+        return 0;
+      g_warning ("%s: poll failed: %s", __func__, strerror (errno));
+      return -1;
+    }
+  if (ret == 0)
+    return -4;
+  return 0;
+}
+
+/**
+ * @brief Try read an XML entity tree from the manager, streaming elements.
  *
  * @param[in]   session        Pointer to GNUTLS session.
  * @param[in]   timeout        Server idle time before giving up, in seconds.  0
@@ -507,12 +659,16 @@ handle_error (GMarkupParseContext *context, GError *error, gpointer user_data)
  *                             remains NULL.  If a pointer to NULL then it
  * points to a freshly allocated GString on successful return. Otherwise it
  * points to an existing GString onto which the text is appended.
+ * @param[in]   stream         Elements to hand to a callback instead of adding
+ *                             them to the tree.  NULL to stream nothing.
  *
- * @return 0 success, -1 read error, -2 parse error, -3 end of file, -4 timeout.
+ * @return 0 success, -1 read error, -2 parse error or stopped by the stream
+ *         callback, -3 end of file, -4 timeout.
  */
-int
-try_read_entity_and_string (gnutls_session_t *session, int timeout,
-                            entity_t *entity, GString **string_return)
+static int
+try_read_entity_and_string_stream (gnutls_session_t *session, int timeout,
+                                   entity_t *entity, GString **string_return,
+                                   const entity_stream_t *stream)
 {
   GMarkupParser xml_parser;
   GError *error = NULL;
@@ -557,7 +713,13 @@ try_read_entity_and_string (gnutls_session_t *session, int timeout,
 
   /* Create the XML parser. */
 
-  if (entity)
+  if (entity && stream)
+    {
+      xml_parser.start_element = stream_start_element;
+      xml_parser.end_element = stream_end_element;
+      xml_parser.text = stream_text;
+    }
+  else if (entity)
     {
       xml_parser.start_element = handle_start_element;
       xml_parser.end_element = handle_end_element;
@@ -577,10 +739,16 @@ try_read_entity_and_string (gnutls_session_t *session, int timeout,
   context_data.first = NULL;
   context_data.current = NULL;
 
+  stream_context_data_t stream_data;
+  stream_data.context = &context_data;
+  stream_data.stream = stream;
+
   /* Setup the XML context. */
 
-  xml_context =
-    g_markup_parse_context_new (&xml_parser, 0, &context_data, NULL);
+  xml_context = g_markup_parse_context_new (
+    &xml_parser, 0,
+    (entity && stream) ? (gpointer) &stream_data : (gpointer) &context_data,
+    NULL);
 
   /* Read and parse, until encountering end of file or error. */
 
@@ -599,8 +767,15 @@ try_read_entity_and_string (gnutls_session_t *session, int timeout,
                 continue;
               if ((timeout > 0) && (count == GNUTLS_E_AGAIN))
                 {
-                  /* Server still busy, either timeout or try read again. */
-                  if ((timeout - (time (NULL) - last_time)) <= 0)
+                  int ret;
+
+                  /* Server still busy, wait for it until timeout. GNUTLS may
+                   * also be waiting to write, e.g. during a rehandshake. */
+                  ret = wait_for_socket (
+                    socket,
+                    gnutls_record_get_direction (*session) ? POLLOUT : POLLIN,
+                    last_time, timeout);
+                  if (ret == -4)
                     {
                       g_warning ("   timeout\n");
                       if (fcntl (socket, F_SETFL, 0L) < 0)
@@ -610,7 +785,8 @@ try_read_entity_and_string (gnutls_session_t *session, int timeout,
                       g_free (buffer);
                       return -4;
                     }
-                  continue;
+                  if (ret == 0)
+                    continue;
                 }
               else if ((timeout == 0) && (count == GNUTLS_E_AGAIN))
                 {
@@ -674,7 +850,7 @@ try_read_entity_and_string (gnutls_session_t *session, int timeout,
           break;
         }
 
-      g_debug ("<= %.*s\n", (int) count, buffer);
+      gvm_server_trace (GVM_TRACE_RECEIVED, buffer, count, 0);
 
       if (string)
         g_string_append_len (string, buffer, count);
@@ -744,7 +920,7 @@ try_read_entity_and_string (gnutls_session_t *session, int timeout,
 }
 
 /**
- * @brief Try read an XML entity tree from the socket.
+ * @brief Try read an XML entity tree from the socket, streaming elements.
  *
  * @param[in]   socket         Socket to read from.
  * @param[in]   timeout        Server idle time before giving up, in seconds.  0
@@ -755,12 +931,16 @@ try_read_entity_and_string (gnutls_session_t *session, int timeout,
  *                             remains NULL.  If a pointer to NULL then it
  * points to a freshly allocated GString on successful return. Otherwise it
  * points to an existing GString onto which the text is appended.
+ * @param[in]   stream         Elements to hand to a callback instead of adding
+ *                             them to the tree.  NULL to stream nothing.
  *
- * @return 0 success, -1 read error, -2 parse error, -3 end of file, -4 timeout.
+ * @return 0 success, -1 read error, -2 parse error or stopped by the stream
+ *         callback, -3 end of file, -4 timeout.
  */
 static int
-try_read_entity_and_string_s (int socket, int timeout, entity_t *entity,
-                              GString **string_return)
+try_read_entity_and_string_stream_s (int socket, int timeout,
+                                     entity_t *entity, GString **string_return,
+                                     const entity_stream_t *stream)
 {
   GMarkupParser xml_parser;
   GError *error = NULL;
@@ -799,7 +979,13 @@ try_read_entity_and_string_s (int socket, int timeout, entity_t *entity,
 
   /* Create the XML parser. */
 
-  if (entity)
+  if (entity && stream)
+    {
+      xml_parser.start_element = stream_start_element;
+      xml_parser.end_element = stream_end_element;
+      xml_parser.text = stream_text;
+    }
+  else if (entity)
     {
       xml_parser.start_element = handle_start_element;
       xml_parser.end_element = handle_end_element;
@@ -819,10 +1005,16 @@ try_read_entity_and_string_s (int socket, int timeout, entity_t *entity,
   context_data.first = NULL;
   context_data.current = NULL;
 
+  stream_context_data_t stream_data;
+  stream_data.context = &context_data;
+  stream_data.stream = stream;
+
   /* Setup the XML context. */
 
-  xml_context =
-    g_markup_parse_context_new (&xml_parser, 0, &context_data, NULL);
+  xml_context = g_markup_parse_context_new (
+    &xml_parser, 0,
+    (entity && stream) ? (gpointer) &stream_data : (gpointer) &context_data,
+    NULL);
 
   /* Read and parse, until encountering end of file or error. */
 
@@ -838,25 +1030,26 @@ try_read_entity_and_string_s (int socket, int timeout, entity_t *entity,
               if (errno == EINTR)
                 /* Interrupted, try read again. */
                 continue;
-              if (timeout > 0)
+              if ((timeout > 0) && (errno == EAGAIN))
                 {
-                  if (errno == EAGAIN)
+                  int ret;
+
+                  /* Server still busy, wait for it until timeout. */
+                  ret = wait_for_socket (socket, POLLIN, last_time, timeout);
+                  if (ret == -4)
                     {
-                      /* Server still busy, either timeout or try read again. */
-                      if ((timeout - (time (NULL) - last_time)) <= 0)
-                        {
-                          g_warning ("   timeout\n");
-                          if (fcntl (socket, F_SETFL, 0L) < 0)
-                            g_warning ("%s :failed to set socket flag: %s",
-                                       __func__, strerror (errno));
-                          g_markup_parse_context_free (xml_context);
-                          g_free (buffer);
-                          if (string && *string_return == NULL)
-                            g_string_free (string, TRUE);
-                          return -4;
-                        }
+                      g_warning ("   timeout\n");
+                      if (fcntl (socket, F_SETFL, 0L) < 0)
+                        g_warning ("%s :failed to set socket flag: %s",
+                                   __func__, strerror (errno));
+                      g_markup_parse_context_free (xml_context);
+                      g_free (buffer);
+                      if (string && *string_return == NULL)
+                        g_string_free (string, TRUE);
+                      return -4;
                     }
-                  continue;
+                  if (ret == 0)
+                    continue;
                 }
               if (context_data.first && context_data.first->data)
                 {
@@ -900,7 +1093,7 @@ try_read_entity_and_string_s (int socket, int timeout, entity_t *entity,
           break;
         }
 
-      g_debug ("<= %.*s\n", (int) count, buffer);
+      gvm_server_trace (GVM_TRACE_RECEIVED, buffer, count, 0);
 
       if (string)
         g_string_append_len (string, buffer, count);
@@ -975,6 +1168,108 @@ try_read_entity_and_string_s (int socket, int timeout, entity_t *entity,
     }
 }
 
+/**
+ * @brief Try read an XML entity tree from the manager.
+ *
+ * @param[in]   session        Pointer to GNUTLS session.
+ * @param[in]   timeout        Server idle time before giving up, in seconds.  0
+ * to wait forever.
+ * @param[out]  entity         Pointer to an entity tree.
+ * @param[out]  string_return  An optional return location for the text read
+ *                             from the session.  If NULL then it simply
+ *                             remains NULL.  If a pointer to NULL then it
+ * points to a freshly allocated GString on successful return. Otherwise it
+ * points to an existing GString onto which the text is appended.
+ *
+ * @return 0 success, -1 read error, -2 parse error, -3 end of file, -4 timeout.
+ */
+int
+try_read_entity_and_string (gnutls_session_t *session, int timeout,
+                            entity_t *entity, GString **string_return)
+{
+  return try_read_entity_and_string_stream (session, timeout, entity,
+                                            string_return, NULL);
+}
+
+/**
+ * @brief Try read an XML entity tree from the socket.
+ *
+ * @param[in]   socket         Socket to read from.
+ * @param[in]   timeout        Server idle time before giving up, in seconds.  0
+ * to wait forever.
+ * @param[out]  entity         Pointer to an entity tree.
+ * @param[out]  string_return  An optional return location for the text read
+ *                             from the session.  If NULL then it simply
+ *                             remains NULL.  If a pointer to NULL then it
+ * points to a freshly allocated GString on successful return. Otherwise it
+ * points to an existing GString onto which the text is appended.
+ *
+ * @return 0 success, -1 read error, -2 parse error, -3 end of file, -4 timeout.
+ */
+static int
+try_read_entity_and_string_s (int socket, int timeout, entity_t *entity,
+                              GString **string_return)
+{
+  return try_read_entity_and_string_stream_s (socket, timeout, entity,
+                                              string_return, NULL);
+}
+
+/**
+ * @brief Read an XML entity tree from the manager, streaming elements.
+ *
+ * Each element named \p name below the top level element is passed to
+ * \p callback as soon as it is closed and freed afterwards, instead of being
+ * added to the tree.  This keeps the memory used for large responses with
+ * many such elements constant.
+ *
+ * @param[in]   session    Pointer to GNUTLS session.
+ * @param[in]   name       Name of the elements to stream.
+ * @param[in]   callback   Called for each streamed element.
+ * @param[in]   user_data  Passed to the callback.
+ * @param[out]  entity     Pointer to the entity tree without streamed elements.
+ *
+ * @return 0 success, -1 read error, -2 parse error or stopped by the callback,
+ *         -3 end of file.
+ */
+int
+read_entity_streamed (gnutls_session_t *session, const char *name,
+                      entity_stream_callback_t callback, gpointer user_data,
+                      entity_t *entity)
+{
+  entity_stream_t stream;
+
+  stream.name = name;
+  stream.callback = callback;
+  stream.user_data = user_data;
+  return try_read_entity_and_string_stream (session, 0, entity, NULL, &stream);
+}
+
+/**
+ * @brief Read an XML entity tree from the socket, streaming elements.
+ *
+ * @param[in]   socket     Socket to read from.
+ * @param[in]   name       Name of the elements to stream.
+ * @param[in]   callback   Called for each streamed element.
+ * @param[in]   user_data  Passed to the callback.
+ * @param[out]  entity     Pointer to the entity tree without streamed elements.
+ *
+ * @return 0 success, -1 read error, -2 parse error or stopped by the callback,
+ *         -3 end of file.
+ */
+int
+read_entity_streamed_s (int socket, const char *name,
+                        entity_stream_callback_t callback, gpointer user_data,
+                        entity_t *entity)
+{
+  entity_stream_t stream;
+
+  stream.name = name;
+  stream.callback = callback;
+  stream.user_data = user_data;
+  return try_read_entity_and_string_stream_s (socket, 0, entity, NULL,
+                                              &stream);
+}
+
 /**
  * @brief Try read an XML entity tree from the manager.
  *
@@ -1194,91 +1489,458 @@ read_entity_c (gvm_connection_t *connection, entity_t *entity)
 }
 
 /**
- * @brief Read an XML entity tree from a string.
- *
- * @param[in]   string  Input string.
- * @param[out]  entity  Pointer to an entity tree.
- *
- * @return 0 success, -1 read error, -2 parse error, -3 XML ended prematurely.
+ * @brief Read the next chunk of data from a session or socket.
+ *
+ * Retries reads which were interrupted.  If the socket is not ready, waits
+ * for it with wait_for_socket until the timeout is reached.
+ *
+ * @param[in]   session    Pointer to GNUTLS session, or NULL to read from
+ *                         socket.
+ * @param[in]   socket     Socket to read from if session is NULL.
+ * @param[in]   timeout    Server idle time before giving up, in seconds.  0
+ *                         for a blocking socket, where a read which would
+ *                         block is an error.
+ * @param[in]   last_time  Time data was last received.
+ * @param[out]  buffer     Buffer for the data.
+ * @param[in]   size       Size of buffer.
+ *
+ * @return Number of bytes read, 0 on end of file, -1 on error, -4 on timeout.
  */
-int
-parse_entity (const char *string, entity_t *entity)
+static ssize_t
+read_chunk (gnutls_session_t *session, int socket, int timeout,
+            time_t last_time, char *buffer, size_t size)
 {
-  GMarkupParser xml_parser;
-  GError *error = NULL;
-  GMarkupParseContext *xml_context;
-  context_data_t context_data;
-
-  /* Create the XML parser. */
-
-  xml_parser.start_element = handle_start_element;
-  xml_parser.end_element = handle_end_element;
-  xml_parser.text = handle_text;
-  xml_parser.passthrough = NULL;
-  xml_parser.error = handle_error;
-
-  context_data.done = FALSE;
-  context_data.first = NULL;
-  context_data.current = NULL;
-
-  /* Setup the XML context. */
-
-  xml_context =
-    g_markup_parse_context_new (&xml_parser, 0, &context_data, NULL);
+  while (1)
+    {
+      ssize_t count;
+      short events = POLLIN;
+      int ret;
 
-  /* Parse the string. */
+      if (session)
+        {
+          count = gnutls_record_recv (*session, buffer, size);
+          if (count == GNUTLS_E_INTERRUPTED || count == GNUTLS_E_REHANDSHAKE)
+            continue;
+          if (count == GNUTLS_E_AGAIN)
+            {
+              /* GNUTLS may also be waiting to write, e.g. during a
+               * rehandshake. */
+              socket = GPOINTER_TO_INT (gnutls_transport_get_ptr (*session));
+              if (gnutls_record_get_direction (*session))
+                events = POLLOUT;
+            }
+          else if (count < 0)
+            return -1;
+        }
+      else
+        {
+          count = read (socket, buffer, size);
+          if (count < 0 && errno == EINTR)
+            continue;
+          if (count < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+            return -1;
+        }
 
-  g_markup_parse_context_parse (xml_context, string, strlen (string), &error);
-  if (error)
-    {
-      g_error_free (error);
-      if (context_data.first && context_data.first->data)
+      if (count >= 0)
         {
-          free_entity (context_data.first->data);
-          g_slist_free_1 (context_data.first);
+          if (count > 0)
+            gvm_server_trace (GVM_TRACE_RECEIVED, buffer, count, 0);
+          return count;
         }
-      return -2;
+
+      /* Server still busy, wait for it until timeout. */
+      if (timeout <= 0)
+        return -1;
+      ret = wait_for_socket (socket, events, last_time, timeout);
+      if (ret)
+        return ret;
     }
-  if (context_data.done)
+}
+
+/**
+ * @brief Find the end of an XML start or end tag.
+ *
+ * @param[in]  pos  Position within the tag, after the '<'.
+ * @param[in]  end  End of the data.
+ *
+ * @return Position of the closing '>', NULL if the tag is not closed.
+ */
+static const gchar *
+xml_tag_end (const gchar *pos, const gchar *end)
+{
+  gchar quote = 0;
+
+  for (; pos < end; pos++)
     {
-      g_markup_parse_context_end_parse (xml_context, &error);
-      if (error)
+      if (quote)
         {
-          g_warning ("   End error: %s\n", error->message);
-          g_error_free (error);
-          if (context_data.first && context_data.first->data)
-            {
-              free_entity (context_data.first->data);
-              g_slist_free_1 (context_data.first);
-            }
-          return -2;
+          if (*pos == quote)
+            quote = 0;
         }
-      *entity = (entity_t) context_data.first->data;
-      g_slist_free_1 (context_data.first);
-      return 0;
+      else if (*pos == '"' || *pos == '\'')
+        quote = *pos;
+      else if (*pos == '>')
+        return pos;
     }
-  if (context_data.first && context_data.first->data)
-    {
-      free_entity (context_data.first->data);
-      g_slist_free_1 (context_data.first);
-    }
-  return -3;
+  return NULL;
 }
 
 /**
- * @brief Print an XML entity for g_slist_foreach to a GString.
- *
- * @param[in]  entity  The entity, as a gpointer.
- * @param[in]  string  The stream to which to print, as a gpointer.
+ * @brief State of xml_scan_root_end.
  */
-static void
-foreach_print_entity_to_string (gpointer entity, gpointer string)
+typedef struct
 {
-  print_entity_to_string ((entity_t) entity, (GString *) string);
-}
+  gsize pos; ///< Offset up to which the data has been scanned.
+  int depth; ///< Number of open elements.
+} xml_scan_t;
 
 /**
- * @brief Print an XML attribute for g_hash_table_foreach to a GString.
+ * @brief Check whether XML data starts with a markup prefix.
+ *
+ * @param[in]  data    XML data.
+ * @param[in]  len     Length of data.
+ * @param[in]  prefix  Prefix, like "<!--".
+ *
+ * @return 1 if data starts with prefix, 0 if not, -1 if data is too short to
+ *         tell but is a start of prefix.
+ */
+static int
+xml_scan_prefix (const gchar *data, gsize len, const gchar *prefix)
+{
+  gsize prefix_len = strlen (prefix);
+
+  if (memcmp (data, prefix, MIN (len, prefix_len)))
+    return 0;
+  return len < prefix_len ? -1 : 1;
+}
+
+/**
+ * @brief Find the end of the root element in XML data, incrementally.
+ *
+ * Only follows the markup as far as needed to see where the root element is
+ * closed.  Scanning stops before markup which is not complete yet and goes on
+ * from there when called again with more data.
+ *
+ * @param[in]      data  XML data.
+ * @param[in]      len   Length of data.
+ * @param[in,out]  scan  Scan state, zeroed before the first call.
+ *
+ * @return Offset just after the root element, 0 if it is not complete yet.
+ */
+static gsize
+xml_scan_root_end (const gchar *data, gsize len, xml_scan_t *scan)
+{
+  while (scan->pos < len)
+    {
+      const gchar *start, *end;
+      gsize left;
+
+      start = data + scan->pos;
+      left = len - scan->pos;
+      if (*start != '<')
+        {
+          end = memchr (start, '<', left);
+          scan->pos = end ? (gsize) (end - data) : len;
+          continue;
+        }
+      if (left < 2)
+        return 0;
+
+      if (start[1] == '!' || start[1] == '?')
+        {
+          const char *close;
+          gsize skip;
+          int comment, cdata;
+
+          /* Comment, CDATA section, declaration or processing instruction.
+           * Only wait for more data while it can not be told apart yet. */
+          comment = xml_scan_prefix (start, left, "<!--");
+          cdata = xml_scan_prefix (start, left, "<![CDATA[");
+          if (comment < 0 || cdata < 0)
+            return 0;
+          if (comment)
+            {
+              close = "-->";
+              skip = 4;
+            }
+          else if (cdata)
+            {
+              close = "]]>";
+              skip = 9;
+            }
+          else
+            {
+              close = start[1] == '?' ? "?>" : ">";
+              skip = 2;
+            }
+          end = memmem (start + skip, left - skip, close, strlen (close));
+          if (end == NULL)
+            return 0;
+          scan->pos = end + strlen (close) - data;
+          continue;
+        }
+
+      end = xml_tag_end (start + 1, data + len);
+      if (end == NULL)
+        return 0;
+      scan->pos = end + 1 - data;
+      if (start[1] == '/')
+        scan->depth--;
+      else if (end[-1] != '/')
+        scan->depth++;
+      if (scan->depth <= 0)
+        return scan->pos;
+    }
+  return 0;
+}
+
+/**
+ * @brief Size of the reads of try_read_entity_buffered_internal.
+ */
+#define READ_ENTITY_BUFFERED_CHUNK 65536
+
+/**
+ * @brief Try read an XML entity tree, keeping any data received after it.
+ *
+ * @param[in]      session  Pointer to GNUTLS session, or NULL to read from
+ *                          socket.
+ * @param[in]      socket   Socket to read from if session is NULL.
+ * @param[in]      timeout  Server idle time before giving up, in seconds.  0
+ *                          to wait forever.
+ * @param[in,out]  buffer   Data received but not parsed yet.  Read before
+ *                          reading from the session or socket.  On return
+ *                          holds the data received after the entity, or all
+ *                          data received on timeout.
+ * @param[out]     entity   Pointer to an entity tree.
+ *
+ * @return 0 success, -1 read error, -2 parse error, -3 end of file, -4 timeout.
+ */
+static int
+try_read_entity_buffered_internal (gnutls_session_t *session, int socket,
+                                   int timeout, GString *buffer,
+                                   entity_t *entity)
+{
+  xml_scan_t scan;
+  time_t last_time;
+  gsize end;
+  gchar saved;
+  int ret;
+
+  if (timeout > 0)
+    {
+      /* Turn off blocking. */
+
+      if (session)
+        socket = GPOINTER_TO_INT (gnutls_transport_get_ptr (*session));
+      if (fcntl (socket, F_SETFL, O_NONBLOCK) == -1)
+        return -1;
+    }
+
+  time (&last_time);
+  scan.pos = 0;
+  scan.depth = 0;
+  ret = 0;
+  while ((end = xml_scan_root_end (buffer->str, buffer->len, &scan)) == 0)
+    {
+      gsize len = buffer->len;
+      ssize_t count;
+
+      g_string_set_size (buffer, len + READ_ENTITY_BUFFERED_CHUNK);
+      count = read_chunk (session, socket, timeout, last_time,
+                          buffer->str + len, READ_ENTITY_BUFFERED_CHUNK);
+      g_string_set_size (buffer, len + MAX (count, 0));
+      if (count <= 0)
+        {
+          ret = count ? count : -3;
+          break;
+        }
+      time (&last_time);
+    }
+
+  if (timeout > 0 && fcntl (socket, F_SETFL, 0L) < 0)
+    g_warning ("%s: failed to set socket flag: %s", __func__,
+               strerror (errno));
+  if (ret)
+    return ret;
+
+  /* Parse the entity in place, without the data after it. */
+  saved = buffer->str[end];
+  buffer->str[end] = '\0';
+  ret = parse_entity (buffer->str, entity);
+  buffer->str[end] = saved;
+  g_string_erase (buffer, 0, end);
+  return ret;
+}
+#undef READ_ENTITY_BUFFERED_CHUNK
+
+/**
+ * @brief Try read an XML entity tree from the manager, keeping any data
+ *        received after it.
+ *
+ * Unlike try_read_entity, data sent after the entity is not lost, so
+ * responses to several commands sent at once can be read one after the other.
+ * On timeout the data received so far is kept as well, so the read can be
+ * tried again.
+ *
+ * @param[in]      session  Pointer to GNUTLS session.
+ * @param[in]      timeout  Server idle time before giving up, in seconds.  0
+ *                          to wait forever.
+ * @param[in,out]  buffer   Data received but not parsed yet, empty at first.
+ *                          Must be passed to every read from the session.
+ * @param[out]     entity   Pointer to an entity tree.
+ *
+ * @return 0 success, -1 read error, -2 parse error, -3 end of file, -4 timeout.
+ */
+int
+try_read_entity_buffered (gnutls_session_t *session, int timeout,
+                          GString *buffer, entity_t *entity)
+{
+  return try_read_entity_buffered_internal (session, 0, timeout, buffer,
+                                            entity);
+}
+
+/**
+ * @brief Try read an XML entity tree from the socket, keeping any data
+ *        received after it.
+ *
+ * @param[in]      socket   Socket to read from.
+ * @param[in]      timeout  Server idle time before giving up, in seconds.  0
+ *                          to wait forever.
+ * @param[in,out]  buffer   Data received but not parsed yet, empty at first.
+ *                          Must be passed to every read from the socket.
+ * @param[out]     entity   Pointer to an entity tree.
+ *
+ * @return 0 success, -1 read error, -2 parse error, -3 end of file, -4 timeout.
+ */
+int
+try_read_entity_buffered_s (int socket, int timeout, GString *buffer,
+                            entity_t *entity)
+{
+  return try_read_entity_buffered_internal (NULL, socket, timeout, buffer,
+                                            entity);
+}
+
+/**
+ * @brief Read an XML entity tree from the manager, keeping any data received
+ *        after it.
+ *
+ * @param[in]      session  Pointer to GNUTLS session.
+ * @param[in,out]  buffer   Data received but not parsed yet, empty at first.
+ *                          Must be passed to every read from the session.
+ * @param[out]     entity   Pointer to an entity tree.
+ *
+ * @return 0 success, -1 read error, -2 parse error, -3 end of file.
+ */
+int
+read_entity_buffered (gnutls_session_t *session, GString *buffer,
+                      entity_t *entity)
+{
+  return try_read_entity_buffered (session, 0, buffer, entity);
+}
+
+/**
+ * @brief Read an XML entity tree from the socket, keeping any data received
+ *        after it.
+ *
+ * @param[in]      socket  Socket to read from.
+ * @param[in,out]  buffer  Data received but not parsed yet, empty at first.
+ *                         Must be passed to every read from the socket.
+ * @param[out]     entity  Pointer to an entity tree.
+ *
+ * @return 0 success, -1 read error, -2 parse error, -3 end of file.
+ */
+int
+read_entity_buffered_s (int socket, GString *buffer, entity_t *entity)
+{
+  return try_read_entity_buffered_s (socket, 0, buffer, entity);
+}
+
+/**
+ * @brief Read an XML entity tree from a string.
+ *
+ * @param[in]   string  Input string.
+ * @param[out]  entity  Pointer to an entity tree.
+ *
+ * @return 0 success, -1 read error, -2 parse error, -3 XML ended prematurely.
+ */
+int
+parse_entity (const char *string, entity_t *entity)
+{
+  GMarkupParser xml_parser;
+  GError *error = NULL;
+  GMarkupParseContext *xml_context;
+  context_data_t context_data;
+
+  /* Create the XML parser. */
+
+  xml_parser.start_element = handle_start_element;
+  xml_parser.end_element = handle_end_element;
+  xml_parser.text = handle_text;
+  xml_parser.passthrough = NULL;
+  xml_parser.error = handle_error;
+
+  context_data.done = FALSE;
+  context_data.first = NULL;
+  context_data.current = NULL;
+
+  /* Setup the XML context. */
+
+  xml_context =
+    g_markup_parse_context_new (&xml_parser, 0, &context_data, NULL);
+
+  /* Parse the string. */
+
+  g_markup_parse_context_parse (xml_context, string, strlen (string), &error);
+  if (error)
+    {
+      g_error_free (error);
+      if (context_data.first && context_data.first->data)
+        {
+          free_entity (context_data.first->data);
+          g_slist_free_1 (context_data.first);
+        }
+      return -2;
+    }
+  if (context_data.done)
+    {
+      g_markup_parse_context_end_parse (xml_context, &error);
+      if (error)
+        {
+          g_warning ("   End error: %s\n", error->message);
+          g_error_free (error);
+          if (context_data.first && context_data.first->data)
+            {
+              free_entity (context_data.first->data);
+              g_slist_free_1 (context_data.first);
+            }
+          return -2;
+        }
+      *entity = (entity_t) context_data.first->data;
+      g_slist_free_1 (context_data.first);
+      return 0;
+    }
+  if (context_data.first && context_data.first->data)
+    {
+      free_entity (context_data.first->data);
+      g_slist_free_1 (context_data.first);
+    }
+  return -3;
+}
+
+/**
+ * @brief Print an XML entity for g_slist_foreach to a GString.
+ *
+ * @param[in]  entity  The entity, as a gpointer.
+ * @param[in]  string  The stream to which to print, as a gpointer.
+ */
+static void
+foreach_print_entity_to_string (gpointer entity, gpointer string)
+{
+  print_entity_to_string ((entity_t) entity, (GString *) string);
+}
+
+/**
+ * @brief Print an XML attribute for g_hash_table_foreach to a GString.
  *
  * @param[in]  name    The attribute name.
  * @param[in]  value   The attribute value.
@@ -1550,6 +2212,104 @@ xml_string_append (GString *xml, const char *format, ...)
   g_free (piece);
 }
 
+/**
+ * @brief Append text to an XML string, escaping it.
+ *
+ * Escapes like g_markup_escape_text, but directly into the string instead of
+ * into a temporary copy.
+ *
+ * @param[in]  xml     XML string.
+ * @param[in]  text    Text to escape and append.  NULL to append nothing.
+ * @param[in]  length  Length of text, -1 if text is NUL terminated.
+ */
+void
+xml_string_append_text (GString *xml, const char *text, gssize length)
+{
+  const char *run, *pos, *end;
+
+  if (text == NULL)
+    return;
+
+  end = text + (length < 0 ? strlen (text) : (gsize) length);
+  run = pos = text;
+  while (pos < end)
+    {
+      unsigned char c = *pos;
+      const char *entity;
+      unsigned int code;
+      int skip;
+
+      entity = NULL;
+      code = 0;
+      skip = 1;
+      switch (c)
+        {
+        case '&':
+          entity = "&amp;";
+          break;
+        case '<':
+          entity = "&lt;";
+          break;
+        case '>':
+          entity = "&gt;";
+          break;
+        case '\'':
+          entity = "&#39;";
+          break;
+        case '"':
+          entity = "&quot;";
+          break;
+        default:
+          if ((c >= 0x1 && c <= 0x8) || c == 0xb || c == 0xc
+              || (c >= 0xe && c <= 0x1f) || c == 0x7f)
+            code = c;
+          else if (c == 0xc2 && pos + 1 < end
+                   && (unsigned char) pos[1] >= 0x80
+                   && (unsigned char) pos[1] <= 0x9f)
+            {
+              /* C1 control character. */
+              code = (unsigned char) pos[1];
+              skip = 2;
+            }
+          break;
+        }
+
+      if (entity == NULL && code == 0)
+        {
+          pos++;
+          continue;
+        }
+
+      g_string_append_len (xml, run, pos - run);
+      if (entity)
+        g_string_append (xml, entity);
+      else
+        g_string_append_printf (xml, "&#x%x;", code);
+      pos += skip;
+      run = pos;
+    }
+  g_string_append_len (xml, run, pos - run);
+}
+
+/**
+ * @brief Append an XML element with escaped text to an XML string.
+ *
+ * @param[in]  xml   XML string.
+ * @param[in]  name  Name of the element.  Escaped.
+ * @param[in]  text  Text of the element.  Escaped.  NULL for no text.
+ */
+void
+xml_string_append_element (GString *xml, const char *name, const char *text)
+{
+  g_string_append_c (xml, '<');
+  xml_string_append_text (xml, name, -1);
+  g_string_append_c (xml, '>');
+  xml_string_append_text (xml, text, -1);
+  g_string_append (xml, "</");
+  xml_string_append_text (xml, name, -1);
+  g_string_append_c (xml, '>');
+}
+
 /* XML file utilities */
 
 /**
@@ -1620,23 +2380,135 @@ xml_search_handle_start_element (GMarkupParseContext *ctx,
     }
 }
 
+/**
+ * @brief Check a single start tag in an XML search.
+ *
+ * Runs the search parser on the tag alone, closed as an empty element, so
+ * that attribute values are unescaped exactly as in a full parse.
+ *
+ * @param[in]  tag          Start of the tag, at the '<'.
+ * @param[in]  length       Length of the tag, including the closing '>'.
+ * @param[in]  search_data  The search data struct.
+ */
+static void
+xml_search_tag (const gchar *tag, gsize length, xml_search_data_t *search_data)
+{
+  GMarkupParser xml_parser;
+  GMarkupParseContext *xml_context;
+  gboolean empty;
+
+  xml_parser.start_element = xml_search_handle_start_element;
+  xml_parser.end_element = NULL;
+  xml_parser.text = NULL;
+  xml_parser.passthrough = NULL;
+  xml_parser.error = NULL;
+  xml_context = g_markup_parse_context_new (&xml_parser, 0, search_data, NULL);
+
+  empty = length >= 2 && tag[length - 2] == '/';
+  if (g_markup_parse_context_parse (xml_context, tag,
+                                    empty ? length : length - 1, NULL)
+      && (empty || g_markup_parse_context_parse (xml_context, "/>", 2, NULL)))
+    g_markup_parse_context_end_parse (xml_context, NULL);
+
+  g_markup_parse_context_free (xml_context);
+}
+
+/**
+ * @brief Search XML data in memory for an element with given attributes.
+ *
+ * Uses memmem to skip straight to the start tags of the element and only
+ * parses those, stopping at the first match.  Comments and CDATA sections
+ * are skipped, as they may contain markup.  Well-formed XML cannot contain
+ * a '<' anywhere else outside of markup, so no other tags can be missed.
+ *
+ * @param[in]  data         XML data.
+ * @param[in]  size         Size of data.
+ * @param[in]  search_data  The search data struct.
+ *
+ * @return 1 if element was found, 0 if not.
+ */
+static int
+xml_search_mapped (const gchar *data, gsize size,
+                   xml_search_data_t *search_data)
+{
+  const gchar *pos, *end, *comment, *cdata;
+  gchar *needle;
+  gsize needle_len;
+
+  needle = g_strdup_printf ("<%s", search_data->find_element);
+  needle_len = strlen (needle);
+  pos = data;
+  end = data + size;
+  comment = memmem (pos, size, "<!--", 4);
+  cdata = memmem (pos, size, "<![CDATA[", 9);
+
+  while (search_data->found == 0)
+    {
+      const gchar *candidate, *skip, *tag_end;
+
+      candidate = memmem (pos, end - pos, needle, needle_len);
+      if (candidate == NULL)
+        break;
+
+      skip = (comment && (cdata == NULL || comment < cdata)) ? comment : cdata;
+      if (skip && skip < candidate)
+        {
+          const gchar *skip_end;
+
+          if (skip == comment)
+            skip_end = memmem (skip + 4, end - skip - 4, "-->", 3);
+          else
+            skip_end = memmem (skip + 9, end - skip - 9, "]]>", 3);
+          if (skip_end == NULL)
+            break;
+          pos = skip_end + 3;
+          if (comment && comment < pos)
+            comment = memmem (pos, end - pos, "<!--", 4);
+          if (cdata && cdata < pos)
+            cdata = memmem (pos, end - pos, "<![CDATA[", 9);
+          continue;
+        }
+
+      pos = candidate + needle_len;
+      if (pos == end)
+        break;
+      if (!g_ascii_isspace (*pos) && *pos != '/' && *pos != '>')
+        /* Element with a longer name. */
+        continue;
+
+      tag_end = xml_tag_end (pos, end);
+      if (tag_end == NULL)
+        break;
+      xml_search_tag (candidate, tag_end + 1 - candidate, search_data);
+      pos = tag_end + 1;
+    }
+
+  g_free (needle);
+  return search_data->found;
+}
+
 #define XML_FILE_BUFFER_SIZE 1048576
-int
 /**
  * @brief Tests if an XML file contains an element with given attributes.
  *
+ * Regular files are memory mapped and searched with xml_search_mapped.
+ * Other files are parsed as a stream.  Either way the search stops at the
+ * first match.
+ *
  * @param[in]   file_path         Path of the XML file.
  * @param[in]   find_element      Name of the element to find.
  * @param[in]   find_attributes   GHashTable of attributes to find.
  *
  * @return  1 if element was found, 0 if not.
  */
+int
 find_element_in_xml_file (gchar *file_path, gchar *find_element,
                           GHashTable *find_attributes)
 {
   gchar buffer[XML_FILE_BUFFER_SIZE];
   FILE *file;
-  int read_len;
+  int fd, read_len;
+  struct stat st;
   GMarkupParser xml_parser;
   GMarkupParseContext *xml_context;
   xml_search_data_t search_data;
@@ -1646,6 +2518,38 @@ find_element_in_xml_file (gchar *file_path, gchar *find_element,
   search_data.find_attributes = find_attributes;
   search_data.found = 0;
 
+  fd = open (file_path, O_RDONLY);
+  if (fd == -1)
+    {
+      g_warning ("%s: Failed to open '%s': %s", __func__, file_path,
+                 strerror (errno));
+      return 0;
+    }
+
+  if (fstat (fd, &st) == 0 && S_ISREG (st.st_mode) && st.st_size > 0)
+    {
+      void *data;
+
+      data = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED)
+        {
+          madvise (data, st.st_size, MADV_SEQUENTIAL);
+          xml_search_mapped (data, st.st_size, &search_data);
+          munmap (data, st.st_size);
+          close (fd);
+          return search_data.found;
+        }
+    }
+
+  file = fdopen (fd, "r");
+  if (file == NULL)
+    {
+      g_warning ("%s: Failed to open '%s': %s", __func__, file_path,
+                 strerror (errno));
+      close (fd);
+      return 0;
+    }
+
   /* Create the XML parser. */
   xml_parser.start_element = xml_search_handle_start_element;
   xml_parser.end_element = NULL;
@@ -1654,20 +2558,16 @@ find_element_in_xml_file (gchar *file_path, gchar *find_element,
   xml_parser.error = NULL;
   xml_context = g_markup_parse_context_new (&xml_parser, 0, &search_data, NULL);
 
-  file = fopen (file_path, "r");
-  if (file == NULL)
-    {
-      g_markup_parse_context_free (xml_context);
-      g_warning ("%s: Failed to open '%s':", __func__, strerror (errno));
-      return 0;
-    }
-
-  while ((read_len = fread (&buffer, sizeof (char), XML_FILE_BUFFER_SIZE, file))
+  while (search_data.found == 0
+         && (read_len =
+               fread (&buffer, sizeof (char), XML_FILE_BUFFER_SIZE, file))
          && g_markup_parse_context_parse (xml_context, buffer, read_len, &error)
          && error == NULL)
     {
     }
-  g_markup_parse_context_end_parse (xml_context, &error);
+  if (search_data.found == 0)
+    g_markup_parse_context_end_parse (xml_context, &error);
+  g_clear_error (&error);
 
   fclose (file);
 
@@ -1714,6 +2614,267 @@ parse_element (const gchar *string, element_t *element)
   return 0;
 }
 
+/**
+ * @brief State of try_read_element_internal, reached via the parser context.
+ */
+typedef struct
+{
+  int depth;     ///< Number of open elements.
+  gboolean done; ///< Flag which is true when the root element is closed.
+} read_element_state_t;
+
+/**
+ * @brief Handle the start of an element read by try_read_element_internal.
+ *
+ * Counts the open elements and builds the tree with the default SAX2 handler.
+ *
+ * @param[in]  ctx            Parser context.
+ * @param[in]  localname      Local name of the element.
+ * @param[in]  prefix         Namespace prefix of the element.
+ * @param[in]  URI            Namespace URI of the element.
+ * @param[in]  nb_namespaces  Number of namespace definitions.
+ * @param[in]  namespaces     Namespace definitions.
+ * @param[in]  nb_attributes  Number of attributes.
+ * @param[in]  nb_defaulted   Number of defaulted attributes.
+ * @param[in]  attributes     Attributes.
+ */
+static void
+read_element_start (void *ctx, const xmlChar *localname, const xmlChar *prefix,
+                    const xmlChar *URI, int nb_namespaces,
+                    const xmlChar **namespaces, int nb_attributes,
+                    int nb_defaulted, const xmlChar **attributes)
+{
+  xmlParserCtxtPtr parser = (xmlParserCtxtPtr) ctx;
+  read_element_state_t *state = parser->_private;
+
+  state->depth++;
+  xmlSAX2StartElementNs (ctx, localname, prefix, URI, nb_namespaces,
+                         namespaces, nb_attributes, nb_defaulted, attributes);
+}
+
+/**
+ * @brief Handle the end of an element read by try_read_element_internal.
+ *
+ * Stops the parser once the root element is closed, so that the response is
+ * complete without waiting for the other side to close the connection.
+ *
+ * @param[in]  ctx        Parser context.
+ * @param[in]  localname  Local name of the element.
+ * @param[in]  prefix     Namespace prefix of the element.
+ * @param[in]  URI        Namespace URI of the element.
+ */
+static void
+read_element_end (void *ctx, const xmlChar *localname, const xmlChar *prefix,
+                  const xmlChar *URI)
+{
+  xmlParserCtxtPtr parser = (xmlParserCtxtPtr) ctx;
+  read_element_state_t *state = parser->_private;
+
+  xmlSAX2EndElementNs (ctx, localname, prefix, URI);
+  if (--state->depth == 0)
+    {
+      state->done = TRUE;
+      xmlStopParser (parser);
+    }
+}
+
+/**
+ * @brief Try read an XML element tree from a session or socket.
+ *
+ * Feeds the libxml2 push parser directly from the received data, so the
+ * response never goes through GMarkup and entity_t.
+ *
+ * @param[in]   session  Pointer to GNUTLS session, or NULL to read from socket.
+ * @param[in]   socket   Socket to read from if session is NULL.
+ * @param[in]   timeout  Server idle time before giving up, in seconds.  0 to
+ *                       wait forever.
+ * @param[out]  element  Location for parsed element tree.  Set to NULL on
+ *                       failure.  Free with element_free.
+ *
+ * @return 0 success, -1 read error, -2 parse error, -3 end of file, -4 timeout
+ *         or setup error.
+ */
+static int
+try_read_element_internal (gnutls_session_t *session, int socket, int timeout,
+                           element_t *element)
+{
+  xmlSAXHandler sax;
+  xmlParserCtxtPtr parser;
+  read_element_state_t state;
+  xmlDocPtr doc;
+  char *buffer;
+  time_t last_time;
+  int ret;
+
+  LIBXML_TEST_VERSION
+
+  *element = NULL;
+
+  if (xmlMemSetup (g_free, g_malloc, g_realloc, g_strdup))
+    return -4;
+
+  if (session)
+    socket = GPOINTER_TO_INT (gnutls_transport_get_ptr (*session));
+
+  memset (&sax, 0, sizeof (sax));
+  xmlSAXVersion (&sax, 2);
+  sax.startElementNs = read_element_start;
+  sax.endElementNs = read_element_end;
+
+  parser = xmlCreatePushParserCtxt (&sax, NULL, NULL, 0, NULL);
+  if (parser == NULL)
+    return -4;
+  state.depth = 0;
+  state.done = FALSE;
+  parser->_private = &state;
+
+  buffer = g_malloc (BUFFER_SIZE);
+  time (&last_time);
+
+  while (1)
+    {
+      ssize_t count;
+
+      if (timeout > 0
+          && (session == NULL || gnutls_record_check_pending (*session) == 0))
+        {
+          ret = wait_for_socket (socket, POLLIN, last_time, timeout);
+          if (ret)
+            break;
+        }
+
+      count = read_chunk (session, socket, timeout, last_time, buffer,
+                          BUFFER_SIZE);
+      if (count < 0)
+        {
+          ret = count;
+          break;
+        }
+      if (count == 0)
+        {
+          ret = -3;
+          break;
+        }
+
+      time (&last_time);
+
+      if (xmlParseChunk (parser, buffer, count, 0) && !state.done)
+        {
+          ret = -2;
+          break;
+        }
+      if (state.done)
+        {
+          ret = 0;
+          break;
+        }
+    }
+
+  g_free (buffer);
+  doc = parser->myDoc;
+  parser->myDoc = NULL;
+  xmlFreeParserCtxt (parser);
+
+  if (ret)
+    {
+      if (doc)
+        xmlFreeDoc (doc);
+      return ret;
+    }
+
+  *element = xmlDocGetRootElement (doc);
+  return 0;
+}
+
+/**
+ * @brief Try read an XML element tree from the manager.
+ *
+ * @param[in]   session  Pointer to GNUTLS session.
+ * @param[in]   timeout  Server idle time before giving up, in seconds.  0 to
+ *                       wait forever.
+ * @param[out]  element  Location for parsed element tree.  Set to NULL on
+ *                       failure.  Free with element_free.
+ *
+ * @return 0 success, -1 read error, -2 parse error, -3 end of file, -4 timeout
+ *         or setup error.
+ */
+int
+try_read_element (gnutls_session_t *session, int timeout, element_t *element)
+{
+  return try_read_element_internal (session, 0, timeout, element);
+}
+
+/**
+ * @brief Try read an XML element tree from the manager.
+ *
+ * @param[in]   connection  Connection.
+ * @param[in]   timeout     Server idle time before giving up, in seconds.  0 to
+ *                          wait forever.
+ * @param[out]  element     Location for parsed element tree.  Set to NULL on
+ *                          failure.  Free with element_free.
+ *
+ * @return 0 success, -1 read error, -2 parse error, -3 end of file, -4 timeout
+ *         or setup error.
+ */
+int
+try_read_element_c (gvm_connection_t *connection, int timeout,
+                    element_t *element)
+{
+  if (connection->tls)
+    return try_read_element_internal (&connection->session, 0, timeout,
+                                      element);
+  return try_read_element_internal (NULL, connection->socket, timeout,
+                                    element);
+}
+
+/**
+ * @brief Read an XML element tree from the manager.
+ *
+ * @param[in]   session  Pointer to GNUTLS session.
+ * @param[out]  element  Location for parsed element tree.  Set to NULL on
+ *                       failure.  Free with element_free.
+ *
+ * @return 0 success, -1 read error, -2 parse error, -3 end of file, -4 setup
+ *         error.
+ */
+int
+read_element (gnutls_session_t *session, element_t *element)
+{
+  return try_read_element_internal (session, 0, 0, element);
+}
+
+/**
+ * @brief Read an XML element tree from the socket.
+ *
+ * @param[in]   socket   Socket to read from.
+ * @param[out]  element  Location for parsed element tree.  Set to NULL on
+ *                       failure.  Free with element_free.
+ *
+ * @return 0 success, -1 read error, -2 parse error, -3 end of file, -4 setup
+ *         error.
+ */
+int
+read_element_s (int socket, element_t *element)
+{
+  return try_read_element_internal (NULL, socket, 0, element);
+}
+
+/**
+ * @brief Read an XML element tree from the manager.
+ *
+ * @param[in]   connection  Connection.
+ * @param[out]  element     Location for parsed element tree.  Set to NULL on
+ *                          failure.  Free with element_free.
+ *
+ * @return 0 success, -1 read error, -2 parse error, -3 end of file, -4 setup
+ *         error.
+ */
+int
+read_element_c (gvm_connection_t *connection, element_t *element)
+{
+  return try_read_element_c (connection, 0, element);
+}
+
 /**
  * @brief Free an entire element tree.
  *
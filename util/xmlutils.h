@@ -141,6 +141,34 @@ read_entity_s (int, entity_t *);
 int
 read_entity_c (gvm_connection_t *, entity_t *);
 
+int
+try_read_entity_buffered (gnutls_session_t *, int, GString *, entity_t *);
+
+int
+try_read_entity_buffered_s (int, int, GString *, entity_t *);
+
+int
+read_entity_buffered (gnutls_session_t *, GString *, entity_t *);
+
+int
+read_entity_buffered_s (int, GString *, entity_t *);
+
+/**
+ * @brief Callback for the elements streamed by read_entity_streamed.
+ *
+ * Gets the element and the user data.  The element is freed after the
+ * callback returns.  Returns 0 to continue reading, else to stop.
+ */
+typedef int (*entity_stream_callback_t) (entity_t, gpointer);
+
+int
+read_entity_streamed (gnutls_session_t *, const char *,
+                      entity_stream_callback_t, gpointer, entity_t *);
+
+int
+read_entity_streamed_s (int, const char *, entity_stream_callback_t, gpointer,
+                        entity_t *);
+
 int
 read_string (gnutls_session_t *, GString **);
 
@@ -158,6 +186,12 @@ int xml_count_entities (entities_t);
 void
 xml_string_append (GString *, const char *, ...);
 
+void
+xml_string_append_text (GString *, const char *, gssize);
+
+void
+xml_string_append_element (GString *, const char *, const char *);
+
 /* XML file utilities */
 
 int
@@ -170,6 +204,21 @@ typedef struct _xmlNode *element_t;
 int
 parse_element (const gchar *, element_t *);
 
+int
+try_read_element (gnutls_session_t *, int, element_t *);
+
+int
+try_read_element_c (gvm_connection_t *, int, element_t *);
+
+int
+read_element (gnutls_session_t *, element_t *);
+
+int
+read_element_s (int, element_t *);
+
+int
+read_element_c (gvm_connection_t *, element_t *);
+
 void element_free (element_t);
 
 const gchar *element_name (element_t);
@@ -21,6 +21,7 @@
 
 #include <cgreen/cgreen.h>
 #include <cgreen/mocks.h>
+#include <sys/socket.h>
 
 Describe (xmlutils);
 BeforeEach (xmlutils)
@@ -176,6 +177,48 @@ Ensure (xmlutils, next_entities_handles_multiple_children)
   children = next_entities (children);
 }
 
+/* entity_child. */
+
+Ensure (xmlutils, entity_child_finds_first_child_with_name)
+{
+  entity_t entity, child;
+  const gchar *xml;
+
+  xml = "<top><a>1</a><b x='y'>2</b><a>3</a></top>";
+
+  assert_that (parse_entity (xml, &entity), is_equal_to (0));
+
+  child = entity_child (entity, "a");
+  assert_that (child, is_not_null);
+  assert_that (entity_text (child), is_equal_to_string ("1"));
+
+  child = entity_child (entity, "b");
+  assert_that (child, is_not_null);
+  assert_that (entity_text (child), is_equal_to_string ("2"));
+  assert_that (entity_attribute (child, "x"), is_equal_to_string ("y"));
+
+  assert_that (entity_child (entity, "top"), is_null);
+  assert_that (entity_child (entity, "no_such_element_name"), is_null);
+
+  free_entity (entity);
+}
+
+Ensure (xmlutils, entity_child_finds_child_added_by_caller)
+{
+  entity_t entity;
+  gchar *name;
+
+  name = g_strdup_printf ("child_%d", 42);
+  entity = make_entity ("top", NULL);
+  add_entity (&entity->entities, name, "1");
+  g_free (name);
+
+  assert_that (entity_text (entity_child (entity, "child_42")),
+               is_equal_to_string ("1"));
+
+  free_entity (entity);
+}
+
 /* parse_element */
 
 Ensure (xmlutils, parse_element_parses_simple_xml)
@@ -499,6 +542,471 @@ Ensure (xmlutils, parse_element_free_using_child)
   element_free (element);
 }
 
+/* try_read_entity_and_string_s. */
+
+Ensure (xmlutils, try_read_entity_and_string_s_times_out)
+{
+  entity_t entity;
+  int sockets[2];
+  time_t start;
+
+  assert_that (socketpair (AF_UNIX, SOCK_STREAM, 0, sockets), is_equal_to (0));
+
+  entity = NULL;
+  start = time (NULL);
+  assert_that (try_read_entity_and_string_s (sockets[0], 1, &entity, NULL),
+               is_equal_to (-4));
+  assert_that (time (NULL) - start, is_less_than (3));
+  assert_that (entity, is_null);
+
+  close (sockets[0]);
+  close (sockets[1]);
+}
+
+Ensure (xmlutils, try_read_entity_and_string_s_reads_entity)
+{
+  entity_t entity;
+  GString *string;
+  int sockets[2];
+  const gchar *xml;
+
+  assert_that (socketpair (AF_UNIX, SOCK_STREAM, 0, sockets), is_equal_to (0));
+
+  xml = "<a><b>1</b></a>";
+  assert_that (write (sockets[1], xml, strlen (xml)),
+               is_equal_to (strlen (xml)));
+
+  entity = NULL;
+  string = NULL;
+  assert_that (
+    try_read_entity_and_string_s (sockets[0], 1, &entity, &string),
+    is_equal_to (0));
+  assert_that (entity_name (entity), is_equal_to_string ("a"));
+  assert_that (entity_text (entity_child (entity, "b")),
+               is_equal_to_string ("1"));
+  assert_that (string->str, is_equal_to_string (xml));
+
+  free_entity (entity);
+  g_string_free (string, TRUE);
+  close (sockets[0]);
+  close (sockets[1]);
+}
+
+Ensure (xmlutils, try_read_entity_and_string_s_counts_bytes_received)
+{
+  entity_t entity;
+  guint64 before, after;
+  int sockets[2];
+  const gchar *xml;
+
+  assert_that (socketpair (AF_UNIX, SOCK_STREAM, 0, sockets), is_equal_to (0));
+
+  xml = "<a>1</a>";
+  assert_that (write (sockets[1], xml, strlen (xml)),
+               is_equal_to (strlen (xml)));
+
+  gvm_server_trace_bytes (NULL, &before);
+  entity = NULL;
+  assert_that (try_read_entity_and_string_s (sockets[0], 1, &entity, NULL),
+               is_equal_to (0));
+  gvm_server_trace_bytes (NULL, &after);
+  assert_that (after - before, is_equal_to (strlen (xml)));
+
+  free_entity (entity);
+  close (sockets[0]);
+  close (sockets[1]);
+}
+
+/* read_entity_streamed_s. */
+
+static int
+append_streamed_text (entity_t entity, gpointer user_data)
+{
+  GString *texts = (GString *) user_data;
+
+  g_string_append (texts, entity_text (entity));
+  return 0;
+}
+
+static int
+stop_streaming (entity_t entity, gpointer user_data)
+{
+  (void) entity;
+  (void) user_data;
+  return 1;
+}
+
+Ensure (xmlutils, read_entity_streamed_s_passes_elements_to_callback)
+{
+  entity_t entity;
+  GString *texts;
+  int sockets[2];
+  const gchar *xml;
+
+  assert_that (socketpair (AF_UNIX, SOCK_STREAM, 0, sockets), is_equal_to (0));
+
+  xml = "<a><r>1</r><b><r>2</r></b><c>3</c><r>4</r></a>";
+  assert_that (write (sockets[1], xml, strlen (xml)),
+               is_equal_to (strlen (xml)));
+
+  texts = g_string_new ("");
+  entity = NULL;
+  assert_that (read_entity_streamed_s (sockets[0], "r", append_streamed_text,
+                                       texts, &entity),
+               is_equal_to (0));
+  assert_that (texts->str, is_equal_to_string ("124"));
+  assert_that (entity_name (entity), is_equal_to_string ("a"));
+  assert_that (entity_child (entity, "r"), is_null);
+  assert_that (entity_child (entity_child (entity, "b"), "r"), is_null);
+  assert_that (entity_text (entity_child (entity, "c")),
+               is_equal_to_string ("3"));
+
+  free_entity (entity);
+  g_string_free (texts, TRUE);
+  close (sockets[0]);
+  close (sockets[1]);
+}
+
+Ensure (xmlutils, read_entity_streamed_s_stops_when_callback_fails)
+{
+  entity_t entity;
+  int sockets[2];
+  const gchar *xml;
+
+  assert_that (socketpair (AF_UNIX, SOCK_STREAM, 0, sockets), is_equal_to (0));
+
+  xml = "<a><r>1</r><r>2</r></a>";
+  assert_that (write (sockets[1], xml, strlen (xml)),
+               is_equal_to (strlen (xml)));
+
+  entity = NULL;
+  assert_that (
+    read_entity_streamed_s (sockets[0], "r", stop_streaming, NULL, &entity),
+    is_equal_to (-2));
+  assert_that (entity, is_null);
+
+  close (sockets[0]);
+  close (sockets[1]);
+}
+
+/* read_entity_buffered_s. */
+
+/* xml_scan_root_end. */
+
+/**
+ * @brief Scan XML data with xml_scan_root_end from the start.
+ *
+ * @param[in]   data  XML data.
+ * @param[out]  scan  Scan state.
+ *
+ * @return Offset just after the root element, 0 if it is not complete yet.
+ */
+static gsize
+scan_root_end (const gchar *data, xml_scan_t *scan)
+{
+  scan->pos = 0;
+  scan->depth = 0;
+  return xml_scan_root_end (data, strlen (data), scan);
+}
+
+Ensure (xmlutils, xml_scan_root_end_skips_short_markup_at_end_of_data)
+{
+  xml_scan_t scan;
+
+  assert_that (scan_root_end ("<a><!---->", &scan), is_equal_to (0));
+  assert_that (scan.pos, is_equal_to (strlen ("<a><!---->")));
+
+  assert_that (scan_root_end ("<a><?a?>", &scan), is_equal_to (0));
+  assert_that (scan.pos, is_equal_to (strlen ("<a><?a?>")));
+
+  assert_that (scan_root_end ("<a><!x>", &scan), is_equal_to (0));
+  assert_that (scan.pos, is_equal_to (strlen ("<a><!x>")));
+}
+
+Ensure (xmlutils, xml_scan_root_end_waits_for_markup_prefix)
+{
+  xml_scan_t scan;
+
+  assert_that (scan_root_end ("<a><!-", &scan), is_equal_to (0));
+  assert_that (scan.pos, is_equal_to (3));
+
+  assert_that (scan_root_end ("<a><![CDATA", &scan), is_equal_to (0));
+  assert_that (scan.pos, is_equal_to (3));
+
+  /* Not a comment, even though it contains its end. */
+  assert_that (scan_root_end ("<a><!-->x</a>", &scan), is_equal_to (0));
+
+  assert_that (scan_root_end ("<a><![CDATA[</a>]]></a>", &scan),
+               is_equal_to (strlen ("<a><![CDATA[</a>]]></a>")));
+}
+
+Ensure (xmlutils, read_entity_buffered_s_keeps_data_after_entity)
+{
+  entity_t entity;
+  GString *buffer;
+  int sockets[2];
+  const gchar *xml;
+
+  assert_that (socketpair (AF_UNIX, SOCK_STREAM, 0, sockets), is_equal_to (0));
+
+  xml = "<a><b x='>'>1</b><!-- </a> --></a><c/><d>";
+  assert_that (write (sockets[1], xml, strlen (xml)),
+               is_equal_to (strlen (xml)));
+
+  buffer = g_string_new (NULL);
+  assert_that (read_entity_buffered_s (sockets[0], buffer, &entity),
+               is_equal_to (0));
+  assert_that (entity_name (entity), is_equal_to_string ("a"));
+  assert_that (entity_text (entity_child (entity, "b")),
+               is_equal_to_string ("1"));
+  free_entity (entity);
+  assert_that (buffer->str, is_equal_to_string ("<c/><d>"));
+
+  assert_that (read_entity_buffered_s (sockets[0], buffer, &entity),
+               is_equal_to (0));
+  assert_that (entity_name (entity), is_equal_to_string ("c"));
+  free_entity (entity);
+
+  close (sockets[1]);
+  assert_that (read_entity_buffered_s (sockets[0], buffer, &entity),
+               is_equal_to (-3));
+
+  g_string_free (buffer, TRUE);
+  close (sockets[0]);
+}
+
+Ensure (xmlutils, try_read_entity_buffered_s_times_out_keeping_data)
+{
+  entity_t entity;
+  GString *buffer;
+  int sockets[2];
+  time_t start;
+
+  assert_that (socketpair (AF_UNIX, SOCK_STREAM, 0, sockets), is_equal_to (0));
+  assert_that (write (sockets[1], "<a>", 3), is_equal_to (3));
+
+  buffer = g_string_new (NULL);
+  start = time (NULL);
+  assert_that (try_read_entity_buffered_s (sockets[0], 1, buffer, &entity),
+               is_equal_to (-4));
+  assert_that (time (NULL) - start, is_less_than (3));
+  assert_that (buffer->str, is_equal_to_string ("<a>"));
+
+  /* The rest of the entity completes the data received before. */
+  assert_that (write (sockets[1], "1</a>", 5), is_equal_to (5));
+  assert_that (try_read_entity_buffered_s (sockets[0], 1, buffer, &entity),
+               is_equal_to (0));
+  assert_that (entity_name (entity), is_equal_to_string ("a"));
+  assert_that (entity_text (entity), is_equal_to_string ("1"));
+  free_entity (entity);
+
+  g_string_free (buffer, TRUE);
+  close (sockets[0]);
+  close (sockets[1]);
+}
+
+/* read_element_s. */
+
+Ensure (xmlutils, read_element_s_reads_element_without_eof)
+{
+  element_t element;
+  int sockets[2];
+  const gchar *xml;
+
+  assert_that (socketpair (AF_UNIX, SOCK_STREAM, 0, sockets), is_equal_to (0));
+
+  xml = "<a x=\"1\"><b>1 &amp; 2</b><c/></a>";
+  assert_that (write (sockets[1], xml, strlen (xml)),
+               is_equal_to (strlen (xml)));
+
+  element = NULL;
+  assert_that (read_element_s (sockets[0], &element), is_equal_to (0));
+  assert_that (element_name (element), is_equal_to_string ("a"));
+  assert_that (element_attribute (element, "x"), is_equal_to_string ("1"));
+  assert_that (element_text (element_child (element, "b")),
+               is_equal_to_string ("1 & 2"));
+  assert_that (element_child (element, "c"), is_not_null);
+
+  element_free (element);
+  close (sockets[0]);
+  close (sockets[1]);
+}
+
+Ensure (xmlutils, read_element_s_fails_on_bad_xml)
+{
+  element_t element;
+  int sockets[2];
+  const gchar *xml;
+
+  assert_that (socketpair (AF_UNIX, SOCK_STREAM, 0, sockets), is_equal_to (0));
+
+  xml = "<a><b></a>";
+  assert_that (write (sockets[1], xml, strlen (xml)),
+               is_equal_to (strlen (xml)));
+
+  element = NULL;
+  assert_that (read_element_s (sockets[0], &element), is_equal_to (-2));
+  assert_that (element, is_null);
+
+  close (sockets[0]);
+  close (sockets[1]);
+}
+
+Ensure (xmlutils, read_element_s_returns_eof_on_truncated_xml)
+{
+  element_t element;
+  int sockets[2];
+  const gchar *xml;
+
+  assert_that (socketpair (AF_UNIX, SOCK_STREAM, 0, sockets), is_equal_to (0));
+
+  xml = "<a><b>1</b>";
+  assert_that (write (sockets[1], xml, strlen (xml)),
+               is_equal_to (strlen (xml)));
+  close (sockets[1]);
+
+  element = NULL;
+  assert_that (read_element_s (sockets[0], &element), is_equal_to (-3));
+  assert_that (element, is_null);
+
+  close (sockets[0]);
+}
+
+Ensure (xmlutils, try_read_element_internal_times_out)
+{
+  element_t element;
+  int sockets[2];
+  time_t start;
+
+  assert_that (socketpair (AF_UNIX, SOCK_STREAM, 0, sockets), is_equal_to (0));
+
+  element = NULL;
+  start = time (NULL);
+  assert_that (try_read_element_internal (NULL, sockets[0], 1, &element),
+               is_equal_to (-4));
+  assert_that (time (NULL) - start, is_less_than (3));
+  assert_that (element, is_null);
+
+  close (sockets[0]);
+  close (sockets[1]);
+}
+
+/* find_element_in_xml_file. */
+
+/**
+ * @brief Search an XML string with find_element_in_xml_file.
+ *
+ * @param[in]  xml         XML to search.
+ * @param[in]  name        Name of the element to find.
+ * @param[in]  attribute   Name of an attribute to find, or NULL.
+ * @param[in]  value       Value of the attribute.
+ *
+ * @return Result of find_element_in_xml_file.
+ */
+static int
+find_element_in_xml_string (const gchar *xml, gchar *name,
+                            const gchar *attribute, const gchar *value)
+{
+  GHashTable *attributes;
+  gchar *file_path;
+  int fd, found;
+
+  fd = g_file_open_tmp ("xmlutils-test-XXXXXX.xml", &file_path, NULL);
+  assert_that (fd, is_not_equal_to (-1));
+  close (fd);
+  assert_that (g_file_set_contents (file_path, xml, -1, NULL), is_true);
+
+  attributes = g_hash_table_new (g_str_hash, g_str_equal);
+  if (attribute)
+    g_hash_table_insert (attributes, (gpointer) attribute, (gpointer) value);
+  found = find_element_in_xml_file (file_path, name, attributes);
+
+  g_hash_table_destroy (attributes);
+  unlink (file_path);
+  g_free (file_path);
+  return found;
+}
+
+Ensure (xmlutils, find_element_in_xml_file_finds_element)
+{
+  const gchar *xml;
+
+  xml = "<nvts><nvtx oid=\"1.2\"/><nvt oid=\"1.1\"><name>a</name></nvt>"
+        "<nvt oid='1.2' name=\"x &gt; y\"/></nvts>";
+
+  assert_that (find_element_in_xml_string (xml, "nvt", NULL, NULL),
+               is_equal_to (1));
+  assert_that (find_element_in_xml_string (xml, "nvt", "oid", "1.2"),
+               is_equal_to (1));
+  assert_that (find_element_in_xml_string (xml, "nvt", "name", "x > y"),
+               is_equal_to (1));
+  assert_that (find_element_in_xml_string (xml, "nvt", "oid", "1.3"),
+               is_equal_to (0));
+  assert_that (find_element_in_xml_string (xml, "family", NULL, NULL),
+               is_equal_to (0));
+}
+
+Ensure (xmlutils, find_element_in_xml_file_skips_comments_and_cdata)
+{
+  const gchar *xml;
+
+  xml = "<nvts><!-- <nvt oid=\"1.1\"/> --><a><![CDATA[<nvt oid=\"1.2\"/>]]></a>"
+        "<nvt oid=\"1.3\"/></nvts>";
+
+  assert_that (find_element_in_xml_string (xml, "nvt", "oid", "1.1"),
+               is_equal_to (0));
+  assert_that (find_element_in_xml_string (xml, "nvt", "oid", "1.2"),
+               is_equal_to (0));
+  assert_that (find_element_in_xml_string (xml, "nvt", "oid", "1.3"),
+               is_equal_to (1));
+}
+
+Ensure (xmlutils, find_element_in_xml_file_fails_on_missing_file)
+{
+  assert_that (
+    find_element_in_xml_file ("/nonexistent/xmlutils-test.xml", "nvt", NULL),
+    is_equal_to (0));
+}
+
+/* xml_string_append_text. */
+
+Ensure (xmlutils, xml_string_append_text_escapes_like_glib)
+{
+  GString *xml;
+  gchar *expected;
+  const gchar *text;
+
+  text = "a<b>&'\"\x01\x1f\x7f\xc2\x85\xc3\xa4z";
+
+  xml = g_string_new ("x");
+  xml_string_append_text (xml, text, -1);
+  expected = g_markup_escape_text (text, -1);
+  assert_that (xml->str + 1, is_equal_to_string (expected));
+  g_free (expected);
+
+  g_string_truncate (xml, 0);
+  xml_string_append_text (xml, text, 3);
+  assert_that (xml->str, is_equal_to_string ("a&lt;b"));
+
+  g_string_truncate (xml, 0);
+  xml_string_append_text (xml, NULL, -1);
+  assert_that (xml->len, is_equal_to (0));
+
+  g_string_free (xml, TRUE);
+}
+
+Ensure (xmlutils, xml_string_append_element_escapes_name_and_text)
+{
+  GString *xml;
+
+  xml = g_string_new ("");
+  xml_string_append_element (xml, "a", "1 < 2");
+  xml_string_append_element (xml, "b", NULL);
+  assert_that (xml->str, is_equal_to_string ("<a>1 &lt; 2</a><b></b>"));
+
+  g_string_free (xml, TRUE);
+}
+
 /* Test suite. */
 
 int
@@ -518,6 +1026,11 @@ main (int argc, char **argv)
   add_test_with_context (suite, xmlutils,
                          next_entities_handles_multiple_children);
 
+  add_test_with_context (suite, xmlutils,
+                         entity_child_finds_first_child_with_name);
+  add_test_with_context (suite, xmlutils,
+                         entity_child_finds_child_added_by_caller);
+
   add_test_with_context (suite, xmlutils, parse_element_parses_simple_xml);
   add_test_with_context (suite, xmlutils,
                          parse_element_parses_xml_with_attributes);
@@ -533,6 +1046,47 @@ main (int argc, char **argv)
   add_test_with_context (suite, xmlutils,
                          element_next_handles_multiple_children);
 
+  add_test_with_context (suite, xmlutils,
+                         try_read_entity_and_string_s_times_out);
+  add_test_with_context (suite, xmlutils,
+                         try_read_entity_and_string_s_reads_entity);
+  add_test_with_context (suite, xmlutils,
+                         try_read_entity_and_string_s_counts_bytes_received);
+
+  add_test_with_context (suite, xmlutils,
+                         read_entity_streamed_s_passes_elements_to_callback);
+  add_test_with_context (suite, xmlutils,
+                         read_entity_streamed_s_stops_when_callback_fails);
+
+  add_test_with_context (suite, xmlutils,
+                         xml_scan_root_end_skips_short_markup_at_end_of_data);
+  add_test_with_context (suite, xmlutils,
+                         xml_scan_root_end_waits_for_markup_prefix);
+  add_test_with_context (suite, xmlutils,
+                         read_entity_buffered_s_keeps_data_after_entity);
+  add_test_with_context (suite, xmlutils,
+                         try_read_entity_buffered_s_times_out_keeping_data);
+
+  add_test_with_context (suite, xmlutils,
+                         read_element_s_reads_element_without_eof);
+  add_test_with_context (suite, xmlutils, read_element_s_fails_on_bad_xml);
+  add_test_with_context (suite, xmlutils,
+                         read_element_s_returns_eof_on_truncated_xml);
+  add_test_with_context (suite, xmlutils,
+                         try_read_element_internal_times_out);
+
+  add_test_with_context (suite, xmlutils,
+                         find_element_in_xml_file_finds_element);
+  add_test_with_context (suite, xmlutils,
+                         find_element_in_xml_file_skips_comments_and_cdata);
+  add_test_with_context (suite, xmlutils,
+                         find_element_in_xml_file_fails_on_missing_file);
+
+  add_test_with_context (suite, xmlutils,
+                         xml_string_append_text_escapes_like_glib);
+  add_test_with_context (suite, xmlutils,
+                         xml_string_append_element_escapes_name_and_text);
+
   if (argc > 1)
     return run_single_test (suite, argv[1], create_text_reporter ());
 